@@ -1,1185 +1,6511 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <ctype.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "review_store_internal.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 /* Configuration */
 #define MAX_ROWS 100        // Maximum number of csv rows
-#define COLS 6              // Fixed number of columns
 #define MAX_CELL 2048       // Maximum length of one cell
-#define MAX_REVIEW_WIDTH 70 // Maximum width of review text column
 #define MAX 100             // define max value of review
 #define LINE 1024
 #define REVIEW_LEN 4000
+#define DATA_FILE "disneylandreview.csv"
+#define WATCH_POLL_MS 1000     // Fallback poll interval when no file events arrive
+#define BENCH_MIN_SECONDS 0.5   // Minimum time each benchmark is repeated for
+#define TREND_MAX_BRANCHES 32
+#define TREND_MAGIC "TRND0002"
+#define MINHASH_SIZE 64 // MinHash values in a review signature
+#define LSH_BANDS 16    // Signature bands bucketed by the dedupe command
+#define SHINGLE_WORDS 3
+#define DEDUPE_BATCH 4096 // Reviews hashed by one pool task
+#define TERMS_BATCH 2048  // Reviews tokenized by one pool task
+#define TERM_MAX_LEN 32   // Longer words (links, runs of letters) are not counted
+#define HLL_BITS 11       // 2048 registers per HyperLogLog: about 2.3% standard error
+#define HLL_REGISTERS (1 << HLL_BITS)
+#define CM_DEPTH 4
+#define CM_WIDTH 4096     // Count-Min counters per row (a power of two)
+#define HEAVY_TRACKED 64  // Most frequent locations tracked next to the Count-Min sketch
+#define SKETCH_MAGIC "SKCH0002"
+#define EXPORT_FLUSH (1 << 20)  // Buffered export bytes written with one system call
+#define LINT_MIN_SPLIT (4 << 20) // Smallest byte range lint hands to one task
+
+//***************************** Thread Pool *****************************
+
+/* Work-stealing pool shared by every parallel feature. Each thread owns a deque:
+ * it pushes and pops its own tasks at the back, idle threads steal from the front.
+ * The thread that waits for a task group runs tasks too, so deque 0 belongs to it. */
+struct task_group
+{
+    long pending; // tasks submitted but not finished
+};
 
+struct pool_task
+{
+    void (*run)(void *arg);
+    void *arg;
+    struct task_group *group;
+};
 
-//***************************** View Data *****************************
+struct task_deque
+{
+    pthread_mutex_t lock;
+    struct pool_task *items; // ring buffer
+    int head;
+    int count;
+    int cap;
+};
 
-char table[MAX_ROWS][COLS][MAX_CELL]; // Stores csv file in memory
-int rows = 0;
-int col_width[COLS];
+struct thread_pool
+{
+    int nthreads;      // including the waiting thread
+    int started;
+    int pin;           // pin thread i to the i-th CPU we may run on
+    int stop;
+    long queued;       // tasks sitting in any deque
+    pthread_t *threads;
+    struct task_deque *deques;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle;
+};
 
-/* Function Prototypes */
-void view_data(FILE *fp);
-void column_width(void);
-void print_table(void);
-void print_separator(void);
-void print_cell_wrapped(const char *text, int width, int line);
+struct thread_pool pool = {0, 0, 0, 0, 0, NULL, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+static __thread int pool_self;    // deque owned by the calling thread
 
-/* Wrapped lines are counted so the whole review is printed */
-int count_wrapped_lines(const char *text, int width)
+/* Threads the process may run on (respects taskset and cgroup CPU sets, like nproc) */
+int pool_cpu_count(void)
 {
-    int len = strlen(text);
-    int pos = 0;
-    int lines = 0;
-
-    while (pos < len)
-    {
-        int end = pos + width;
-        if (end >= len)
-        {
-            lines++;
-            break;
-        }
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+        return CPU_COUNT(&set);
+#endif
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
 
-        int cut = end;
-        while (cut > pos && text[cut] != ' ')
-        {
-            cut--;
-        }
+/* Sets the thread count used when the pool starts; 0 means one per available CPU */
+void pool_configure(int nthreads, int pin)
+{
+    if (pool.started)
+        return;
+    pool.nthreads = nthreads > 0 ? nthreads : pool_cpu_count();
+    pool.pin = pin;
+}
 
-        if (cut == pos)
-        {
-            pos = end;
-        }
-        else
+static void deque_push(struct task_deque *dq, struct pool_task task)
+{
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->cap)
+    {
+        int cap = dq->cap ? dq->cap * 2 : 64;
+        struct pool_task *items = malloc(sizeof(*items) * cap);
+        if (!items)
         {
-            pos = cut + 1;
+            pthread_mutex_unlock(&dq->lock);
+            task.run(task.arg); // no room: run it here
+            __atomic_sub_fetch(&task.group->pending, 1, __ATOMIC_ACQ_REL);
+            return;
         }
-        lines++;
+        for (int i = 0; i < dq->count; i++)
+            items[i] = dq->items[(dq->head + i) % dq->cap];
+        free(dq->items);
+        dq->items = items;
+        dq->head = 0;
+        dq->cap = cap;
     }
-    return lines;
+    dq->items[(dq->head + dq->count) % dq->cap] = task;
+    dq->count++;
+    __atomic_add_fetch(&pool.queued, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&dq->lock);
 }
 
-/* Word-wrapping for a single cell */
-void print_cell_wrapped(const char *text, int width, int line)
+/* Takes a task from the back (owner) or the front (thief) */
+static int deque_take(struct task_deque *dq, int steal, struct pool_task *task)
 {
-    int len = strlen(text);
-    int pos = 0;
+    int ok = 0;
 
-    // Find the starting position for the requested line
-    for (int l = 0; l < line && pos < len; l++)
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0)
     {
-        int end = pos + width;
-        if (end >= len)
+        if (steal)
         {
-            pos = len;
-            break;
-        }
-
-        int cut = end;
-        while (cut > pos && text[cut] != ' ')
-        {
-            cut--;
-        }
-
-        // Force cut when no space is found
-        if (cut == pos)
-        {
-            pos = end;
+            *task = dq->items[dq->head];
+            dq->head = (dq->head + 1) % dq->cap;
         }
         else
         {
-            pos = cut +1;
+            *task = dq->items[(dq->head + dq->count - 1) % dq->cap];
         }
+        dq->count--;
+        __atomic_sub_fetch(&pool.queued, 1, __ATOMIC_ACQ_REL);
+        ok = 1;
     }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
 
-    // Print empty cell when no more text is left
-    if (pos >= len)
-    {
-        printf("%-*s", width, "");
-        return;
-    }
+/* Runs one task from the own deque or stolen from another. Returns 0 when all are empty */
+static int pool_run_one(void)
+{
+    struct pool_task task;
+    int found = deque_take(&pool.deques[pool_self], 0, &task);
 
-    // Determine end of the current wrapped line
-    int end = pos + width;
-    if (end >= len)
-    {
-        printf("%-*s", width, text + pos);
-        return;
-    }
+    for (int i = 1; !found && i < pool.nthreads; i++)
+        found = deque_take(&pool.deques[(pool_self + i) % pool.nthreads], 1, &task);
+    if (!found)
+        return 0;
 
-    int cut = end;
-    while (cut > pos && text[cut] != ' ')
-    {
-        cut--;
-    }
+    int nested = prof_in_task;
+    prof_in_task = 1;
+    task.run(task.arg);
+    prof_in_task = nested;
+    __atomic_sub_fetch(&task.group->pending, 1, __ATOMIC_ACQ_REL);
+    return 1;
+}
 
-    if (cut == pos)
+static void *pool_worker(void *arg)
+{
+    pool_self = (int)(intptr_t)arg;
+
+    while (1)
     {
-        cut = end;
-    }
+        if (pool_run_one())
+            continue;
 
-    printf("%-*.*s", width, cut - pos, text + pos);
+        pthread_mutex_lock(&pool.idle_lock);
+        while (!pool.stop && __atomic_load_n(&pool.queued, __ATOMIC_ACQUIRE) == 0)
+            pthread_cond_wait(&pool.idle, &pool.idle_lock);
+        int stop = pool.stop;
+        pthread_mutex_unlock(&pool.idle_lock);
+        if (stop)
+            return NULL;
+    }
 }
 
-/* Printing a separator line for displaying table*/
-void print_separator(void)
+static void pool_pin(pthread_t thread, int index)
 {
-    printf("+");
+#ifdef __linux__
+    cpu_set_t allowed, one;
+    int seen = 0;
 
-    for (int c = 0; c < COLS; c++)
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return;
+    index %= CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
     {
-        for (int i = 0; i < col_width[c] + 2; i++)
+        if (CPU_ISSET(cpu, &allowed) && seen++ == index)
         {
-            printf("-");
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(thread, sizeof(one), &one);
+            return;
         }
-        printf("+");
     }
-    printf("\n");
+#else
+    (void)thread;
+    (void)index;
+#endif
 }
 
-/* Calculates ideal width for each column */
-void column_width(void)
+void pool_stop(void);
+
+/* Starts the worker threads on first use. With one thread tasks simply run in pool_wait() */
+static void pool_start(void)
 {
-    const char *header[COLS] = {
-        "Review_ID", "Rating", "Review_Month",
-        "Reviewer_Location", "Review_Text", "Branch"};
+    if (pool.started)
+        return;
+    if (pool.nthreads <= 0)
+        pool_configure(0, pool.pin);
 
-    for (int c = 0; c < COLS; c++)
+    pool.deques = calloc(pool.nthreads, sizeof(struct task_deque));
+    pool.threads = calloc(pool.nthreads, sizeof(pthread_t));
+    if (!pool.deques || !pool.threads)
     {
-        col_width[c] = strlen(header[c]); // Column must be as wide as header (minimum)
-
-        // Find longest cell in current column
-        for (int r = 0; r < rows; r++)
-        {
-            int len = strlen(table[r][c]);
-            if (len > col_width[c])
-            {
-                col_width[c] = len;
-            }
-        }
+        free(pool.deques);
+        free(pool.threads);
+        pool.nthreads = 1;
+        pool.deques = calloc(1, sizeof(struct task_deque));
+        pool.threads = NULL;
+        if (!pool.deques)
+            abort();
     }
+    for (int i = 0; i < pool.nthreads; i++)
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+    pool.started = 1;
 
-    // Limit width of review text column to create optimal table
-    if (col_width[4] > MAX_REVIEW_WIDTH)
+    if (pool.pin)
+        pool_pin(pthread_self(), 0);
+    for (int i = 1; i < pool.nthreads; i++)
     {
-        col_width[4] = MAX_REVIEW_WIDTH;
+        if (pthread_create(&pool.threads[i], NULL, pool_worker, (void *)(intptr_t)i) != 0)
+        {
+            pool.nthreads = i; // run with the threads we got
+            break;
+        }
+        if (pool.pin)
+            pool_pin(pool.threads[i], i);
     }
+    atexit(pool_stop);
 }
 
-/* Reads csv file into table array & supports quoted text fields */
-void view_data(FILE *fp)
+/* Queues a task on the calling thread's deque */
+void pool_submit(struct task_group *group, void (*run)(void *arg), void *arg)
 {
-    char line[32768];
-    rows = 0;
-
-    // Skip header
-    fgets(line, sizeof(line), fp);
-
-    while (fgets(line, sizeof(line), fp) && rows < MAX_ROWS)
-    {
-        int col = 0, pos = 0;
-        int in_quotes = 0;
-
-        for (int i = 0; line[i] && col < COLS; i++)
-        {
-            char ch = line[i];
-
-            // Toggle quoted-field state
-            if (ch == '"')
-            {
-                in_quotes = !in_quotes;
-                continue;
-            }
+    struct pool_task task = {run, arg, group};
 
-            // Ignore \r (Windows line ending)
-            if (ch == '\r')
-            {
-                continue;
-            }
+    pool_start();
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+    deque_push(&pool.deques[pool_self], task);
 
-            // Add separator outside quotes
-            if (ch == ',' && !in_quotes)
-            {
-                table[rows][col][pos] = '\0';
-                col++;
-                pos = 0;
-            }
-            else if (ch != '\n' && pos < MAX_CELL - 1)
-            {
-                table[rows][col][pos++] = ch;
-            }
-        }
+    pthread_mutex_lock(&pool.idle_lock);
+    pthread_cond_signal(&pool.idle);
+    pthread_mutex_unlock(&pool.idle_lock);
+}
 
-        table[rows][col][pos] = '\0';
-        rows++;
+/* Runs tasks until every task of the group has finished */
+void pool_wait(struct task_group *group)
+{
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0)
+    {
+        if (!pool_run_one())
+            sched_yield(); // the rest is running on other threads
     }
 }
 
-/* Prints formatted table */
-void print_table()
+/* Number of threads tasks are spread over */
+int pool_size(void)
 {
-    const char *header[COLS] = {
-        "Review_ID", "Rating", "Review_Month",
-        "Reviewer_Location", "Review_Text", "Branch"};
-
-    print_separator();
+    pool_start();
+    return pool.nthreads;
+}
 
-    // Print header
-    printf("|");
-    for (int c = 0; c < COLS; c++)
-        printf(" %-*s |", col_width[c], header[c]);
-    printf("\n");
+void pool_stop(void)
+{
+    if (!pool.started)
+        return;
+    pthread_mutex_lock(&pool.idle_lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.idle);
+    pthread_mutex_unlock(&pool.idle_lock);
+    for (int i = 1; i < pool.nthreads; i++)
+        pthread_join(pool.threads[i], NULL);
+    pool.started = 0;
+}
 
-    print_separator();
+//***************************** Instrumentation *****************************
 
-    // Print data
-    for (int r = 0; r < rows; r++)
-    {
-        int max_lines = 1;
+/* Bytes the allocator has handed out and not had back, or -1 where the C library can't say */
+static long long heap_in_use(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 mi = mallinfo2(); // sums every arena, so worker threads are included
 
-        // Only columns with wrapping are taken into account
-        for (int c = 2; c < COLS; c++)
-        {
-            int w = col_width[c];
-            int lines = count_wrapped_lines(table[r][c], w);
-            if (lines > max_lines)
-            {
-                max_lines = lines;
-            }
-        }
+    return (long long)(mi.uordblks + mi.hblkhd);
+#else
+    return -1;
+#endif
+}
 
-        // Print wrapped line
-        for (int l = 0; l < max_lines; l++)
-        {
-            printf("|");
+#ifdef __linux__
+/* stdout replacement that counts the bytes printed */
+static ssize_t prof_stdout_write(void *cookie, const char *buf, size_t n)
+{
+    size_t done = 0;
 
-            for (int c = 0; c < COLS; c++)
-            {
-                printf(" ");
+    (void)cookie;
+    while (done < n)
+    {
+        ssize_t w = write(STDOUT_FILENO, buf + done, n - done);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return done > 0 ? (ssize_t)done : -1;
+        done += w;
+    }
+    PROF_COUNT(output_bytes, n);
+    return n;
+}
+#endif
 
-                // ID and Rating are NOT wrapped
-                if (c < 2)
-                {
-                    if (l == 0)
-                    {
-                        printf("%-*s", col_width[c], table[r][c]);
-                    }
-                    else
-                    {
-                        printf("%-*s", col_width[c], "");
-                    }
-                }
-                else
-                {
-                    print_cell_wrapped(table[r][c], col_width[c], l);
-                }
+/* Turns profiling on; output bytes are only counted where stdout can be wrapped */
+void profile_enable(void)
+{
+    profile.enabled = 1;
+#ifdef __linux__
+    cookie_io_functions_t io = {NULL, prof_stdout_write, NULL, NULL};
+    FILE *fp = fopencookie(NULL, "w", io);
 
-                printf(" |");
-            }
-            printf("\n");
-        }
-        print_separator();
+    if (fp)
+    {
+        fflush(stdout);
+        setvbuf(fp, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, BUFSIZ);
+        stdout = fp;
     }
+#endif
 }
 
-//***************************** Sort Data *****************************
+/* Resets the counters at the start of an operation */
+void profile_begin(const char *op)
+{
+    if (!profile.enabled)
+        return;
+    fflush(stdout);
+    memset(profile.seconds, 0, sizeof(profile.seconds));
+    profile.bytes_read = profile.rows_parsed = profile.bytes_parsed = 0;
+    profile.comparisons = profile.output_bytes = profile.bytes_written = profile.syncs = 0;
+    profile.heap_bytes = heap_in_use();
+    profile.op = op;
+    profile.phase = PHASE_OTHER;
+    profile.start = profile.mark = now_seconds();
+}
 
-/* Function to help sort review entries */
-void swap_rows(int a, int b)
+/* Prints the breakdown of the operation to stderr */
+void profile_report(void)
 {
-    char temp[MAX_CELL];
+    static const char *names[PHASE_COUNT] = {"other", "read", "parse", "sort", "render", "write", "sync", "lock"};
+    struct rusage ru;
 
-    for (int c = 0; c < COLS; c++)
-    {
-        strcpy(temp, table[a][c]);
-        strcpy(table[a][c], table[b][c]);
-        strcpy(table[b][c], temp);
-    }
+    if (!profile.enabled)
+        return;
+    fflush(stdout); // buffered output belongs to this operation
+    prof_enter(PHASE_OTHER);
+
+    double total = profile.mark - profile.start;
+    double parse = profile.seconds[PHASE_PARSE];
+
+    fprintf(stderr, "\n--- stats: %s ---\n", profile.op);
+    for (int p = 1; p < PHASE_COUNT; p++)
+        fprintf(stderr, "%-8s %10.6f s\n", names[p], profile.seconds[p]);
+    fprintf(stderr, "%-8s %10.6f s (including user input)\n", names[0], profile.seconds[0]);
+    fprintf(stderr, "%-8s %10.6f s\n", "total", total);
+    fprintf(stderr, "read:   %lld bytes\n", profile.bytes_read);
+    fprintf(stderr, "parse:  %lld rows, %lld bytes, %.1f MB/s\n", profile.rows_parsed, profile.bytes_parsed,
+            parse > 0 ? profile.bytes_parsed / parse / 1e6 : 0.0);
+    fprintf(stderr, "sort:   %lld comparisons\n", profile.comparisons);
+    fprintf(stderr, "output: %lld bytes printed\n", profile.output_bytes);
+    fprintf(stderr, "write:  %lld bytes, %lld syncs\n", profile.bytes_written, profile.syncs);
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        fprintf(stderr, "memory: %ld KB peak RSS", ru.ru_maxrss);
+    long long heap = heap_in_use();
+    if (heap >= 0 && profile.heap_bytes >= 0)
+        fprintf(stderr, ", heap %+lld KB (%lld KB in use)", (heap - profile.heap_bytes) / 1024, heap / 1024);
+    fputc('\n', stderr);
 }
 
-/* Sorts review entries by rating in a descending order*/
-void sort_by_rating_desc()
+//***************************** Checksums *****************************
+
+struct verify_task
 {
-    for (int i = 0; i < rows - 1; i++)
-    {
-        for (int j = 0; j < rows - i - 1; j++)
-        {
-            int r1 = atoi(table[j][1]);
-            int r2 = atoi(table[j + 1][1]);
+    int fd;
+    const struct crc_header *h;
+    const uint32_t *expected;
+    long long first, last; // Blocks first..last-1
+    unsigned char *bad;    // One flag per block of the file
+    int ok;
+};
 
-            if (r1 < r2)
-            {
-                char temp[COLS][MAX_CELL];
-                memcpy(temp, table[j], sizeof(temp));
-                memcpy(table[j], table[j + 1], sizeof(temp));
-                memcpy(table[j + 1], temp, sizeof(temp));
-            }
-        }
-    }
+static void verify_task_run(void *arg)
+{
+    struct verify_task *t = arg;
+    uint32_t *crc = malloc(sizeof(uint32_t) * (t->last - t->first));
+
+    t->ok = crc && crc_blocks(t->fd, t->h->block_size, t->h->length, t->first, t->last, crc);
+    for (long long b = t->first; t->ok && b < t->last; b++)
+        t->bad[b] = crc[b - t->first] != t->expected[b];
+    free(crc);
 }
 
-/* Sorting review entries alphabetically by branch */
-void sort_by_branch(void)
+/* Prints the data rows (and their Review_IDs) overlapping bytes from..to-1 of fd */
+static void verify_rows(int fd, long long from, long long to)
 {
-    for (int i = 0; i < rows - 1; i++)
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long row = 0, first_row = 0, last_row = 0;
+    char first_id[16] = "?", last_id[16] = "?";
+
+    if (!reader_open(&rd, fd, 0))
+        return;
+    rd.want = 1u << COL_ID;
+    reader_skip_header(&rd);
+    while (reader_next(&rd, &rec, 1))
     {
-        for (int j = i + 1; j < rows; j++)
+        row++;
+        if (rec.offset + (long long)rec.length <= from)
+            continue;
+        if (rec.offset >= to)
+            break;
+        if (!first_row)
         {
-            if (strcmp(table[i][5], table[j][5]) > 0)
-            {
-                swap_rows(i, j);
-            }
+            first_row = row;
+            snprintf(first_id, sizeof(first_id), "%.15s", rec.field[COL_ID]);
         }
+        last_row = row;
+        snprintf(last_id, sizeof(last_id), "%.15s", rec.field[COL_ID]);
     }
+    reader_close(&rd);
+
+    if (first_row)
+        printf("    rows %lld..%lld (Review_ID %s..%s)\n", first_row, last_row, first_id, last_id);
+    else if (from == 0)
+        printf("    the header line\n");
 }
 
-/* Menu for sorting */
-int sort_menu()
+/* Checks path against its sidecar and reports damaged byte and row ranges. A file without
+ * checksums gets them recorded. Returns 0 if damage was found or the file can't be read */
+int verify_file(const char *path, int update)
 {
-    // Input is read as char
-    char input[10];
-
-    int choice;
-
-    printf("\nSort reviews by:\n\n");
-    printf("1 No sorting\n");
-    printf("2 Rating (high to low)\n");
-    printf("3 Branch (A-Z)\n\n");
-    printf("Choice: ");
+    struct crc_header h;
+    struct stat st;
+    uint32_t *expected;
+    int damaged = 0;
 
-    if (!fgets(input, sizeof(input), stdin))
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
     {
+        printf("%s: cannot be read (%s)\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
         return 0;
     }
-
-    if (sscanf(input, "%d", &choice) != 1)
+    if (!checksums_load(path, &h, &expected))
     {
-        printf("Please enter a number!\n\n");
-        return 0;
+        close(fd);
+        int ok = checksums_record(path);
+        printf("%s: no checksums yet, %s\n", path, ok ? "recorded them" : "could not record them");
+        return ok;
     }
 
-    if (choice < 1 || choice > 3)
+    // A few tasks per thread so a slow one can be balanced by stealing
+    long long per_task = h.nblocks / (pool_size() * 4) + 1;
+    int ntasks = (int)((h.nblocks + per_task - 1) / per_task);
+    struct verify_task *tasks = calloc(ntasks ? ntasks : 1, sizeof(*tasks));
+    unsigned char *bad = calloc(h.nblocks ? h.nblocks : 1, 1);
+    struct task_group group = {0};
+    double start = now_seconds();
+    int ok = tasks && bad;
+
+    for (int i = 0; ok && i < ntasks; i++)
     {
-        printf("Please enter a number between 1 and 3!\n\n");
-        return 0;
+        tasks[i] = (struct verify_task){fd, &h, expected, i * per_task, (i + 1) * per_task, bad, 0};
+        if (tasks[i].last > h.nblocks)
+            tasks[i].last = h.nblocks;
+        pool_submit(&group, verify_task_run, &tasks[i]);
     }
+    enum prof_phase prev = prof_enter(PHASE_READ);
+    pool_wait(&group);
+    prof_enter(prev);
+    double elapsed = now_seconds() - start;
+    for (int i = 0; ok && i < ntasks; i++)
+        ok = tasks[i].ok;
+
+    if (!ok)
+        printf("%s: checksums could not be computed\n", path);
+    for (long long b = 0; ok && b < h.nblocks;)
+    {
+        if (!bad[b])
+        {
+            b++;
+            continue;
+        }
+        long long e = b;
+        while (e < h.nblocks && bad[e])
+            e++;
+
+        long long from = b * h.block_size;
+        long long to = e * h.block_size < h.length ? e * h.block_size : h.length;
+        if (from >= st.st_size)
+            break; // reported as truncation below
+        if (!damaged++)
+            printf("%s: DAMAGED\n", path);
+        printf("  bytes %lld..%lld do not match their checksums\n", from, (to < st.st_size ? to : st.st_size) - 1);
+        verify_rows(fd, from, to);
+        b = e;
+    }
+    if (ok && st.st_size < h.length)
+    {
+        if (!damaged++)
+            printf("%s: DAMAGED\n", path);
+        printf("  truncated: %lld of %lld bytes left\n", (long long)st.st_size, h.length);
+        verify_rows(fd, st.st_size, h.length);
+    }
+    else if (ok && st.st_size > h.length)
+        printf("%s: %lld appended bytes have no checksums yet\n", path, (long long)st.st_size - h.length);
+
+    if (ok && !damaged)
+        printf("%s: OK (%u blocks, %.1f MB/s)\n", path, h.nblocks,
+               elapsed > 0 ? h.length / elapsed / 1e6 : 0.0);
+    close(fd);
+    free(tasks);
+    free(bad);
+    free(expected);
+
+    if (update && ok && checksums_record(path))
+        printf("%s: checksums recorded for the current contents\n", path);
+    return ok && !damaged;
+}
+
+//***************************** View Data *****************************
+
+char table[MAX_ROWS][COLS][MAX_CELL]; // Stores csv file in memory
+int rows = 0;
+int col_width[COLS];
+int shown[COLS] = {REVIEW_SCHEMA(SCHEMA_ENUM)}; // Columns laid out by print_table(), in order
+int nshown = COLS;
+
+/* Render policy of each column, from the schema */
+#define SCHEMA_WRAPS_WRAP 1
+#define SCHEMA_WRAPS_NOWRAP 0
+#define SCHEMA_WRAPS(col, name, key, type, encoding, wrap, width) SCHEMA_WRAPS_##wrap,
+#define SCHEMA_LIMIT(col, name, key, type, encoding, wrap, width) width,
+static const unsigned char column_wraps[COLS] = {REVIEW_SCHEMA(SCHEMA_WRAPS)};
+static const int column_limit[COLS] = {REVIEW_SCHEMA(SCHEMA_LIMIT)};
+
+/* Function Prototypes */
+int view_data(const char *filename, const struct review_filter *filter);
+void column_width(void);
+void print_table(void);
+void print_separator(void);
+void print_cell_wrapped(const char *text, int width, int line);
+
+/* Length of the pure-ASCII prefix of s. The SIMD path confirms 32 bytes per step */
+static size_t ascii_prefix(const char *s, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    while (i + 32 <= n)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(a, b)) != 0)
+            break;
+        i += 32;
+    }
+#elif defined(__aarch64__)
+    while (i + 32 <= n)
+    {
+        uint8x16_t a = vld1q_u8((const uint8_t *)s + i);
+        uint8x16_t b = vld1q_u8((const uint8_t *)s + i + 16);
+        if (vmaxvq_u8(vorrq_u8(a, b)) >= 0x80)
+            break;
+        i += 32;
+    }
+#endif
+    while (i + 8 <= n)
+    {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        if (w & 0x8080808080808080ULL)
+            break;
+        i += 8;
+    }
+    while (i < n && !(s[i] & 0x80))
+        i++;
+    return i;
+}
+
+/* Decodes one UTF-8 character. Malformed bytes decode one at a time as U+FFFD */
+static size_t utf8_decode(const char *s, size_t n, unsigned *cp)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    size_t len = u[0] >= 0xF0 ? 4 : u[0] >= 0xE0 ? 3 : u[0] >= 0xC0 ? 2 : 1;
+    unsigned c = len == 4 ? u[0] & 0x07 : len == 3 ? u[0] & 0x0F : u[0] & 0x1F;
+
+    if (len == 1 || len > n || u[0] >= 0xF8)
+    {
+        *cp = u[0] < 0x80 ? u[0] : 0xFFFD;
+        return 1;
+    }
+    for (size_t i = 1; i < len; i++)
+    {
+        if ((u[i] & 0xC0) != 0x80)
+        {
+            *cp = 0xFFFD;
+            return 1;
+        }
+        c = (c << 6) | (u[i] & 0x3F);
+    }
+    *cp = c;
+    return len;
+}
+
+/* Terminal columns of a character: 0 for combining marks, 2 for East Asian wide and fullwidth.
+ * Control characters such as tabs take 1: cells print them as a space */
+static int codepoint_width(unsigned cp)
+{
+    if ((cp >= 0x0300 && cp <= 0x036F) || (cp >= 0x200B && cp <= 0x200F) ||
+        (cp >= 0x20D0 && cp <= 0x20FF) || (cp >= 0xFE00 && cp <= 0xFE0F) || cp == 0xFEFF)
+        return 0;
+    if ((cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0xA4CF && cp != 0x303F) ||
+        (cp >= 0xAC00 && cp <= 0xD7A3) || (cp >= 0xF900 && cp <= 0xFAFF) ||
+        (cp >= 0xFE30 && cp <= 0xFE4F) || (cp >= 0xFF00 && cp <= 0xFF60) ||
+        (cp >= 0xFFE0 && cp <= 0xFFE6) || (cp >= 0x1F300 && cp <= 0x1F64F) ||
+        (cp >= 0x1F900 && cp <= 0x1F9FF) || (cp >= 0x20000 && cp <= 0x3FFFD))
+        return 2;
+    return 1;
+}
+
+/* Bytes of s (at most n) that fit in cols terminal columns without splitting a character.
+ * The columns used are stored in *used */
+static size_t width_prefix(const char *s, size_t n, int cols, int *used)
+{
+    size_t i = ascii_prefix(s, n < (size_t)cols ? n : (size_t)cols);
+    int w = (int)i;
+
+    while (i < n)
+    {
+        unsigned cp;
+        size_t len = utf8_decode(s + i, n - i, &cp);
+        int cw = codepoint_width(cp);
+        if (w + cw > cols)
+            break;
+        w += cw;
+        i += len;
+    }
+    *used = w;
+    return i;
+}
+
+/* Terminal columns needed to print text: the width of its widest line */
+int text_width(const char *text)
+{
+    int widest = 0;
+
+    while (1)
+    {
+        const char *nl = strchr(text, '\n');
+        size_t n = nl ? (size_t)(nl - text) : strlen(text);
+        int used;
+        if (nl && n > 0 && text[n - 1] == '\r')
+            n--; // not shown, like in wrap_line
+        width_prefix(text, n, 0x7fffffff, &used);
+        if (used > widest)
+            widest = used;
+        if (!nl)
+            return widest;
+        text = nl + 1;
+    }
+}
+
+/* Finds the line of a wrapped cell that starts at byte pos. Returns its end and stores where
+ * the next line starts; lines break at a line break in the text, else at the last space that
+ * fits, or mid-word if there is none */
+static int wrap_line(const char *text, int len, int pos, int width, int *next)
+{
+    const char *nl = memchr(text + pos, '\n', len - pos);
+    int stop = nl ? (int)(nl - text) : len;
+    int used;
+    int end = pos + (int)width_prefix(text + pos, stop - pos, width, &used);
+
+    if (end >= stop)
+    {
+        *next = nl ? stop + 1 : stop;
+        return nl && stop > pos && text[stop - 1] == '\r' ? stop - 1 : stop; // CR LF ends the line as well
+    }
+    if (end == pos) // a wide character in a one-column cell
+    {
+        unsigned cp;
+        end += utf8_decode(text + pos, stop - pos, &cp);
+        *next = end;
+        return end;
+    }
+
+    int cut = end;
+    while (cut > pos && text[cut] != ' ')
+    {
+        cut--;
+    }
+
+    // Force cut when no space is found
+    if (cut == pos)
+    {
+        *next = end;
+        return end;
+    }
+    *next = cut + 1;
+    return cut;
+}
+
+/* Wrapped lines are counted so the whole review is printed */
+int count_wrapped_lines(const char *text, int width)
+{
+    int len = strlen(text);
+    int pos = 0;
+    int lines = 0;
+
+    while (pos < len)
+    {
+        wrap_line(text, len, pos, width, &pos);
+        lines++;
+    }
+    return lines;
+}
+
+/* Word-wrapping for a single cell, padded to width terminal columns */
+void print_cell_wrapped(const char *text, int width, int line)
+{
+    int len = strlen(text);
+    int pos = 0;
+
+    // Find the starting position for the requested line
+    for (int l = 0; l < line && pos < len; l++)
+    {
+        wrap_line(text, len, pos, width, &pos);
+    }
+
+    // Print empty cell when no more text is left
+    if (pos >= len)
+    {
+        printf("%-*s", width, "");
+        return;
+    }
+
+    int next;
+    int end = wrap_line(text, len, pos, width, &next);
+    int used;
+    width_prefix(text + pos, end - pos, 0x7fffffff, &used);
+
+    // Control characters print as a space, so tabs and stray CRs can't move the borders
+    for (int i = pos; i < end; i++)
+    {
+        if ((unsigned char)text[i] < 0x20 || text[i] == 0x7F)
+        {
+            printf("%.*s ", i - pos, text + pos);
+            pos = i + 1;
+        }
+    }
+    printf("%.*s%*s", end - pos, text + pos, used < width ? width - used : 0, "");
+}
+
+/* Printing a separator line for displaying table*/
+void print_separator(void)
+{
+    printf("+");
+
+    for (int k = 0; k < nshown; k++)
+    {
+        int c = shown[k];
+        for (int i = 0; i < col_width[c] + 2; i++)
+        {
+            printf("-");
+        }
+        printf("+");
+    }
+    printf("\n");
+}
+
+/* Calculates ideal width for each column */
+void column_width(void)
+{
+    enum prof_phase prev = prof_enter(PHASE_RENDER);
+
+    for (int k = 0; k < nshown; k++)
+    {
+        int c = shown[k];
+        col_width[c] = strlen(column_names[c]); // Column must be as wide as header (minimum)
+
+        // Find widest cell in current column, in terminal columns
+        for (int r = 0; r < rows; r++)
+        {
+            int len = text_width(table[r][c]);
+            if (len > col_width[c])
+            {
+                col_width[c] = len;
+            }
+        }
+    }
+
+    // Limit width of columns with a display limit (the review text) to create optimal table
+    for (int c = 0; c < COLS; c++)
+    {
+        if (column_limit[c] && col_width[c] > column_limit[c])
+            col_width[c] = column_limit[c];
+    }
+    prof_enter(prev);
+}
+
+/* Copies a record into the display table, truncating long cells */
+static void table_put(int row, const struct csv_record *rec)
+{
+    for (int c = 0; c < COLS; c++)
+    {
+        size_t n = rec->field_len[c] < MAX_CELL - 1 ? rec->field_len[c] : MAX_CELL - 1;
+        // A cut never leaves half a UTF-8 character behind
+        while (n < rec->field_len[c] && n > 0 && (rec->field[c][n] & 0xC0) == 0x80)
+            n--;
+        memcpy(table[row][c], rec->field[c], n);
+        table[row][c][n] = '\0';
+    }
+}
+
+/* Lays out only the columns in mask (bit per column, 0 for all) */
+void show_columns(unsigned mask)
+{
+    nshown = 0;
+    for (int c = 0; c < COLS; c++)
+    {
+        if (!mask || (mask & (1u << c)))
+            shown[nshown++] = c;
+    }
+}
+
+/* Prints whatever is buffered in the display table */
+static void flush_table(void)
+{
+    if (rows == 0)
+        return;
+    column_width();
+    print_table();
+    rows = 0;
+}
+
+/* Reads the first MAX_ROWS matching reviews into table array (all if filter is NULL). Returns 0 if the data can't be opened */
+int view_data(const char *filename, const struct review_filter *filter)
+{
+    struct review_scan sc;
+    const struct csv_record *rec;
+
+    rows = 0;
+    if (!scan_open(&sc, filename, filter))
+        return 0;
+
+    while (rows < MAX_ROWS && (rec = scan_next(&sc)) != NULL)
+        table_put(rows++, rec);
+
+    scan_close(&sc);
+    return 1;
+}
+
+/* Prints rows first..last (1-based, in view order). A single CSV seeks through its zone map,
+ * which records the offset of every block_records-th row; filtered or sharded data is streamed */
+int view_rows(const char *filename, const struct review_filter *filter, long long first, long long last)
+{
+    struct shard_manifest m;
+    struct zone_map zm;
+    long long row = 1;
+
+    rows = 0;
+    if (manifest_load(filename, &m) || (filter && (filter_restricts_rows(filter) || filter->branch)))
+    {
+        struct review_scan sc;
+        const struct csv_record *rec;
+
+        if (!scan_open(&sc, filename, filter))
+            return 0;
+        sc.skip_text = 1; // rows before the range are only counted
+        while (row <= last && (rec = scan_next(&sc)) != NULL)
+        {
+            if (row++ < first)
+                continue;
+            struct csv_record full = *rec;
+            if (is_text_ref(rec->field[COL_TEXT]))
+            {
+                const char *t = text_store_get(&sc.ts[sc.last], rec->field[COL_TEXT], &full.field_len[COL_TEXT]);
+                if (t)
+                    full.field[COL_TEXT] = (char *)t;
+            }
+            table_put(rows++, &full);
+            if (rows == MAX_ROWS)
+                flush_table();
+        }
+        scan_close(&sc);
+        flush_table();
+        return 1;
+    }
+
+    // Builds the index on first use and extends it when rows were appended since. A rewrite
+    // swapped in between indexing and opening leaves them describing different files: try again
+    int fd = -1;
+    for (int attempt = 0; attempt < 3 && fd < 0; attempt++)
+    {
+        if (!zonemap_sync(filename, &zm, 0))
+            return 0;
+        fd = open(filename, O_RDONLY);
+        if (fd >= 0 && !zonemap_covers(&zm, fd))
+        {
+            close(fd);
+            fd = -1;
+            zonemap_free(&zm);
+        }
+    }
+    struct csv_reader rd;
+    struct csv_record rec;
+    struct text_store ts;
+
+    if (fd < 0 || !reader_open(&rd, fd, 0))
+    {
+        if (fd >= 0)
+            close(fd);
+        zonemap_free(&zm);
+        return 0;
+    }
+    text_store_open(&ts, filename);
+    if (filter)
+        rd.want = filter_columns(filter);
+
+    // Jump to the block holding the first row
+    int b = 0;
+    while (b < zm.nblocks && row + zm.blocks[b].records <= first)
+        row += zm.blocks[b++].records;
+    if (b < zm.nblocks)
+        reader_seek(&rd, zm.blocks[b].start);
+    else
+        row = last + 1; // past the end
+
+    enum prof_phase prev = prof_enter(PHASE_PARSE);
+    while (row <= last && reader_next(&rd, &rec, 1))
+    {
+        if (row++ < first)
+            continue;
+        if (is_text_ref(rec.field[COL_TEXT]))
+        {
+            const char *t = text_store_get(&ts, rec.field[COL_TEXT], &rec.field_len[COL_TEXT]);
+            if (t)
+                rec.field[COL_TEXT] = (char *)t;
+        }
+        table_put(rows++, &rec);
+        if (rows == MAX_ROWS)
+            flush_table();
+    }
+    prof_enter(prev);
+    flush_table();
+
+    text_store_close(&ts);
+    reader_close(&rd);
+    close(fd);
+    zonemap_free(&zm);
+    return 1;
+}
+
+/* Prints formatted table */
+void print_table()
+{
+    enum prof_phase prev = prof_enter(PHASE_RENDER);
+
+    print_separator();
+
+    // Print header
+    printf("|");
+    for (int k = 0; k < nshown; k++)
+        printf(" %-*s |", col_width[shown[k]], column_names[shown[k]]);
+    printf("\n");
+
+    print_separator();
+
+    // Print data
+    for (int r = 0; r < rows; r++)
+    {
+        int max_lines = 1;
+
+        // Only columns with wrapping are taken into account
+        for (int k = 0; k < nshown; k++)
+        {
+            int c = shown[k];
+            if (!column_wraps[c])
+                continue;
+            int w = col_width[c];
+            int lines = count_wrapped_lines(table[r][c], w);
+            if (lines > max_lines)
+            {
+                max_lines = lines;
+            }
+        }
+
+        // Print wrapped line
+        for (int l = 0; l < max_lines; l++)
+        {
+            printf("|");
+
+            for (int k = 0; k < nshown; k++)
+            {
+                int c = shown[k];
+                printf(" ");
+
+                // Columns such as ID and Rating are NOT wrapped
+                if (!column_wraps[c])
+                {
+                    if (l == 0)
+                    {
+                        printf("%-*s", col_width[c], table[r][c]);
+                    }
+                    else
+                    {
+                        printf("%-*s", col_width[c], "");
+                    }
+                }
+                else
+                {
+                    print_cell_wrapped(table[r][c], col_width[c], l);
+                }
+
+                printf(" |");
+            }
+            printf("\n");
+        }
+        print_separator();
+    }
+    prof_enter(prev);
+}
+
+//***************************** Sort Data *****************************
+
+/* Function to help sort review entries */
+void swap_rows(int a, int b)
+{
+    char temp[MAX_CELL];
+
+    for (int c = 0; c < COLS; c++)
+    {
+        strcpy(temp, table[a][c]);
+        strcpy(table[a][c], table[b][c]);
+        strcpy(table[b][c], temp);
+    }
+}
+
+/* Sorts review entries by rating in a descending order*/
+void sort_by_rating_desc()
+{
+    enum prof_phase prev = prof_enter(PHASE_SORT);
+
+    for (int i = 0; i < rows - 1; i++)
+    {
+        for (int j = 0; j < rows - i - 1; j++)
+        {
+            int r1 = parse_int(table[j][COL_RATING], strlen(table[j][COL_RATING]));
+            int r2 = parse_int(table[j + 1][COL_RATING], strlen(table[j + 1][COL_RATING]));
+            PROF_COUNT(comparisons, 1);
+
+            if (r1 < r2)
+            {
+                char temp[COLS][MAX_CELL];
+                memcpy(temp, table[j], sizeof(temp));
+                memcpy(table[j], table[j + 1], sizeof(temp));
+                memcpy(table[j + 1], temp, sizeof(temp));
+            }
+        }
+    }
+    prof_enter(prev);
+}
+
+/* Sorting review entries alphabetically by branch */
+void sort_by_branch(void)
+{
+    enum prof_phase prev = prof_enter(PHASE_SORT);
+
+    for (int i = 0; i < rows - 1; i++)
+    {
+        for (int j = i + 1; j < rows; j++)
+        {
+            PROF_COUNT(comparisons, 1);
+            if (strcmp(table[i][COL_BRANCH], table[j][COL_BRANCH]) > 0)
+            {
+                swap_rows(i, j);
+            }
+        }
+    }
+    prof_enter(prev);
+}
+
+/* Menu for sorting */
+int sort_menu()
+{
+    // Input is read as char
+    char input[10];
+
+    int choice;
+
+    printf("\nSort reviews by:\n\n");
+    printf("1 No sorting\n");
+    printf("2 Rating (high to low)\n");
+    printf("3 Branch (A-Z)\n\n");
+    printf("Choice: ");
+
+    if (!fgets(input, sizeof(input), stdin))
+    {
+        return 0;
+    }
+
+    if (sscanf(input, "%d", &choice) != 1)
+    {
+        printf("Please enter a number!\n\n");
+        return 0;
+    }
+
+    if (choice < 1 || choice > 3)
+    {
+        printf("Please enter a number between 1 and 3!\n\n");
+        return 0;
+    }
+
+    if (choice == 2)
+    {
+        sort_by_rating_desc();
+    }
+    else if (choice == 3)
+    {
+        sort_by_branch();
+    }
+
+    return 1;
+}
+
+// Function to check that only the names of the 12 months are entered by the user
+void inputMonth(char *result, int maxLen)
+{
+    char input[50];
+
+    while (1)
+    {
+        printf("Enter the month you have visited (e.g. April): ");
+
+        if (!fgets(input, sizeof(input), stdin))
+            continue;
+
+        // delete newline
+        input[strcspn(input, "\n")] = '\0';
+
+        if (month_index(input) >= 0)
+        {
+            strncpy(result, input, maxLen - 1);
+            result[maxLen - 1] = '\0';
+            return;
+        }
+
+        printf("Invalid month. Please enter a valid month name.\n");
+    }
+}
+
+//***************************** Add Data *****************************
+
+static char ask_yes_no(const char *prompt);
+
+/*Checks if the file exists. It tries to open the file in read mode. It returns 1 if it works, otherwise 0.*/
+int file_exists(const char *filename)
+{
+    FILE *dl = fopen(filename, "r"); /* opening in read mode is a simple existence/access check */
+    if (dl == NULL)
+        return 0;
+
+    fclose(dl);
+    return 1;
+}
+
+/*Asks the user for all review data. Buffers must hold 100/200/2000/200 bytes. Returns 0 if the input was rejected.*/
+static int input_review(int *rating, char month[], char location[], char review_text[], char branch[])
+{
+    int i;
+    int ch;
+
+    while (1)
+    {
+        printf("Enter your rating (1-5): ");
+
+        if (scanf("%d", rating) != 1)
+        {
+            printf("Rating must be a number!\n");
+            /* clear invalid input from stdin so the loop can retry cleanly */
+            while ((ch = getchar()) != '\n' && ch != EOF) { }
+            continue;
+        }
+
+        while ((ch = getchar()) != '\n' && ch != EOF) { } /* consume leftover newline */
+
+        if (*rating < 1 || *rating > 5)
+        {
+            printf("Rating must be between 1 and 5!\n");
+            continue;
+        }
+
+        break;
+    }
+
+    inputMonth(month, 100); /* external helper: reads month text into buffer safely */
+
+    for (i = 0; month[i] != '\0'; i++)
+    {
+        if (month[i] >= '0' && month[i] <= '9')
+        {
+            printf("Month must not contain numbers!\n");
+            return 0; /* early exit on invalid month */
+        }
+    }
+
+    while (1)
+    {
+        printf("Enter your location: ");
+        if (scanf(" %199[^\n]", location) != 1)
+        {
+            printf("Location input is invalid!\n");
+            while ((ch = getchar()) != '\n' && ch != EOF) { }
+            continue;
+        }
+        getchar(); /* consume newline after the scanset read */
+
+        for (i = 0; location[i] != '\0'; i++)
+        {
+            if (location[i] >= '0' && location[i] <= '9')
+            {
+                printf("Location must not contain numbers!\n");
+                break;
+            }
+        }
+
+        if (location[i] == '\0')
+            break; /* only accept location if no digits were found */
+    }
+
+    printf("Enter your review: ");
+    scanf(" %1999[^\n]", review_text); /* read full line (up to buffer limit) */
+    getchar();
+
+    while (1)
+    {
+        printf("Enter the branch you have visited (e.g. Disneyland_Paris): ");
+        if (scanf(" %199[^\n]", branch) != 1)
+        {
+            printf("Branch input is invalid!\n");
+            while ((ch = getchar()) != '\n' && ch != EOF) { }
+            continue;
+        }
+        getchar();
+
+        for (i = 0; branch[i] != '\0'; i++)
+        {
+            if (branch[i] >= '0' && branch[i] <= '9')
+            {
+                printf("Branch must not contain numbers!\n");
+                break;
+            }
+        }
+
+        if (branch[i] == '\0')
+            break;
+    }
+
+    printf("\n");
+    return 1;
+}
+
+/* One review typed in by the user, waiting to be written */
+struct typed_review
+{
+    int rating;
+    char month[100];
+    char location[200];
+    char review_text[2000];
+    char branch[200];
+};
+
+/*Asks for reviews until the user stops. All of them are appended at the bottom of the CSV (or its branch shard) in one batch.
+  The file is only locked once typing is done, so other operators never wait for this user.*/
+void add_review_append_only(const char *filename)
+{
+    struct review_writer w;
+    enum durability durability = parse_durability(getenv("REVIEW_DURABILITY"), DURABLE_BATCH);
+    struct typed_review *typed = NULL;
+    int ntyped = 0;
+    int added = 0;
+
+    do
+    {
+        struct typed_review *tmp = realloc(typed, sizeof(*typed) * (ntyped + 1));
+        if (!tmp)
+            break;
+        typed = tmp;
+
+        struct typed_review *t = &typed[ntyped];
+        if (input_review(&t->rating, t->month, t->location, t->review_text, t->branch))
+            ntyped++;
+    } while (ask_yes_no("Do you want to add another review? (y/n): ") == 'y');
+
+    if (ntyped == 0)
+    {
+        free(typed);
+        return;
+    }
+
+    if (!writer_open(&w, filename, durability)) /* append-only write: preserve existing records */
+    {
+        printf("\nError: %s could not be opened, your review was not saved.\n", filename);
+        free(typed);
+        return;
+    }
+
+    for (int i = 0; i < ntyped; i++)
+    {
+        struct typed_review *t = &typed[i];
+        struct review_values v = {.rating = t->rating, .month = t->month, .location = t->location,
+                                  .text = t->review_text, .branch = t->branch};
+        if (writer_add(&w, &v))
+            added++;
+    }
+    free(typed);
+
+    if (!writer_close(&w) || added < ntyped)
+    {
+        printf("\nError: your review could not be saved.\n");
+        return;
+    }
+
+    printf("\nThank you! We have successfully received your review.\n");
+}
+
+//***************************** Delete Data *****************************
+
+/* Trim newline characters from the end of the input string */
+static void trim_newline(char *s)
+{
+    if (!s)
+        return;
+    size_t n = strlen(s);
+    while (n > 0 && (s[n - 1] == '\n' || s[n - 1] == '\r'))
+    {
+        s[n - 1] = '\0';
+        n--;
+    }
+}
+
+/* Ask the user a yes/no question until valid input is given */
+static char ask_yes_no(const char *prompt)
+{
+    char ans[32];
+    while (1)
+    {
+        printf("%s", prompt);
+        if (!fgets(ans, sizeof(ans), stdin))
+            return 'n';
+        trim_newline(ans);
+
+        if (ans[0] == 'y' || ans[0] == 'Y')
+            return 'y';
+        if (ans[0] == 'n' || ans[0] == 'N')
+            return 'n';
+
+        printf("Please enter y or n.\n");
+    }
+}
+
+/* Delete a review by Review ID */
+void delete_review(const char *filename)
+{
+    /* Sharded data is spread over one file per branch */
+    char paths[MAX_SHARDS][PATH_LEN];
+
+    if (data_files(filename, paths) == 0)
+    {
+        printf("There are no reviews to delete.\n");
+        return;
+    }
+
+    /* Keep asking until user enters a valid and existing Review ID */
+    int delete_id = 0;
+    char line[128];
+
+    while (1)
+    {
+        printf("Enter the Review ID to delete: ");
+        if (!fgets(line, sizeof(line), stdin))
+            continue;
+        trim_newline(line);
+
+        /* Input must be a number only */
+        int value;
+        char extra;
+        if (sscanf(line, "%d %c", &value, &extra) != 1)
+        {
+            printf("\nInvalid Review ID. Please enter numbers only.\n\n");
+            continue;
+        }
+
+        delete_id = value;
+
+        /* Look the review up with a scan: zone maps skip the blocks that can't hold it and the rest
+           is read ahead while it is parsed. The fields are only valid until the scan is closed */
+        struct review_filter f;
+        struct review_scan sc;
+        const struct csv_record *rec;
+
+        filter_init(&f);
+        f.min_id = f.max_id = delete_id;
+        if (!scan_open(&sc, filename, &f))
+        {
+            printf("File not found %s\n", filename);
+            return;
+        }
+        rec = scan_next(&sc);
+        if (rec)
+        {
+            /* Display the selected review */
+            printf("\n--- Review Found ---\n");
+            printf("ID: %s\nRating: %s\nMonth: %s\nLocation: %s\nReview: %s\nBranch: %s\n", rec->field[COL_ID],
+                   rec->field[COL_RATING], rec->field[COL_MONTH], rec->field[COL_LOCATION], rec->field[COL_TEXT],
+                   rec->field[COL_BRANCH]);
+        }
+        scan_close(&sc);
+
+        if (!rec)
+        {
+            printf("\nReview ID not found. Please try again.\n\n");
+            continue;
+        }
+
+        break;
+    }
+
+    /* Double confirmation to prevent accidental deletion */
+    if (ask_yes_no("\nDo you want to delete this review? (y/n): ") == 'n')
+    {
+        printf("\nThis review has NOT been deleted.\n");
+        return;
+    }
+
+    if (ask_yes_no("\nAre you sure you want to delete this review? (y/n): ") == 'n')
+    {
+        printf("\nThis review has NOT been deleted.\n");
+        return;
+    }
+
+    /* The store rewrites the file (or shard) as it is now, under the dataset lock, and swaps the
+       result in, so reviews added since the review was shown are kept */
+    struct review_store *store = review_store_open(filename);
+    int removed = store ? review_store_delete(store, &delete_id, 1) : -1;
+
+    if (removed < 0)
+        printf("\nError: cannot write file.\n");
+    else if (removed == 0)
+        printf("\nThis review was already deleted by someone else.\n");
+    else
+        printf("\nReview deleted successfully.\n");
+    if (store)
+        review_store_close(store);
+}
+
+//***************************** Edit Data *****************************
+
+/* =========================
+Struct for collecting review
+========================= */
+struct Review
+{
+    int id;                  // Review ID
+    int rating;              // Rating
+    char month[20];          // Review month
+    char location[50];       // Reviewer location
+    char review[REVIEW_LEN]; // Review text
+    char branch[50];         // Disneyland branch
+};
+
+struct Review reviews[MAX]; // array collect all review
+int count = 0;              // collect the amount of review
+
+//comma in review
+void parseCSVLine(char *line, struct Review *r)
+{
+    char fields[COLS][REVIEW_LEN];
+    int field = 0, i = 0, j = 0;
+    int in_quotes = 0;
+
+    for (int k = 0; k < COLS; k++)
+        fields[k][0] = '\0';
+
+    while (line[i] != '\0' && field < COLS)
+    {
+        if (line[i] == '"')
+        {
+            in_quotes = !in_quotes;
+        }
+        else if (line[i] == ',' && !in_quotes)
+        {
+            fields[field][j] = '\0';
+            field++;
+            j = 0;
+        }
+        else
+        {
+            fields[field][j++] = line[i];
+        }
+        i++;
+    }
+    fields[field][j] = '\0';
+
+    /* copy to struct */
+    r->id = parse_int(fields[COL_ID], strlen(fields[COL_ID]));
+    r->rating = parse_int(fields[COL_RATING], strlen(fields[COL_RATING]));
+    snprintf(r->month, sizeof(r->month), "%s", fields[COL_MONTH]);
+    snprintf(r->location, sizeof(r->location), "%s", fields[COL_LOCATION]);
+    snprintf(r->review, sizeof(r->review), "%s", fields[COL_TEXT]);
+    snprintf(r->branch, sizeof(r->branch), "%s", fields[COL_BRANCH]);
+}
+
+// function check int of id and rating
+int inputInt(const char *message)
+{
+    char line[100];
+    int value;
+
+    while (1)
+    {
+        printf("%s", message);
+        // if it not int it will be continue in the while loop
+        if (!fgets(line, sizeof(line), stdin))
+            continue;
+        // condition if it "int" it will return the value
+        if (sscanf(line, "%d", &value) == 1)
+            return value;
+
+        printf("\nPlease enter numbers only!\n");
+    }
+}
+
+// function loadcsv
+void loadCSV()
+{
+    /* sharded data is read shard by shard, all as of the same moment */
+    char paths[MAX_SHARDS][PATH_LEN];
+    int hold = shards_hold(DATA_FILE, 0);
+    int npaths = data_files(DATA_FILE, paths);
+    char line[REVIEW_LEN];
+
+    count = 0;
+
+    enum prof_phase prev = prof_enter(PHASE_PARSE);
+    for (int p = 0; p < npaths; p++)
+    {
+        struct csv_reader rd;
+        struct csv_record rec;
+
+        prof_enter(PHASE_READ);
+        int fd = open(paths[p], O_RDONLY);
+        prof_enter(PHASE_PARSE);
+
+        if (fd < 0)
+            continue;
+        if (!reader_open(&rd, fd, 0))
+        {
+            close(fd);
+            continue;
+        }
+
+        /* skip header, then let the next chunks load while these are parsed */
+        reader_skip_header(&rd);
+        reader_read_ahead(&rd);
+
+        while (count < MAX && reader_next(&rd, &rec, 1))
+        {
+            /* the raw row, without its line break */
+            size_t n = rec.length < sizeof(line) - 1 ? rec.length : sizeof(line) - 1;
+            memcpy(line, rd.buf + (rec.offset - rd.pos), n);
+            while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+                n--;
+            line[n] = '\0';
+
+            parseCSVLine(line, &reviews[count]);
+
+            /* compressed text is expanded so an edit can save it as plain text */
+            resolve_review_text(paths[p], reviews[count].review, sizeof(reviews[count].review));
+            count++;
+        }
+
+        reader_close(&rd);
+        close(fd);
+    }
+    prof_enter(prev);
+    shards_release(hold);
+}
+
+int inputRating(const char *message)
+{
+    char line[100];
+    int value;
+
+    while (1)
+    {
+        printf("%s", message);
+
+        if (!fgets(line, sizeof(line), stdin))
+            continue;
+
+        if (sscanf(line, "%d", &value) != 1)
+        {
+            printf("\nPlease enter numbers only!\n");
+            continue;
+        }
+
+        if (value < 1 || value > 5)
+        {
+            printf("\nRating must be between 1 and 5!\n");
+            continue;
+        }
+
+        return value;
+    }
+}
+
+void inputBranch(char branch[], int size)
+{
+    int i;
+    char ch;
+
+    while (1)
+    {
+        printf("Enter the branch you have visited (e.g. Disneyland_Paris): ");
+
+        if (scanf(" %49[^\n]", branch) != 1)
+        {
+            printf("Branch input is invalid!\n");
+            while ((ch = getchar()) != '\n' && ch != EOF) { }
+            continue;
+        }
+        getchar(); // clear newline
+
+        for (i = 0; branch[i] != '\0'; i++)
+        {
+            if (branch[i] >= '0' && branch[i] <= '9')
+            {
+                printf("Branch must not contain numbers!\n");
+                break;
+            }
+        }
+
+        if (branch[i] == '\0')
+            break;   
+    }
+}
+
+void inputLocation(char location[], int size)
+{
+    int i;
+    char ch;
+
+    while (1)
+    {
+        printf("Enter your location: ");
+
+        if (scanf(" %49[^\n]", location) != 1)
+        {
+            printf("Location input is invalid!\n");
+            while ((ch = getchar()) != '\n' && ch != EOF) { }
+            continue;
+        }
+        getchar(); // clear newline
+
+        for (i = 0; location[i] != '\0'; i++)
+        {
+            if (location[i] >= '0' && location[i] <= '9')
+            {
+                printf("Location must not contain numbers!\n");
+                break;
+            }
+        }
+
+        if (location[i] == '\0')
+            break;  
+    }
+}
+
+// find data by ID
+int findByID(int id)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (reviews[i].id == id)
+            return i; // find → send index back
+    }
+    return -1; // can't find
+}
+
+// function editReview
+void editReview(int index)
+{
+    printf("\n--- Edit Review ---\n");
+
+    // use function inputint
+    reviews[index].rating = inputRating("Enter the Rating (1-5): ");
+
+    // printf("Enter the month you have visited (e.g. April): ");
+    inputMonth(reviews[index].month, sizeof(reviews[index].month));
+
+    inputLocation(reviews[index].location, sizeof(reviews[index].location));
+
+    printf("Enter your review: ");
+    scanf(" %3999[^\n]", reviews[index].review);
+
+    inputBranch(reviews[index].branch, sizeof(reviews[index].branch));
+
+    // save only this review: the store rewrites the file as it is now, so reviews other
+    // operators added or deleted since loadCSV() are not undone
+    struct review_update u = {reviews[index].id, {reviews[index].rating, reviews[index].month,
+                              reviews[index].location, reviews[index].review, reviews[index].branch}};
+    struct review_store *store = review_store_open(DATA_FILE);
+    int changed = store ? review_store_update(store, &u, 1) : -1;
+    if (store)
+        review_store_close(store);
+
+    if (changed < 0)
+        printf("\nError: the review could not be saved.\n");
+    else if (changed == 0)
+        printf("\nThis review was deleted by someone else in the meantime.\n");
+    else
+        printf("\nReview updated successfully!\n");
+}
+
+// Funtion to show the whole process
+void editMenu()
+{
+    count = 0;
+    loadCSV(); // use function loadcsv
+
+    // Giving user to Enter review id
+    //  use function inputint
+    int id; 
+    int index; 
+
+    while (1)
+    {
+        id = inputInt("Enter the Review ID: ");
+        index = findByID(id);
+
+        if (index == -1)
+        {
+            printf("\nReview ID not found! Please try again.\n");
+            continue;  
+        }
+
+        break;
+    }
+
+    /* show data to make sure!! */
+    printf("\nID: %d\n", reviews[index].id);
+    printf("Rating: %d\n", reviews[index].rating);
+    printf("Month: %s\n", reviews[index].month);
+    printf("Location: %s\n", reviews[index].location);
+    printf("Review: %s\n", reviews[index].review);
+    printf("Branch: %s\n", reviews[index].branch);
+
+    char confirm;
+    printf("\nDo you want to edit this review? (y/n): ");
+    scanf(" %c", &confirm);
+
+    // clear buffer
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF)
+        ;
+
+    if (confirm == 'y' || confirm == 'Y')
+    {
+        editReview(index);
+    }
+    return;
+}
+
+//***************************** Review Statistics *****************************
+
+/* Running totals for one branch */
+struct branch_stats
+{
+    char name[50];
+    long long reviews;
+    long long rating_sum;
+    long long by_rating[5]; // Count of 1..5 star reviews
+};
+
+/* Per-branch totals built while streaming records */
+struct review_stats
+{
+    long long total;
+    struct branch_stats *branches;
+    int nbranches;
+    int branch_cap;
+};
+
+void stats_reset(struct review_stats *st)
+{
+    st->total = 0;
+    st->nbranches = 0;
+}
+
+void stats_free(struct review_stats *st)
+{
+    free(st->branches);
+    memset(st, 0, sizeof(*st));
+}
+
+/* Finds or creates the totals for a branch */
+struct branch_stats *stats_branch(struct review_stats *st, const char *name)
+{
+    for (int b = 0; b < st->nbranches; b++)
+    {
+        if (strcmp(st->branches[b].name, name) == 0)
+            return &st->branches[b];
+    }
+
+    if (st->nbranches == st->branch_cap)
+    {
+        int cap = st->branch_cap ? st->branch_cap * 2 : 8;
+        struct branch_stats *tmp = realloc(st->branches, sizeof(*tmp) * cap);
+        if (!tmp)
+            return NULL;
+        st->branches = tmp;
+        st->branch_cap = cap;
+    }
+
+    struct branch_stats *bs = &st->branches[st->nbranches++];
+    memset(bs, 0, sizeof(*bs));
+    strncpy(bs->name, name, sizeof(bs->name) - 1);
+    return bs;
+}
+
+void stats_add(struct review_stats *st, const struct csv_record *rec)
+{
+    int rating = record_rating(rec);
+    struct branch_stats *bs = stats_branch(st, rec->field[COL_BRANCH]);
+
+    st->total++;
+    if (bs)
+    {
+        bs->reviews++;
+        bs->rating_sum += rating;
+        if (rating >= 1 && rating <= 5)
+            bs->by_rating[rating - 1]++;
+    }
+}
+
+/* Adds the totals of other into st */
+void stats_merge(struct review_stats *st, const struct review_stats *other)
+{
+    st->total += other->total;
+    for (int b = 0; b < other->nbranches; b++)
+    {
+        const struct branch_stats *from = &other->branches[b];
+        struct branch_stats *bs = stats_branch(st, from->name);
+        if (!bs)
+            continue;
+        bs->reviews += from->reviews;
+        bs->rating_sum += from->rating_sum;
+        for (int r = 0; r < 5; r++)
+            bs->by_rating[r] += from->by_rating[r];
+    }
+}
+
+/* Zone blocks first..last of one file, counted by a pool task */
+struct stats_task
+{
+    int fd;
+    struct zone_map *zm;
+    int first, last;
+    const struct review_filter *filter;
+    struct review_stats st;
+    int ok;
+};
+
+static void stats_task_run(void *arg)
+{
+    struct stats_task *t = arg;
+    struct csv_reader rd;
+    struct csv_record rec;
+
+    if (!reader_open(&rd, t->fd, t->zm->blocks[t->first].start))
+        return;
+    rd.want = filter_columns(t->filter);
+    for (int b = t->first; b <= t->last; b++)
+    {
+        if (!zone_block_may_match(t->zm, b, t->filter))
+            continue;
+        if (reader_offset(&rd) != t->zm->blocks[b].start)
+            reader_seek(&rd, t->zm->blocks[b].start);
+        while (reader_offset(&rd) < t->zm->blocks[b].end && reader_next(&rd, &rec, 1))
+        {
+            if (filter_match(t->filter, &rec))
+                stats_add(&t->st, &rec);
+        }
+    }
+    reader_close(&rd);
+    t->ok = 1;
+}
+
+/* Counts the reviews of the data in parallel, one task per run of zone blocks. Returns 0 (and counts
+ * nothing) when a file has no zone map yet, since records can only be split at known offsets */
+int stats_parallel(const char *filename, const struct review_filter *filter, struct review_stats *st)
+{
+    struct shard_manifest m;
+    char paths[MAX_SHARDS][PATH_LEN];
+    char side[PATH_LEN + 16];
+    struct zone_map zm[MAX_SHARDS];
+    int fd[MAX_SHARDS];
+    int npaths = 0;
+    int ntasks = 0;
+    int ok = 1;
+
+    // The shards stay put until every one of them is open
+    int hold = shards_hold(filename, 0);
+    if (manifest_load(filename, &m))
+    {
+        for (int s = 0; s < m.nshards; s++)
+        {
+            if (!filter->branch || strcmp(filter->branch, m.branch[s]) == 0)
+                shard_path(filename, m.file[s], paths[npaths++], PATH_LEN);
+        }
+    }
+    else
+    {
+        snprintf(paths[npaths++], PATH_LEN, "%s", filename);
+    }
+
+    for (int p = 0; p < npaths; p++)
+    {
+        zonemap_path(paths[p], side, sizeof(side));
+        if (access(side, F_OK) != 0)
+        {
+            shards_release(hold);
+            return 0;
+        }
+    }
+
+    // Appended rows are indexed first, so every record lies inside a block. A file swapped in
+    // between indexing and opening fails the check; the caller then falls back to a plain scan
+    for (int p = 0; p < npaths; p++)
+    {
+        fd[p] = -1;
+        if (ok && (!zonemap_sync(paths[p], &zm[p], 0) || (fd[p] = open(paths[p], O_RDONLY)) < 0 ||
+                   !zonemap_covers(&zm[p], fd[p])))
+            ok = 0;
+        else if (ok)
+            ntasks += zm[p].nblocks;
+        else
+            memset(&zm[p], 0, sizeof(zm[p]));
+    }
+    shards_release(hold);
+
+    // A few tasks per thread so a slow one can be balanced by stealing
+    int per_task = 1;
+    int want = pool_size() * 4;
+    if (ntasks > want)
+        per_task = (ntasks + want - 1) / want;
+
+    struct stats_task *tasks = ok ? calloc(ntasks, sizeof(struct stats_task)) : NULL;
+    struct task_group group = {0};
+    int n = 0;
+
+    if (tasks)
+    {
+        for (int p = 0; p < npaths; p++)
+        {
+            for (int b = 0; b < zm[p].nblocks; b += per_task)
+            {
+                struct stats_task *t = &tasks[n++];
+                t->fd = fd[p];
+                t->zm = &zm[p];
+                t->first = b;
+                t->last = b + per_task - 1 < zm[p].nblocks ? b + per_task - 1 : zm[p].nblocks - 1;
+                t->filter = filter;
+                pool_submit(&group, stats_task_run, t);
+            }
+        }
+        enum prof_phase prev = prof_enter(PHASE_PARSE);
+        pool_wait(&group);
+        prof_enter(prev);
+
+        // Merged in task order, so the result doesn't depend on which thread ran what
+        for (int i = 0; i < n; i++)
+        {
+            if (!tasks[i].ok)
+                ok = 0;
+            stats_merge(st, &tasks[i].st);
+            stats_free(&tasks[i].st);
+        }
+        free(tasks);
+    }
+    else
+    {
+        ok = 0;
+    }
+
+    for (int p = 0; p < npaths; p++)
+    {
+        if (fd[p] >= 0)
+            close(fd[p]);
+        zonemap_free(&zm[p]);
+    }
+    if (!ok)
+        stats_free(st);
+    return ok;
+}
+
+/* Prints the per-branch totals */
+void stats_print(const struct review_stats *st)
+{
+    printf("\n%-30s %10s %8s %8s %8s %8s %8s %8s\n", "Branch", "Reviews", "Average", "1*", "2*", "3*", "4*", "5*");
+    for (int b = 0; b < st->nbranches; b++)
+    {
+        const struct branch_stats *bs = &st->branches[b];
+        printf("%-30s %10lld %8.2f", bs->name, bs->reviews,
+               bs->reviews ? (double)bs->rating_sum / bs->reviews : 0.0);
+        for (int r = 0; r < 5; r++)
+            printf(" %8lld", bs->by_rating[r]);
+        printf("\n");
+    }
+    printf("%-30s %10lld\n\n", "Total", st->total);
+}
+
+//***************************** Top Reviews *****************************
+
+/* The K reviews kept for one group, as a heap whose root is the first one to drop out */
+struct top_group
+{
+    char key[100];
+    int n;
+    struct top_entry *heap;
+};
+
+struct top_query
+{
+    int k;
+    int worst; // keep the lowest ratings instead of the highest
+    int by;    // column the groups are formed by, or -1 for a single group
+    int ngroups;
+    int group_cap;
+    struct top_group *groups;
+};
+
+/* Non-zero when review a is listed before review b: better (or worse) rating first, then lower ID */
+static int top_ranks_before(const struct top_query *q, int a_rating, int a_id, int b_rating, int b_id)
+{
+    if (a_rating != b_rating)
+        return q->worst ? a_rating < b_rating : a_rating > b_rating;
+    return a_id < b_id;
+}
+
+/* Restores the heap below slot i: every parent ranks after its children */
+static void top_sift_down(const struct top_query *q, struct top_entry *heap, int n, int i)
+{
+    while (1)
+    {
+        int last = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
+
+        if (l < n && top_ranks_before(q, heap[last].rating, heap[last].id, heap[l].rating, heap[l].id))
+            last = l;
+        if (r < n && top_ranks_before(q, heap[last].rating, heap[last].id, heap[r].rating, heap[r].id))
+            last = r;
+        if (last == i)
+            return;
+
+        struct top_entry tmp = heap[i];
+        heap[i] = heap[last];
+        heap[last] = tmp;
+        i = last;
+    }
+}
+
+static void top_sift_up(const struct top_query *q, struct top_entry *heap, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!top_ranks_before(q, heap[parent].rating, heap[parent].id, heap[i].rating, heap[i].id))
+            return;
+
+        struct top_entry tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+static struct top_group *top_group(struct top_query *q, const char *key)
+{
+    for (int g = 0; g < q->ngroups; g++)
+    {
+        if (strcmp(q->groups[g].key, key) == 0)
+            return &q->groups[g];
+    }
+
+    if (q->ngroups == q->group_cap)
+    {
+        int cap = q->group_cap ? q->group_cap * 2 : 8;
+        struct top_group *tmp = realloc(q->groups, sizeof(*tmp) * cap);
+        if (!tmp)
+            return NULL;
+        q->groups = tmp;
+        q->group_cap = cap;
+    }
+
+    struct top_group *g = &q->groups[q->ngroups];
+    memset(g, 0, sizeof(*g));
+    g->heap = calloc(q->k, sizeof(struct top_entry));
+    if (!g->heap)
+        return NULL;
+    snprintf(g->key, sizeof(g->key), "%s", key);
+    q->ngroups++;
+    return g;
+}
+
+/* Offers one review to its group. text resolves a text reference when the review is kept */
+static int top_offer(struct top_query *q, const struct csv_record *rec, struct text_store *text)
+{
+    struct top_group *g = top_group(q, q->by >= 0 ? rec->field[q->by] : "");
+    int rating = record_rating(rec);
+    int id = record_id(rec);
+    struct csv_record full;
+
+    if (!g)
+        return 0;
+    PROF_COUNT(comparisons, 1);
+    if (g->n == q->k && !top_ranks_before(q, rating, id, g->heap[0].rating, g->heap[0].id))
+        return 1;
+
+    // Only kept reviews have their text decompressed
+    full = *rec;
+    if (is_text_ref(rec->field[COL_TEXT]))
+    {
+        const char *t = text_store_get(text, rec->field[COL_TEXT], &full.field_len[COL_TEXT]);
+        if (t)
+            full.field[COL_TEXT] = (char *)t;
+    }
+
+    if (g->n < q->k)
+    {
+        if (!top_store(&g->heap[g->n], &full, rating, id))
+            return 0;
+        top_sift_up(q, g->heap, g->n++);
+        return 1;
+    }
+    if (!top_store(&g->heap[0], &full, rating, id))
+        return 0;
+    top_sift_down(q, g->heap, g->n, 0);
+    return 1;
+}
+
+static void top_free(struct top_query *q)
+{
+    for (int g = 0; g < q->ngroups; g++)
+    {
+        for (int i = 0; i < q->k; i++)
+            free(q->groups[g].heap[i].buf);
+        free(q->groups[g].heap);
+    }
+    free(q->groups);
+    q->groups = NULL;
+    q->ngroups = q->group_cap = 0;
+}
+
+static int top_group_cmp(const void *a, const void *b)
+{
+    return strcmp(((const struct top_group *)a)->key, ((const struct top_group *)b)->key);
+}
+
+/* Prints the k best (or worst) reviews of every group in one pass over the data. by is a column or -1 */
+int view_top(const char *filename, const struct review_filter *filter, int k, int worst, int by)
+{
+    struct top_query q = {k, worst, by, 0, 0, NULL};
+    struct review_filter f = *filter;
+    struct review_scan sc;
+    const struct csv_record *rec;
+    int ok = 1;
+
+    if (f.columns && by >= 0)
+        f.columns |= 1u << by; // groups are formed from this column
+    if (!scan_open(&sc, filename, &f))
+        return 0;
+
+    sc.skip_text = 1; // resolved only for reviews that make it into a heap
+    while (ok && (rec = scan_next(&sc)) != NULL)
+        ok = top_offer(&q, rec, &sc.ts[sc.last]);
+    scan_close(&sc);
+    if (!ok)
+        printf("Out of memory, the list is incomplete.\n");
+
+    qsort(q.groups, q.ngroups, sizeof(struct top_group), top_group_cmp);
+    for (int g = 0; g < q.ngroups; g++)
+    {
+        struct top_group *grp = &q.groups[g];
+
+        // Popping the heap leaves its entries in the order they are listed
+        for (int n = grp->n; n > 1; n--)
+        {
+            struct top_entry tmp = grp->heap[0];
+            grp->heap[0] = grp->heap[n - 1];
+            grp->heap[n - 1] = tmp;
+            top_sift_down(&q, grp->heap, n - 1, 0);
+        }
+
+        if (by >= 0)
+            printf("\n%s %d: %s\n", worst ? "Bottom" : "Top", k, grp->key);
+        rows = 0;
+        for (int i = 0; i < grp->n; i++)
+        {
+            table_put(rows++, &grp->heap[i].rec);
+            if (rows == MAX_ROWS)
+                flush_table();
+        }
+        flush_table();
+    }
+
+    top_free(&q);
+    return 1;
+}
+
+void rng_seed(unsigned long long seed);
+unsigned long long rng_next(void);
+
+static int sample_id_cmp(const void *a, const void *b)
+{
+    int x = ((const struct top_entry *)a)->id;
+    int y = ((const struct top_entry *)b)->id;
+    return (x > y) - (x < y);
+}
+
+/* Prints n reviews picked uniformly at random in one pass (reservoir sampling), in ID order */
+int view_sample(const char *filename, const struct review_filter *filter, int n, unsigned long long seed)
+{
+    struct top_entry *kept = calloc(n, sizeof(struct top_entry));
+    struct review_scan sc;
+    const struct csv_record *rec;
+    long long seen = 0;
+    int nkept = 0;
+    int ok = 1;
+
+    if (!kept)
+        return 0;
+    if (!scan_open(&sc, filename, filter))
+    {
+        free(kept);
+        return 0;
+    }
+
+    rng_seed(seed);
+    sc.skip_text = 1;
+    while (ok && (rec = scan_next(&sc)) != NULL)
+    {
+        // The i-th review replaces a random kept one with probability n / i
+        long long slot = seen < n ? seen : (long long)(rng_next() % (unsigned long long)(seen + 1));
+        seen++;
+        if (slot >= n)
+            continue;
+
+        struct csv_record full = *rec;
+        if (is_text_ref(rec->field[COL_TEXT]))
+        {
+            const char *t = text_store_get(&sc.ts[sc.last], rec->field[COL_TEXT], &full.field_len[COL_TEXT]);
+            if (t)
+                full.field[COL_TEXT] = (char *)t;
+        }
+        ok = top_store(&kept[slot], &full, record_rating(rec), record_id(rec));
+        if (slot == nkept)
+            nkept++;
+    }
+    scan_close(&sc);
+    if (!ok)
+        printf("Out of memory, the sample is incomplete.\n");
+
+    qsort(kept, nkept, sizeof(struct top_entry), sample_id_cmp);
+    rows = 0;
+    for (int i = 0; i < nkept; i++)
+    {
+        table_put(rows++, &kept[i].rec);
+        if (rows == MAX_ROWS)
+            flush_table();
+    }
+    flush_table();
+    fprintf(stderr, "Sampled %d of %lld reviews (seed %llu).\n", nkept, seen, seed);
+
+    for (int i = 0; i < n; i++)
+        free(kept[i].buf);
+    free(kept);
+    return 1;
+}
+
+//***************************** Trends *****************************
+
+/* Review counts and rating sums per branch and month of one data file, cached in a sidecar */
+struct trend_grid
+{
+    struct file_mark mark; // Extent and fingerprint of the file that was counted
+    int nbranch;
+    char branch[TREND_MAX_BRANCHES][50];
+    long long count[TREND_MAX_BRANCHES][12];
+    long long sum[TREND_MAX_BRANCHES][12];
+};
+
+/* Prefix sums over the months: month range a..b of branch r is prefix[r][b + 1] - prefix[r][a] */
+struct trend_prefix
+{
+    int nbranch;
+    char branch[TREND_MAX_BRANCHES][50];
+    long long count[TREND_MAX_BRANCHES][13];
+    long long sum[TREND_MAX_BRANCHES][13];
+};
+
+struct trend_header
+{
+    char magic[8];
+    int nbranch;
+    struct file_mark mark;
+};
+
+static void trends_path(const char *path, char *out, size_t size)
+{
+    snprintf(out, size, "%.*s.trends", PATH_LEN - 1, path);
+}
+
+/* Row of a branch in a table of up to TREND_MAX_BRANCHES names, added when new. Branches past
+ * the limit share one row named "(other branches)", so none is counted under another's name */
+static int branch_row(char branch[][50], int *nbranch, const char *name)
+{
+    static const char other[] = "(other branches)";
+    int b = 0;
+
+    while (b < *nbranch && strcmp(branch[b], name) != 0)
+        b++;
+    if (b < *nbranch)
+        return b;
+    if (*nbranch >= TREND_MAX_BRANCHES - 1 || strcmp(name, other) == 0)
+    {
+        // the table is full (or a merged table brings its own row of other branches)
+        for (b = 0; b < *nbranch && strcmp(branch[b], other) != 0; b++)
+            ;
+        name = other;
+    }
+    if (b == *nbranch)
+        snprintf(branch[(*nbranch)++], 50, "%s", name);
+    return b;
+}
+
+static int trends_load(const char *path, struct trend_grid *g)
+{
+    struct trend_header h;
+    char side[PATH_LEN + 16];
+    int ok = 0;
+
+    trends_path(path, side, sizeof(side));
+    FILE *fp = fopen(side, "rb");
+    if (!fp)
+        return 0;
+
+    if (fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.magic, TREND_MAGIC, 8) == 0 &&
+        h.nbranch >= 0 && h.nbranch <= TREND_MAX_BRANCHES)
+    {
+        g->nbranch = h.nbranch;
+        g->mark = h.mark;
+        ok = fread(g->branch, sizeof(g->branch[0]), h.nbranch, fp) == (size_t)h.nbranch &&
+             fread(g->count, sizeof(g->count[0]), h.nbranch, fp) == (size_t)h.nbranch &&
+             fread(g->sum, sizeof(g->sum[0]), h.nbranch, fp) == (size_t)h.nbranch;
+    }
+    fclose(fp);
+    return ok;
+}
+
+/* Writes the sidecar through a temporary file */
+static int trends_save(const char *path, const struct trend_grid *g)
+{
+    struct trend_header h;
+    char side[PATH_LEN + 16];
+    char tmp[PATH_LEN + 48];
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TREND_MAGIC, 8);
+    h.nbranch = g->nbranch;
+    h.mark = g->mark;
+
+    trends_path(path, side, sizeof(side));
+    temp_path(side, tmp, sizeof(tmp));
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+        return 0;
+
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+             fwrite(g->branch, sizeof(g->branch[0]), g->nbranch, fp) == (size_t)g->nbranch &&
+             fwrite(g->count, sizeof(g->count[0]), g->nbranch, fp) == (size_t)g->nbranch &&
+             fwrite(g->sum, sizeof(g->sum[0]), g->nbranch, fp) == (size_t)g->nbranch;
+    if (fclose(fp) != 0 || !ok)
+    {
+        remove(tmp);
+        return 0;
+    }
+    return rename(tmp, side) == 0;
+}
+
+/* Brings the grid of path up to date in one streaming pass: appended records extend the cached
+ * grid, anything else rebuilds it. Returns 0 if the data file can't be read */
+int trends_sync(const char *path, struct trend_grid *g)
+{
+    struct stat st;
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long from = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    memset(g, 0, sizeof(*g));
+    if (trends_load(path, g) && mark_is_prefix(&g->mark, fd, &st))
+    {
+        if (st.st_size == g->mark.offset)
+        {
+            close(fd);
+            return 1; // already current
+        }
+        from = g->mark.offset;
+    }
+    else
+    {
+        memset(g, 0, sizeof(*g));
+    }
+
+    if (!reader_open(&rd, fd, from))
+    {
+        close(fd);
+        return 0;
+    }
+    rd.want = 1u << COL_RATING | 1u << COL_MONTH | 1u << COL_BRANCH; // Rating, Review_Month and Branch
+    if (from == 0)
+        reader_skip_header(&rd);
+    reader_read_ahead(&rd);
+
+    while (reader_next(&rd, &rec, 1))
+    {
+        int m = month_lookup(rec.field[COL_MONTH], rec.field_len[COL_MONTH]);
+        if (m < 0)
+            continue;
+        int b = branch_row(g->branch, &g->nbranch, rec.field[COL_BRANCH]);
+        g->count[b][m]++;
+        g->sum[b][m] += record_rating(&rec);
+    }
+
+    mark_file(&g->mark, fd, &st, reader_offset(&rd));
+    reader_close(&rd);
+    close(fd);
+
+    trends_save(path, g); // a read-only directory just means no cache
+    return 1;
+}
+
+/* Builds the prefix sums over every data file (all shards when the data is sharded) */
+int trends_build(const char *filename, struct trend_prefix *tp)
+{
+    char paths[MAX_SHARDS][PATH_LEN];
+    int hold = shards_hold(filename, 0); // every shard is read as of the same moment
+    int npaths = data_files(filename, paths);
+    struct trend_grid *g = malloc(sizeof(*g));
+
+    memset(tp, 0, sizeof(*tp));
+    if (!g || npaths == 0)
+    {
+        shards_release(hold);
+        free(g);
+        return 0;
+    }
+
+    for (int p = 0; p < npaths; p++)
+    {
+        if (!trends_sync(paths[p], g))
+        {
+            shards_release(hold);
+            free(g);
+            return 0;
+        }
+        for (int b = 0; b < g->nbranch; b++)
+        {
+            int r = branch_row(tp->branch, &tp->nbranch, g->branch[b]);
+            // Per-month totals first; turned into prefix sums below
+            for (int m = 0; m < 12; m++)
+            {
+                tp->count[r][m + 1] += g->count[b][m];
+                tp->sum[r][m + 1] += g->sum[b][m];
+            }
+        }
+    }
+    shards_release(hold);
+    free(g);
+
+    for (int r = 0; r < tp->nbranch; r++)
+    {
+        for (int m = 1; m <= 12; m++)
+        {
+            tp->count[r][m] += tp->count[r][m - 1];
+            tp->sum[r][m] += tp->sum[r][m - 1];
+        }
+    }
+    return 1;
+}
+
+/* Count and rating sum of branch row r over months first..last (0 = January). A range
+ * like November..February wraps around the year. Both are O(1) */
+void trends_range(const struct trend_prefix *tp, int r, int first, int last, long long *count, long long *sum)
+{
+    if (first <= last)
+    {
+        *count = tp->count[r][last + 1] - tp->count[r][first];
+        *sum = tp->sum[r][last + 1] - tp->sum[r][first];
+    }
+    else
+    {
+        *count = tp->count[r][12] - tp->count[r][first] + tp->count[r][last + 1];
+        *sum = tp->sum[r][12] - tp->sum[r][first] + tp->sum[r][last + 1];
+    }
+}
+
+/* Prints one row of monthly averages, as numbers or as a sparkline (1 to 5 stars) */
+static void trends_print_row(const struct trend_prefix *tp, int r, const char *name, int chart)
+{
+    static const char *bars[8] = {"\u2581", "\u2582", "\u2583", "\u2584", "\u2585", "\u2586", "\u2587", "\u2588"};
+    long long count, sum;
+
+    printf("%-24s", name);
+    for (int m = 0; m < 12; m++)
+    {
+        long long c = 0, s = 0;
+        if (r >= 0)
+            trends_range(tp, r, m, m, &c, &s);
+        else
+        {
+            for (int b = 0; b < tp->nbranch; b++)
+            {
+                trends_range(tp, b, m, m, &count, &sum);
+                c += count;
+                s += sum;
+            }
+        }
+
+        if (chart)
+        {
+            int level = (int)(((double)s / c - 1.0) * 7.0 / 4.0 + 0.5);
+            printf("%s", !c ? " " : bars[level < 0 ? 0 : level > 7 ? 7 : level]);
+        }
+        else if (c)
+            printf(" %5.2f", (double)s / c);
+        else
+            printf(" %5s", "-");
+    }
+    printf("\n");
+}
+
+//***************************** Near Duplicates *****************************
+
+/* Reviews whose text sets of word shingles are similar are found through MinHash signatures:
+ * two signatures agree in a position with probability equal to the Jaccard similarity.
+ * Locality-sensitive hashing buckets the signatures band by band, so only reviews that share
+ * a bucket are ever compared and the work grows linearly with the data. */
+struct dup_batch
+{
+    const struct dedupe *d;
+    int count;
+    char *text;     // texts of the batch, NUL-separated; freed once hashed
+    size_t len, cap;
+    uint32_t *sigs; // MINHASH_SIZE values per review
+};
+
+struct dedupe
+{
+    uint64_t mul[MINHASH_SIZE]; // hash i of a shingle x is (mul[i] * x + add[i]) >> 32
+    uint64_t add[MINHASH_SIZE];
+    int n;
+    int *ids;
+    unsigned char *branch;      // index into names
+    int nnames;
+    char names[MAX_SHARDS][50];
+    struct dup_batch **batches; // review i is entry i % DEDUPE_BATCH of batch i / DEDUPE_BATCH
+    int nbatches, batch_cap;
+};
+
+static const uint32_t *dup_sig(const struct dedupe *d, int i)
+{
+    return d->batches[i / DEDUPE_BATCH]->sigs + (size_t)(i % DEDUPE_BATCH) * MINHASH_SIZE;
+}
+
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* Signature of a text: the minimum of each hash over its SHINGLE_WORDS-word shingles.
+ * Words are compared case-insensitively with punctuation dropped */
+static void minhash_text(const struct dedupe *d, const char *text, uint32_t *sig)
+{
+    uint64_t words[SHINGLE_WORDS] = {0};
+    int nwords = 0;
+    const unsigned char *p = (const unsigned char *)text;
+
+    for (int i = 0; i < MINHASH_SIZE; i++)
+        sig[i] = UINT32_MAX;
+
+    while (1)
+    {
+        // Next word, hashed with FNV-1a
+        while (*p && !(isalnum(*p) || *p >= 0x80))
+            p++;
+        if (!*p)
+            break;
+        uint64_t h = 14695981039346656037ULL;
+        while (*p && (isalnum(*p) || *p >= 0x80))
+        {
+            h = (h ^ (unsigned char)tolower(*p)) * 1099511628211ULL;
+            p++;
+        }
+
+        memmove(words, words + 1, sizeof(words) - sizeof(words[0]));
+        words[SHINGLE_WORDS - 1] = h;
+        if (++nwords < SHINGLE_WORDS)
+            continue;
+
+        uint64_t shingle = 0;
+        for (int w = 0; w < SHINGLE_WORDS; w++)
+            shingle = mix64(shingle ^ words[w]);
+        for (int i = 0; i < MINHASH_SIZE; i++)
+        {
+            uint32_t v = (uint32_t)((d->mul[i] * shingle + d->add[i]) >> 32);
+            if (v < sig[i])
+                sig[i] = v;
+        }
+    }
+
+    // Texts shorter than one shingle count as a single shingle of their words
+    if (nwords > 0 && nwords < SHINGLE_WORDS)
+    {
+        uint64_t shingle = 0;
+        for (int w = SHINGLE_WORDS - nwords; w < SHINGLE_WORDS; w++)
+            shingle = mix64(shingle ^ words[w]);
+        for (int i = 0; i < MINHASH_SIZE; i++)
+            sig[i] = (uint32_t)((d->mul[i] * shingle + d->add[i]) >> 32);
+    }
+}
+
+/* 1 when a text has a word, so it has at least one shingle. Texts without one would all get
+ * the same empty signature and look like perfect duplicates of each other */
+static int has_shingle(const char *text)
+{
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+    {
+        if (isalnum(*p) || *p >= 0x80)
+            return 1;
+    }
+    return 0;
+}
+
+static void dup_batch_run(void *arg)
+{
+    struct dup_batch *b = arg;
+    const char *text = b->text;
+
+    for (int i = 0; i < b->count; i++)
+    {
+        minhash_text(b->d, text, b->sigs + (size_t)i * MINHASH_SIZE);
+        text += strlen(text) + 1;
+    }
+    free(b->text);
+    b->text = NULL;
+}
+
+/* Share of equal signature positions, an estimate of the Jaccard similarity */
+static double dup_similarity(const struct dedupe *d, int a, int b)
+{
+    const uint32_t *x = dup_sig(d, a);
+    const uint32_t *y = dup_sig(d, b);
+    int same = 0;
+
+    for (int i = 0; i < MINHASH_SIZE; i++)
+        same += x[i] == y[i];
+    return (double)same / MINHASH_SIZE;
+}
+
+static int uf_find(int *parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/* Reviews of one LSH band: sorted by bucket, then matched within their bucket */
+struct lsh_entry
+{
+    uint64_t key;
+    int review;
+};
+
+struct lsh_band
+{
+    const struct dedupe *d;
+    int band;
+    double threshold;
+    int *pairs; // matched (earlier, later) pairs
+    int npairs;
+    int failed; // out of memory: the band's pairs are missing
+};
+
+static int lsh_entry_cmp(const void *a, const void *b)
+{
+    const struct lsh_entry *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return (x->review > y->review) - (x->review < y->review);
+}
+
+static void lsh_band_run(void *arg)
+{
+    struct lsh_band *lb = arg;
+    const struct dedupe *d = lb->d;
+    const int rows_per_band = MINHASH_SIZE / LSH_BANDS;
+    struct lsh_entry *e = malloc(sizeof(*e) * (d->n ? d->n : 1));
+    int *joined = malloc(sizeof(int) * (d->n ? d->n : 1)); // union-find over the bucket being matched
+
+    lb->pairs = malloc(sizeof(int) * 2 * (d->n ? d->n : 1));
+    if (!e || !joined || !lb->pairs)
+    {
+        lb->failed = 1;
+        free(e);
+        free(joined);
+        return;
+    }
+
+    for (int i = 0; i < d->n; i++)
+    {
+        const uint32_t *sig = dup_sig(d, i) + lb->band * rows_per_band;
+        uint64_t key = (uint64_t)lb->band;
+        for (int r = 0; r < rows_per_band; r++)
+            key = mix64(key ^ sig[r]);
+        e[i].key = key;
+        e[i].review = i;
+    }
+    qsort(e, d->n, sizeof(*e), lsh_entry_cmp);
+
+    for (int i = 0; i < d->n;)
+    {
+        int j = i + 1;
+        while (j < d->n && e[j].key == e[i].key)
+            j++;
+
+        // Every pair of the bucket is compared unless earlier matches already joined it: the
+        // clusters need one pair per joined review, so a bucket adds fewer pairs than reviews
+        for (int k = i; k < j; k++)
+            joined[k] = k;
+        for (int b = i + 1; b < j; b++)
+        {
+            for (int a = i; a < b; a++)
+            {
+                int x = uf_find(joined, a), y = uf_find(joined, b);
+                if (x == y || dup_similarity(d, e[a].review, e[b].review) < lb->threshold)
+                    continue;
+                joined[y] = x;
+                lb->pairs[2 * lb->npairs] = e[a].review;
+                lb->pairs[2 * lb->npairs + 1] = e[b].review;
+                lb->npairs++;
+            }
+        }
+        i = j;
+    }
+    free(joined);
+    free(e);
+}
+
+static void dedupe_free(struct dedupe *d)
+{
+    for (int b = 0; b < d->nbatches; b++)
+    {
+        free(d->batches[b]->text);
+        free(d->batches[b]->sigs);
+        free(d->batches[b]);
+    }
+    free(d->batches);
+    free(d->ids);
+    free(d->branch);
+}
+
+/* Adds one review to the batch being filled, handing full batches to the pool. Reviews with no
+ * words in their text are left out */
+static int dedupe_add(struct dedupe *d, struct task_group *group, const struct csv_record *rec)
+{
+    if (!has_shingle(rec->field[COL_TEXT]))
+        return 1;
+    if (d->n % DEDUPE_BATCH == 0)
+    {
+        if (d->nbatches > 0)
+            pool_submit(group, dup_batch_run, d->batches[d->nbatches - 1]);
+
+        // Bounded read-ahead: wait for the workers when too many batches are queued
+        if (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 2 * pool_size())
+            pool_wait(group);
+
+        if (d->nbatches == d->batch_cap)
+        {
+            int cap = d->batch_cap ? d->batch_cap * 2 : 16;
+            struct dup_batch **tmp = realloc(d->batches, sizeof(*tmp) * cap);
+            int *ids = realloc(d->ids, sizeof(int) * cap * DEDUPE_BATCH);
+            unsigned char *branch = realloc(d->branch, cap * DEDUPE_BATCH);
+            if (tmp)
+                d->batches = tmp;
+            if (ids)
+                d->ids = ids;
+            if (branch)
+                d->branch = branch;
+            if (!tmp || !ids || !branch)
+                return 0;
+            d->batch_cap = cap;
+        }
+        struct dup_batch *b = calloc(1, sizeof(*b));
+        if (!b || !(b->sigs = malloc(sizeof(uint32_t) * MINHASH_SIZE * DEDUPE_BATCH)))
+        {
+            free(b);
+            return 0;
+        }
+        b->d = d;
+        d->batches[d->nbatches++] = b;
+    }
+
+    struct dup_batch *b = d->batches[d->nbatches - 1];
+    if (!grow_buffer((void **)&b->text, &b->cap, b->len + rec->field_len[COL_TEXT] + 1))
+        return 0;
+    memcpy(b->text + b->len, rec->field[COL_TEXT], rec->field_len[COL_TEXT] + 1);
+    b->len += rec->field_len[COL_TEXT] + 1;
+    b->count++;
+
+    int name = 0;
+    while (name < d->nnames && strcmp(d->names[name], rec->field[COL_BRANCH]) != 0)
+        name++;
+    if (name == d->nnames)
+    {
+        if (d->nnames < MAX_SHARDS - 1)
+            snprintf(d->names[d->nnames++], sizeof(d->names[0]), "%s", rec->field[COL_BRANCH]);
+        else
+        {
+            // Branches past the limit share the last slot, shown under a name of its own
+            name = MAX_SHARDS - 1;
+            if (d->nnames < MAX_SHARDS)
+                snprintf(d->names[d->nnames++], sizeof(d->names[0]), "%s", "(other branches)");
+        }
+    }
+    d->ids[d->n] = record_id(rec);
+    d->branch[d->n] = (unsigned char)name;
+    d->n++;
+    return 1;
+}
+
+static int cluster_cmp(const void *a, const void *b)
+{
+    const int *x = a, *y = b;
+    if (x[0] != y[0])
+        return (x[0] > y[0]) - (x[0] < y[0]);
+    return (x[1] > y[1]) - (x[1] < y[1]);
+}
+
+/* Prints clusters of reviews whose estimated Jaccard similarity reaches threshold. Reviews of
+ * branches past the first MAX_SHARDS - 1 are listed under "(other branches)". Returns 1,
+ * 0 when the data can't be opened or -1 when memory ran out */
+int find_duplicates(const char *filename, const struct review_filter *filter, double threshold)
+{
+    struct dedupe *d = calloc(1, sizeof(*d));
+    struct task_group group = {0};
+    struct review_filter f = *filter;
+    struct review_scan sc;
+    const struct csv_record *rec;
+    int ok = 1;
+
+    if (!d)
+    {
+        printf("Out of memory.\n");
+        return -1;
+    }
+    f.columns = 1u << COL_ID | 1u << COL_TEXT | 1u << COL_BRANCH; // Review_ID, Review_Text and Branch
+    if (!scan_open(&sc, filename, &f))
+    {
+        free(d);
+        return 0;
+    }
+
+    // The same hash functions on every run, so results are repeatable
+    rng_seed(0x5eed);
+    for (int i = 0; i < MINHASH_SIZE; i++)
+    {
+        d->mul[i] = rng_next() | 1;
+        d->add[i] = rng_next();
+    }
+
+    enum prof_phase prev = prof_enter(PHASE_PARSE);
+    while (ok && (rec = scan_next(&sc)) != NULL)
+        ok = dedupe_add(d, &group, rec);
+    scan_close(&sc);
+    if (d->nbatches > 0)
+        pool_submit(&group, dup_batch_run, d->batches[d->nbatches - 1]);
+    pool_wait(&group);
+    prof_enter(prev);
+    if (!ok)
+    {
+        printf("Out of memory after %d reviews.\n", d->n);
+        dedupe_free(d);
+        free(d);
+        return -1;
+    }
+
+    // Every band is bucketed by its own task
+    struct lsh_band bands[LSH_BANDS];
+    for (int b = 0; b < LSH_BANDS; b++)
+    {
+        bands[b] = (struct lsh_band){d, b, threshold, NULL, 0, 0};
+        pool_submit(&group, lsh_band_run, &bands[b]);
+    }
+    prev = prof_enter(PHASE_SORT);
+    pool_wait(&group);
+    prof_enter(prev);
+
+    int *parent = malloc(sizeof(int) * (d->n ? d->n : 1));
+    int *members = malloc(sizeof(int) * 2 * (d->n ? d->n : 1));
+    if (!parent || !members)
+        ok = 0;
+    for (int b = 0; b < LSH_BANDS; b++)
+    {
+        if (bands[b].failed)
+            ok = 0; // a missing band would silently drop its clusters
+    }
+    for (int i = 0; ok && i < d->n; i++)
+        parent[i] = i;
+    for (int b = 0; b < LSH_BANDS; b++)
+    {
+        for (int p = 0; ok && p < bands[b].npairs; p++)
+        {
+            int x = uf_find(parent, bands[b].pairs[2 * p]);
+            int y = uf_find(parent, bands[b].pairs[2 * p + 1]);
+            if (x != y)
+                parent[x > y ? x : y] = x < y ? x : y; // the earliest review represents its cluster
+        }
+        free(bands[b].pairs);
+    }
+
+    // (cluster, review) pairs sorted so each cluster's reviews are adjacent and in scan order
+    int nmembers = 0;
+    for (int i = 0; ok && i < d->n; i++)
+    {
+        members[2 * nmembers] = uf_find(parent, i);
+        members[2 * nmembers + 1] = i;
+        nmembers++;
+    }
+    if (ok)
+        qsort(members, nmembers, sizeof(int) * 2, cluster_cmp);
+
+    int clusters = 0, clustered = 0;
+    for (int i = 0; ok && i < nmembers;)
+    {
+        int j = i;
+        while (j < nmembers && members[2 * j] == members[2 * i])
+            j++;
+        if (j - i > 1)
+        {
+            int first = members[2 * i + 1];
+            clusters++;
+            clustered += j - i;
+            printf("Cluster %d: %d reviews\n", clusters, j - i);
+            for (int k = i; k < j; k++)
+            {
+                int r = members[2 * k + 1];
+                printf("  %-10d %-28s %.2f\n", d->ids[r], d->names[d->branch[r]], dup_similarity(d, first, r));
+            }
+        }
+        i = j;
+    }
+    if (ok)
+        printf("%d cluster(s) with %d of %d reviews at estimated similarity >= %.2f.\n", clusters, clustered, d->n, threshold);
+    else
+        printf("Out of memory.\n");
+
+    free(parent);
+    free(members);
+    dedupe_free(d);
+    free(d);
+    return ok ? 1 : -1;
+}
+
+//***************************** Terms *****************************
+
+/* Which words and two-word phrases stand out in the reviews of each branch and rating bucket.
+ * The scan hands batches of texts to pool tasks; every pool thread counts into its own hash
+ * table and the tables are merged once the last batch is done. The lift of a term in a group
+ * is its share of the group's words divided by its share of the words of every review read */
+enum rating_bucket
+{
+    BUCKET_LOW,  // 1 and 2 stars
+    BUCKET_MID,  // 3 stars
+    BUCKET_HIGH, // 4 and 5 stars
+    BUCKETS
+};
+
+static const char *bucket_names[BUCKETS] = {"1-2", "3", "4-5"};
+
+/* Counts are kept per group: branch, bucket and n (0 for words, 1 for phrases) */
+#define TERM_GROUP(branch, bucket, n) (((branch) * BUCKETS + (bucket)) * 2 + (n))
+#define TERM_GROUPS TERM_GROUP(MAX_SHARDS, 0, 0)
+#define TERM_BREAK 1 // term_fold[] value of punctuation that also ends a phrase
+
+struct term_entry
+{
+    uint64_t hash;   // of the term text
+    uint32_t text;   // offset of the text in the table's arena
+    uint16_t len;
+    uint16_t group;
+    long long count; // 0 marks a free slot
+};
+
+struct term_table
+{
+    struct term_entry *slots;
+    size_t cap, used; // cap is a power of two, kept at least twice used
+    char *arena;      // term texts, one copy per (term, group)
+    size_t arena_len, arena_cap;
+    long long words[TERM_GROUPS]; // words or phrases counted per group
+    int ok;
+};
+
+/* Word bytes folded to lower case; 0 separates words and TERM_BREAK ends a phrase as well.
+ * Bytes of non-ASCII characters are word bytes, so accented words stay whole */
+static unsigned char term_fold[256];
+
+static void term_fold_init(void)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80)
+            term_fold[c] = (unsigned char)c;
+        else if (c >= 'A' && c <= 'Z')
+            term_fold[c] = (unsigned char)(c - 'A' + 'a');
+        else
+            term_fold[c] = c && strchr(".!?,;:()", c) ? TERM_BREAK : 0;
+    }
+}
+
+/* Bytes of the General Punctuation character (U+2000..U+206F: dashes, quotes, ellipsis) at p, or 0 */
+static int utf8_punct(const unsigned char *p)
+{
+    return p[0] == 0xE2 && (p[1] == 0x80 || p[1] == 0x81) && p[2] >= 0x80 && p[2] <= 0xBF ? 3 : 0;
+}
+
+static void term_table_free(struct term_table *tt)
+{
+    free(tt->slots);
+    free(tt->arena);
+    memset(tt, 0, sizeof(*tt));
+}
+
+static uint64_t term_slot(uint64_t hash, int group)
+{
+    return mix64(hash + (uint64_t)group * 0x9e3779b97f4a7c15ULL);
+}
+
+static int term_grow(struct term_table *tt)
+{
+    size_t cap = tt->cap ? tt->cap * 2 : 1 << 14;
+    struct term_entry *slots = calloc(cap, sizeof(*slots));
+
+    if (!slots)
+        return 0;
+    for (size_t i = 0; i < tt->cap; i++)
+    {
+        const struct term_entry *e = &tt->slots[i];
+        if (!e->count)
+            continue;
+        size_t j = term_slot(e->hash, e->group) & (cap - 1);
+        while (slots[j].count)
+            j = (j + 1) & (cap - 1);
+        slots[j] = *e;
+    }
+    free(tt->slots);
+    tt->slots = slots;
+    tt->cap = cap;
+    return 1;
+}
+
+/* Adds count to the term in group. Returns 0 when out of memory */
+static int term_add(struct term_table *tt, uint64_t hash, const char *text, size_t len, int group, long long count)
+{
+    if (tt->used * 2 >= tt->cap && !term_grow(tt))
+        return 0;
+
+    size_t mask = tt->cap - 1;
+    for (size_t i = term_slot(hash, group) & mask;; i = (i + 1) & mask)
+    {
+        struct term_entry *e = &tt->slots[i];
+        if (e->count && e->hash == hash && e->group == group && e->len == len &&
+            memcmp(tt->arena + e->text, text, len) == 0)
+        {
+            e->count += count;
+            return 1;
+        }
+        if (e->count)
+            continue;
+
+        if (tt->arena_len + len > tt->arena_cap)
+        {
+            size_t cap = tt->arena_cap ? tt->arena_cap * 2 : 1 << 16;
+            char *arena = cap <= UINT32_MAX ? realloc(tt->arena, cap) : NULL;
+            if (!arena)
+                return 0;
+            tt->arena = arena;
+            tt->arena_cap = cap;
+        }
+        memcpy(tt->arena + tt->arena_len, text, len);
+        e->hash = hash;
+        e->text = (uint32_t)tt->arena_len;
+        e->len = (uint16_t)len;
+        e->group = (uint16_t)group;
+        e->count = count;
+        tt->arena_len += len;
+        tt->used++;
+        return 1;
+    }
+}
+
+/* Counts the words of a text in group and its phrases in group + 1. An apostrophe between
+ * letters belongs to the word (don't, don’t); sentence punctuation ends a phrase */
+static void term_count_text(struct term_table *tt, const char *text, int group)
+{
+    const unsigned char *p = (const unsigned char *)text;
+    char word[TERM_MAX_LEN], prev[TERM_MAX_LEN], phrase[2 * TERM_MAX_LEN + 1];
+    size_t prev_len = 0;
+    uint64_t prev_hash = 0;
+
+    while (*p && tt->ok)
+    {
+        int punct = utf8_punct(p);
+        if (punct || term_fold[*p] <= TERM_BREAK)
+        {
+            if (punct || term_fold[*p] == TERM_BREAK)
+                prev_len = 0;
+            p += punct ? punct : 1;
+            continue;
+        }
+
+        size_t len = 0;
+        uint64_t h = 14695981039346656037ULL;
+        while (*p)
+        {
+            unsigned char c = term_fold[*p];
+            size_t step = 1;
+            if (c <= TERM_BREAK || utf8_punct(p))
+            {
+                step = *p == '\'' ? 1 : (p[0] == 0xE2 && p[1] == 0x80 && p[2] == 0x99) ? 3 : 0;
+                if (!step || term_fold[p[step]] <= TERM_BREAK)
+                    break;
+                c = '\'';
+            }
+            if (len < TERM_MAX_LEN)
+                word[len] = (char)c;
+            len++;
+            h = (h ^ c) * 1099511628211ULL;
+            p += step;
+        }
+        if (len > TERM_MAX_LEN)
+        {
+            prev_len = 0;
+            continue;
+        }
+
+        tt->ok = term_add(tt, h, word, len, group, 1);
+        tt->words[group]++;
+        if (prev_len && tt->ok)
+        {
+            memcpy(phrase, prev, prev_len);
+            phrase[prev_len] = ' ';
+            memcpy(phrase + prev_len + 1, word, len);
+            tt->ok = term_add(tt, mix64(prev_hash ^ mix64(h)), phrase, prev_len + 1 + len, group + 1, 1);
+            tt->words[group + 1]++;
+        }
+        memcpy(prev, word, len);
+        prev_len = len;
+        prev_hash = h;
+    }
+}
+
+/* Texts of up to TERMS_BATCH reviews, counted by one pool task into its thread's table */
+struct term_batch
+{
+    struct term_table *tables; // one per pool thread
+    int count;
+    char *text;                // NUL-separated
+    size_t len, cap;
+    unsigned short group[TERMS_BATCH];
+};
+
+static void term_batch_run(void *arg)
+{
+    struct term_batch *b = arg;
+    struct term_table *tt = &b->tables[pool_self];
+    const char *text = b->text;
+
+    for (int i = 0; i < b->count; i++)
+    {
+        term_count_text(tt, text, b->group[i]);
+        text += strlen(text) + 1;
+    }
+    free(b->text);
+    free(b);
+}
+
+/* One term of a group, ranked for printing */
+struct term_rank
+{
+    const struct term_entry *e;
+    const char *text;
+    double lift;
+    double key; // sort key: lift or count
+};
+
+static int term_rank_cmp(const void *a, const void *b)
+{
+    const struct term_rank *x = a, *y = b;
+
+    if (x->e->group != y->e->group)
+        return x->e->group - y->e->group;
+    if (x->key != y->key)
+        return x->key < y->key ? 1 : -1;
+    if (x->e->count != y->e->count)
+        return x->e->count < y->e->count ? 1 : -1;
+    int n = x->e->len < y->e->len ? x->e->len : y->e->len;
+    int c = memcmp(x->text, y->text, n);
+    return c ? c : x->e->len - y->e->len;
+}
+
+static long long term_lookup(const struct term_table *tt, const struct term_entry *e, const char *text, int group)
+{
+    if (!tt->cap)
+        return 0;
+    size_t mask = tt->cap - 1;
+    for (size_t i = term_slot(e->hash, group) & mask; tt->slots[i].count; i = (i + 1) & mask)
+    {
+        const struct term_entry *s = &tt->slots[i];
+        if (s->hash == e->hash && s->group == group && s->len == e->len && memcmp(tt->arena + s->text, text, s->len) == 0)
+            return s->count;
+    }
+    return 0;
+}
+
+/* Prints the top words and phrases of each branch and rating bucket among the reviews matching
+ * filter, ranked by lift (or by count) among terms seen at least min_count times in the group.
+ * Branches past the first MAX_SHARDS - 1 are reported together as other branches. Returns 1,
+ * 0 when the data can't be opened or -1 when memory ran out */
+int term_report(const char *filename, const struct review_filter *filter, int top, long long min_count, int by_count)
+{
+    struct review_filter f = *filter;
+    struct review_scan sc;
+    const struct csv_record *rec;
+    struct task_group group = {0};
+    char names[MAX_SHARDS][50];
+    long long reviews[TERM_GROUPS] = {0};
+    int nnames = 0, ok = 1;
+    int nthreads = pool_size();
+    struct term_table *tables = calloc(nthreads, sizeof(*tables));
+    struct term_table all = {0};
+    struct term_batch *b = NULL;
+
+    if (!tables)
+    {
+        printf("Out of memory.\n");
+        return -1;
+    }
+    for (int t = 0; t < nthreads; t++)
+        tables[t].ok = 1;
+    term_fold_init();
+
+    f.columns = 1u << COL_RATING | 1u << COL_TEXT | 1u << COL_BRANCH; // Rating, Review_Text and Branch
+    if (!scan_open(&sc, filename, &f))
+    {
+        free(tables);
+        return 0;
+    }
+
+    enum prof_phase prev = prof_enter(PHASE_PARSE);
+    while (ok && (rec = scan_next(&sc)) != NULL)
+    {
+        int rating = record_rating(rec);
+        if (rating < 1 || rating > 5)
+            continue;
+
+        int name = 0;
+        while (name < nnames && strcmp(names[name], rec->field[COL_BRANCH]) != 0)
+            name++;
+        if (name == nnames)
+        {
+            if (nnames < MAX_SHARDS - 1)
+                snprintf(names[nnames++], sizeof(names[0]), "%s", rec->field[COL_BRANCH]);
+            else
+            {
+                // Branches past the limit share the last slot, shown under a name of its own
+                name = MAX_SHARDS - 1;
+                if (nnames < MAX_SHARDS)
+                    snprintf(names[nnames++], sizeof(names[0]), "%s", "(other branches)");
+            }
+        }
+
+        if (!b)
+        {
+            // Bounded read-ahead: wait for the workers when too many batches are queued
+            if (__atomic_load_n(&group.pending, __ATOMIC_ACQUIRE) > 2 * nthreads)
+                pool_wait(&group);
+            b = calloc(1, sizeof(*b));
+            if (!b)
+            {
+                ok = 0;
+                break;
+            }
+            b->tables = tables;
+        }
+
+        size_t len = rec->field_len[COL_TEXT] + 1;
+        if (b->len + len > b->cap && !grow_buffer((void **)&b->text, &b->cap, (b->len + len) * 2))
+        {
+            ok = 0;
+            break;
+        }
+        memcpy(b->text + b->len, rec->field[COL_TEXT], len);
+        b->len += len;
+        b->group[b->count++] = TERM_GROUP(name, rating <= 2 ? BUCKET_LOW : rating == 3 ? BUCKET_MID : BUCKET_HIGH, 0);
+        reviews[b->group[b->count - 1]]++;
+        if (b->count == TERMS_BATCH)
+        {
+            pool_submit(&group, term_batch_run, b);
+            b = NULL;
+        }
+    }
+    scan_close(&sc);
+    if (b && b->count && ok)
+        pool_submit(&group, term_batch_run, b);
+    else if (b)
+    {
+        free(b->text);
+        free(b);
+    }
+    pool_wait(&group);
+
+    // Merge into the first table; the corpus counts of every term go to a table of their own
+    for (int t = 0; t < nthreads; t++)
+        ok = ok && tables[t].ok;
+    for (int t = 1; ok && t < nthreads; t++)
+    {
+        for (size_t i = 0; ok && i < tables[t].cap; i++)
+        {
+            const struct term_entry *e = &tables[t].slots[i];
+            if (e->count)
+                ok = term_add(&tables[0], e->hash, tables[t].arena + e->text, e->len, e->group, e->count);
+        }
+        for (int g = 0; g < TERM_GROUPS; g++)
+            tables[0].words[g] += tables[t].words[g];
+        term_table_free(&tables[t]);
+    }
+    struct term_table *tt = &tables[0];
+    for (size_t i = 0; ok && i < tt->cap; i++)
+    {
+        const struct term_entry *e = &tt->slots[i];
+        if (e->count)
+            ok = term_add(&all, e->hash, tt->arena + e->text, e->len, e->group % 2, e->count);
+    }
+    for (int g = 0; g < TERM_GROUPS; g++)
+        all.words[g % 2] += tt->words[g];
+    prof_enter(PHASE_SORT);
+
+    // Ranked in one sort: by group, then by key
+    size_t nranks = 0;
+    struct term_rank *ranks = ok ? malloc(sizeof(*ranks) * (tt->used ? tt->used : 1)) : NULL;
+    for (size_t i = 0; ranks && i < tt->cap; i++)
+    {
+        const struct term_entry *e = &tt->slots[i];
+        if (e->count < min_count || e->count == 0)
+            continue;
+
+        struct term_rank *r = &ranks[nranks++];
+        const char *text = tt->arena + e->text;
+        double share = (double)e->count / tt->words[e->group];
+        double corpus = (double)term_lookup(&all, e, text, e->group % 2) / all.words[e->group % 2];
+        r->e = e;
+        r->text = text;
+        r->lift = share / corpus;
+        r->key = by_count ? (double)e->count : r->lift;
+    }
+    if (ranks)
+        qsort(ranks, nranks, sizeof(*ranks), term_rank_cmp);
+    prof_enter(PHASE_RENDER);
+
+    for (int n = 0, r = 0; ranks && n < nnames; n++)
+    {
+        for (int k = 0; k < BUCKETS; k++)
+        {
+            int g = TERM_GROUP(n, k, 0);
+            if (!reviews[g])
+                continue;
+            printf("\n%s, rating %s: %lld review(s), %lld word(s)\n", names[n], bucket_names[k], reviews[g],
+                   tt->words[g]);
+            for (int kind = 0; kind < 2; kind++)
+            {
+                while (r < (int)nranks && ranks[r].e->group < g + kind)
+                    r++;
+                printf("  %-32s %10s %8s %7s\n", kind ? "Phrase" : "Word", "Count", "Share", "Lift");
+                int shown = 0;
+                for (; r < (int)nranks && ranks[r].e->group == g + kind; r++)
+                {
+                    if (shown++ >= top)
+                        continue;
+                    int used; // padded by terminal columns, not bytes
+                    width_prefix(ranks[r].text, ranks[r].e->len, 0x7fffffff, &used);
+                    printf("  %.*s%*s %10lld %7.2f%% %7.2f\n", ranks[r].e->len, ranks[r].text, used < 32 ? 32 - used : 0,
+                           "", ranks[r].e->count, 100.0 * ranks[r].e->count / tt->words[g + kind], ranks[r].lift);
+                }
+                if (!shown)
+                    printf("  (none seen %lld times)\n", min_count);
+            }
+        }
+    }
+    if (ranks)
+        printf("\n%lld word(s) and %lld phrase(s) counted; lift compares each group with all reviews read.\n",
+               all.words[0], all.words[1]);
+    else
+        printf("Out of memory.\n");
+    prof_enter(prev);
+
+    int done = ranks ? 1 : -1;
+    free(ranks);
+    term_table_free(&all);
+    term_table_free(&tables[0]);
+    free(tables);
+    return done;
+}
+
+//***************************** Sketches *****************************
+
+/* Fixed-size summaries of Reviewer_Location built in one streaming pass: a HyperLogLog per
+ * branch and month counts distinct locations, and a Count-Min sketch with a short list of
+ * candidates finds the most frequent ones. Both merge cell by cell, so every data file is
+ * summarised on its own (in parallel) and the results are joined afterwards */
+struct heavy_hitter
+{
+    uint64_t hash;
+    uint32_t count; // Count-Min estimate, never below the true count
+    char name[50];
+};
+
+struct sketch
+{
+    struct file_mark mark; // Extent and fingerprint of the file that was summarised
+    int nbranch;
+    char branch[TREND_MAX_BRANCHES][50];
+    uint8_t hll[TREND_MAX_BRANCHES][12][HLL_REGISTERS];
+    uint32_t cm[CM_DEPTH][CM_WIDTH];
+    int nheavy;
+    struct heavy_hitter heavy[HEAVY_TRACKED];
+};
+
+struct sketch_header
+{
+    char magic[8];
+    int nbranch;
+    int nheavy;
+    struct file_mark mark;
+};
+
+static void sketch_path(const char *path, char *out, size_t size)
+{
+    snprintf(out, size, "%.*s.sketch", PATH_LEN - 1, path);
+}
+
+static uint64_t location_hash(const char *s)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 1099511628211ULL;
+    return mix64(h);
+}
+
+/* The top HLL_BITS bits of the hash pick a register, which keeps the longest run of
+ * leading zeros seen in the remaining bits */
+static void hll_add(uint8_t *reg, uint64_t h)
+{
+    int idx = (int)(h >> (64 - HLL_BITS));
+    uint8_t rank = (uint8_t)(__builtin_clzll(h << HLL_BITS | 1ULL << (HLL_BITS - 1)) + 1);
+
+    if (rank > reg[idx])
+        reg[idx] = rank;
+}
+
+static void hll_merge(uint8_t *dst, const uint8_t *src)
+{
+    for (int i = 0; i < HLL_REGISTERS; i++)
+    {
+        if (src[i] > dst[i])
+            dst[i] = src[i];
+    }
+}
+
+/* Estimated number of distinct values added to a set of registers */
+static double hll_estimate(const uint8_t *reg)
+{
+    double m = HLL_REGISTERS, sum = 0.0;
+    int zeros = 0;
+
+    for (int i = 0; i < HLL_REGISTERS; i++)
+    {
+        sum += 1.0 / (double)(1ULL << reg[i]);
+        zeros += reg[i] == 0;
+    }
+    double e = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0)
+        e = m * log(m / zeros); // small counts: linear counting is more accurate
+    return e;
+}
+
+/* Cell of row d for a hash: two halves of one hash give CM_DEPTH independent-enough columns */
+static uint32_t *cm_cell(uint32_t cm[][CM_WIDTH], int d, uint64_t h)
+{
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    return &cm[d][(h1 + (uint32_t)d * h2) & (CM_WIDTH - 1)];
+}
+
+static uint32_t cm_estimate(struct sketch *sk, uint64_t h)
+{
+    uint32_t est = UINT32_MAX;
+
+    for (int d = 0; d < CM_DEPTH; d++)
+    {
+        uint32_t c = *cm_cell(sk->cm, d, h);
+        if (c < est)
+            est = c;
+    }
+    return est;
+}
+
+/* Keeps name among the candidates if its estimate beats the smallest one tracked */
+static void heavy_offer(struct sketch *sk, uint64_t h, const char *name, uint32_t est)
+{
+    int min = 0;
+
+    for (int i = 0; i < sk->nheavy; i++)
+    {
+        if (sk->heavy[i].hash == h && strcmp(sk->heavy[i].name, name) == 0)
+        {
+            sk->heavy[i].count = est;
+            return;
+        }
+        if (sk->heavy[i].count < sk->heavy[min].count)
+            min = i;
+    }
+    if (sk->nheavy < HEAVY_TRACKED)
+        min = sk->nheavy++;
+    else if (est <= sk->heavy[min].count)
+        return;
+
+    sk->heavy[min].hash = h;
+    sk->heavy[min].count = est;
+    snprintf(sk->heavy[min].name, sizeof(sk->heavy[min].name), "%s", name);
+}
+
+static void sketch_add(struct sketch *sk, const char *branch, int month, const char *location)
+{
+    uint64_t h = location_hash(location);
+
+    if (month >= 0)
+        hll_add(sk->hll[branch_row(sk->branch, &sk->nbranch, branch)][month], h);
+    for (int d = 0; d < CM_DEPTH; d++)
+        (*cm_cell(sk->cm, d, h))++;
+    heavy_offer(sk, h, location, cm_estimate(sk, h));
+}
+
+/* Folds src into dst: registers take the maximum, counters add up and the candidates of both
+ * are ranked again against the combined counters */
+void sketch_merge(struct sketch *dst, const struct sketch *src)
+{
+    for (int b = 0; b < src->nbranch; b++)
+    {
+        int r = branch_row(dst->branch, &dst->nbranch, src->branch[b]);
+        for (int m = 0; m < 12; m++)
+            hll_merge(dst->hll[r][m], src->hll[b][m]);
+    }
+    for (int d = 0; d < CM_DEPTH; d++)
+    {
+        for (int i = 0; i < CM_WIDTH; i++)
+            dst->cm[d][i] += src->cm[d][i];
+    }
+    for (int i = 0; i < dst->nheavy; i++)
+        dst->heavy[i].count = cm_estimate(dst, dst->heavy[i].hash);
+    for (int i = 0; i < src->nheavy; i++)
+        heavy_offer(dst, src->heavy[i].hash, src->heavy[i].name, cm_estimate(dst, src->heavy[i].hash));
+}
+
+static int sketch_load(const char *path, struct sketch *sk)
+{
+    struct sketch_header h;
+    char side[PATH_LEN + 16];
+    int ok = 0;
+
+    sketch_path(path, side, sizeof(side));
+    FILE *fp = fopen(side, "rb");
+    if (!fp)
+        return 0;
+
+    if (fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.magic, SKETCH_MAGIC, 8) == 0 &&
+        h.nbranch >= 0 && h.nbranch <= TREND_MAX_BRANCHES && h.nheavy >= 0 && h.nheavy <= HEAVY_TRACKED)
+    {
+        sk->nbranch = h.nbranch;
+        sk->nheavy = h.nheavy;
+        sk->mark = h.mark;
+        ok = fread(sk->branch, sizeof(sk->branch[0]), h.nbranch, fp) == (size_t)h.nbranch &&
+             fread(sk->hll, sizeof(sk->hll[0]), h.nbranch, fp) == (size_t)h.nbranch &&
+             fread(sk->cm, sizeof(sk->cm), 1, fp) == 1 &&
+             fread(sk->heavy, sizeof(sk->heavy[0]), h.nheavy, fp) == (size_t)h.nheavy;
+    }
+    fclose(fp);
+    return ok;
+}
+
+/* Writes the sidecar through a temporary file */
+static int sketch_save(const char *path, const struct sketch *sk)
+{
+    struct sketch_header h;
+    char side[PATH_LEN + 16];
+    char tmp[PATH_LEN + 48];
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SKETCH_MAGIC, 8);
+    h.nbranch = sk->nbranch;
+    h.nheavy = sk->nheavy;
+    h.mark = sk->mark;
+
+    sketch_path(path, side, sizeof(side));
+    temp_path(side, tmp, sizeof(tmp));
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+        return 0;
+
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+             fwrite(sk->branch, sizeof(sk->branch[0]), sk->nbranch, fp) == (size_t)sk->nbranch &&
+             fwrite(sk->hll, sizeof(sk->hll[0]), sk->nbranch, fp) == (size_t)sk->nbranch &&
+             fwrite(sk->cm, sizeof(sk->cm), 1, fp) == 1 &&
+             fwrite(sk->heavy, sizeof(sk->heavy[0]), sk->nheavy, fp) == (size_t)sk->nheavy;
+    if (fclose(fp) != 0 || !ok)
+    {
+        remove(tmp);
+        return 0;
+    }
+    return rename(tmp, side) == 0;
+}
+
+/* Brings the sketch of path up to date in one streaming pass: appended records are added to
+ * the cached sketch, anything else rebuilds it. Returns 0 if the data file can't be read */
+int sketch_sync(const char *path, struct sketch *sk)
+{
+    struct stat st;
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long from = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    memset(sk, 0, sizeof(*sk));
+    if (sketch_load(path, sk) && mark_is_prefix(&sk->mark, fd, &st))
+    {
+        if (st.st_size == sk->mark.offset)
+        {
+            close(fd);
+            return 1; // already current
+        }
+        from = sk->mark.offset;
+    }
+    else
+    {
+        memset(sk, 0, sizeof(*sk));
+    }
+
+    if (!reader_open(&rd, fd, from))
+    {
+        close(fd);
+        return 0;
+    }
+    rd.want = 1u << COL_MONTH | 1u << COL_LOCATION | 1u << COL_BRANCH; // Review_Month, Reviewer_Location and Branch
+    if (from == 0)
+        reader_skip_header(&rd);
+    reader_read_ahead(&rd);
+
+    while (reader_next(&rd, &rec, 1))
+        sketch_add(sk, rec.field[COL_BRANCH], month_lookup(rec.field[COL_MONTH], rec.field_len[COL_MONTH]),
+                   rec.field[COL_LOCATION]);
+
+    mark_file(&sk->mark, fd, &st, reader_offset(&rd));
+    reader_close(&rd);
+    close(fd);
+
+    sketch_save(path, sk); // a read-only directory just means no cache
+    return 1;
+}
+
+struct sketch_task
+{
+    const char *path;
+    struct sketch *sk;
+    int ok;
+};
+
+static void sketch_task_run(void *arg)
+{
+    struct sketch_task *t = arg;
+    t->ok = sketch_sync(t->path, t->sk);
+}
+
+/* Sketch of every data file (all shards when the data is sharded), one pool task per file.
+ * Returns NULL if the data can't be read */
+struct sketch *sketch_build(const char *filename)
+{
+    char paths[MAX_SHARDS][PATH_LEN];
+    struct sketch_task tasks[MAX_SHARDS];
+    struct task_group group = {0};
+    int hold = shards_hold(filename, 0); // every shard is read as of the same moment
+    int npaths = data_files(filename, paths);
+    int ok = npaths > 0;
+
+    for (int p = 0; p < npaths; p++)
+    {
+        tasks[p] = (struct sketch_task){paths[p], malloc(sizeof(struct sketch)), 0};
+        if (tasks[p].sk)
+            pool_submit(&group, sketch_task_run, &tasks[p]);
+    }
+    pool_wait(&group);
+    shards_release(hold);
+
+    for (int p = 0; p < npaths; p++)
+        ok = ok && tasks[p].ok;
+    for (int p = 1; p < npaths; p++)
+    {
+        if (ok)
+            sketch_merge(tasks[0].sk, tasks[p].sk);
+        free(tasks[p].sk);
+    }
+    if (!ok)
+    {
+        if (npaths > 0)
+            free(tasks[0].sk);
+        return NULL;
+    }
+    return tasks[0].sk;
+}
+
+static int heavy_cmp(const void *a, const void *b)
+{
+    const struct heavy_hitter *x = a, *y = b;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+/* Prints the estimated distinct locations of branch row r (-1 for all branches) per month and
+ * over the year */
+static void sketch_print_row(const struct sketch *sk, int r, const char *name)
+{
+    uint8_t year[HLL_REGISTERS] = {0};
+    uint8_t month[HLL_REGISTERS];
+
+    printf("%-24s", name);
+    for (int m = 0; m < 12; m++)
+    {
+        memset(month, 0, sizeof(month));
+        for (int b = 0; b < sk->nbranch; b++)
+        {
+            if (r < 0 || b == r)
+                hll_merge(month, sk->hll[b][m]);
+        }
+        hll_merge(year, month);
+        printf(" %5.0f", hll_estimate(month));
+    }
+    printf(" %6.0f\n", hll_estimate(year));
+}
+
+//***************************** Export *****************************
+
+enum export_format
+{
+    EXPORT_CSV,   // RFC 4180: CRLF line ends, fields quoted only when they hold , " CR or LF
+    EXPORT_TSV,   // one line per row; backslash, tab, CR and LF written as \\ \t \r \n
+    EXPORT_NDJSON // one JSON object per line, keyed by column name
+};
+
+/* Bytes that end a run of plain text in a format. JSON also stops at control characters and
+ * at non-ASCII bytes, whose UTF-8 is checked so the output always parses */
+struct escape_set
+{
+    unsigned char special[4];
+    int json;
+};
+
+static const struct escape_set escape_sets[] = {
+    [EXPORT_CSV] = {{',', '"', '\r', '\n'}, 0},
+    [EXPORT_TSV] = {{'\\', '\t', '\r', '\n'}, 0},
+    [EXPORT_NDJSON] = {{'"', '\\', '"', '"'}, 1},
+};
+
+static inline int escape_needed(const struct escape_set *es, unsigned char ch)
+{
+    return ch == es->special[0] || ch == es->special[1] || ch == es->special[2] || ch == es->special[3] ||
+           (es->json && (ch < 0x20 || ch >= 0x80));
+}
+
+/* Length of the run at the start of s that is copied as it is. Review text is mostly plain,
+ * so 16 bytes are tested per step */
+static size_t plain_run(const struct escape_set *es, const char *s, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i c0 = _mm_set1_epi8((char)es->special[0]);
+    const __m128i c1 = _mm_set1_epi8((char)es->special[1]);
+    const __m128i c2 = _mm_set1_epi8((char)es->special[2]);
+    const __m128i c3 = _mm_set1_epi8((char)es->special[3]);
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    while (i + 16 <= n)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, c0), _mm_cmpeq_epi8(x, c1)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(x, c2), _mm_cmpeq_epi8(x, c3)));
+        int mask = _mm_movemask_epi8(hit);
+        if (es->json) // bytes up to 0x1f equal their minimum with 0x1f; the sign bit marks non-ASCII
+            mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, ctl), x)) | _mm_movemask_epi8(x);
+        if (mask)
+            return i + __builtin_ctz(mask);
+        i += 16;
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t c0 = vdupq_n_u8(es->special[0]);
+    const uint8x16_t c1 = vdupq_n_u8(es->special[1]);
+    const uint8x16_t c2 = vdupq_n_u8(es->special[2]);
+    const uint8x16_t c3 = vdupq_n_u8(es->special[3]);
+    while (i + 16 <= n)
+    {
+        uint8x16_t x = vld1q_u8((const uint8_t *)s + i);
+        uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(x, c0), vceqq_u8(x, c1)), vorrq_u8(vceqq_u8(x, c2), vceqq_u8(x, c3)));
+        if (es->json)
+            hit = vorrq_u8(hit, vorrq_u8(vcleq_u8(x, vdupq_n_u8(0x1f)), vcgeq_u8(x, vdupq_n_u8(0x80))));
+        if (vmaxvq_u8(hit))
+            break; // the loop below finds the byte
+        i += 16;
+    }
+#endif
+    while (i < n && !escape_needed(es, (unsigned char)s[i]))
+        i++;
+    return i;
+}
+
+/* Bytes of the well-formed UTF-8 character at s (no overlong forms, surrogates or values past
+ * U+10FFFF), or 0 when it is malformed */
+static size_t utf8_valid_char(const char *s, size_t n)
+{
+    static const unsigned min_cp[5] = {0, 0, 0x80, 0x800, 0x10000};
+    unsigned cp;
+    size_t len = utf8_decode(s, n, &cp);
+
+    if (len == 1 && (unsigned char)s[0] >= 0x80)
+        return 0;
+    if (cp < min_cp[len] || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+        return 0;
+    return len;
+}
+
+static void json_escape(struct out_buffer *ob, unsigned char ch)
+{
+    static const char hex[] = "0123456789abcdef";
+    char esc[6] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 15]};
+
+    switch (ch)
+    {
+    case '"':
+        out_put(ob, "\\\"", 2);
+        break;
+    case '\\':
+        out_put(ob, "\\\\", 2);
+        break;
+    case '\n':
+        out_put(ob, "\\n", 2);
+        break;
+    case '\r':
+        out_put(ob, "\\r", 2);
+        break;
+    case '\t':
+        out_put(ob, "\\t", 2);
+        break;
+    default:
+        out_put(ob, esc, 6);
+    }
+}
+
+/* Appends one text field in fmt */
+static void export_field(struct out_buffer *ob, enum export_format fmt, const char *s, size_t n)
+{
+    const struct escape_set *es = &escape_sets[fmt];
+    size_t run = plain_run(es, s, n);
+
+    if (fmt == EXPORT_CSV)
+    {
+        const char *quote;
+
+        if (run == n)
+        {
+            out_put(ob, s, n); // most fields need no quotes at all
+            return;
+        }
+        out_putc(ob, '"');
+        while ((quote = memchr(s, '"', n)) != NULL)
+        {
+            size_t upto = quote - s + 1;
+            out_put(ob, s, upto);
+            out_putc(ob, '"');
+            s += upto;
+            n -= upto;
+        }
+        out_put(ob, s, n);
+        out_putc(ob, '"');
+        return;
+    }
+
+    if (fmt == EXPORT_NDJSON)
+        out_putc(ob, '"');
+    while (1)
+    {
+        out_put(ob, s, run);
+        s += run;
+        n -= run;
+        if (n == 0)
+            break;
+
+        unsigned char ch = (unsigned char)*s;
+        size_t used = 1;
+        if (fmt == EXPORT_TSV)
+        {
+            char esc[2] = {'\\', ch == '\t' ? 't' : ch == '\r' ? 'r' : ch == '\n' ? 'n' : '\\'};
+            out_put(ob, esc, 2);
+        }
+        else if (ch < 0x80)
+        {
+            json_escape(ob, ch);
+        }
+        else if ((used = utf8_valid_char(s, n)) > 0)
+        {
+            out_put(ob, s, used);
+        }
+        else
+        {
+            out_put(ob, "\\ufffd", 6); // a malformed byte would make the whole line invalid JSON
+            used = 1;
+        }
+        s += used;
+        n -= used;
+        run = plain_run(es, s, n);
+    }
+    if (fmt == EXPORT_NDJSON)
+        out_putc(ob, '"');
+}
+
+/* 1 when an INT field can be written as a bare JSON number (no sign or leading zeros) */
+static int json_number(const char *s, size_t len)
+{
+    return int_valid(s, len) && s[0] != '+' && !(s[s[0] == '-'] == '0' && len > (size_t)(s[0] == '-') + 1);
+}
+
+#define SCHEMA_NUMERIC_INT 1
+#define SCHEMA_NUMERIC_TEXT 0
+#define SCHEMA_NUMERIC(col, name, key, type, encoding, wrap, width) SCHEMA_NUMERIC_##type,
+static const unsigned char column_numeric[COLS] = {REVIEW_SCHEMA(SCHEMA_NUMERIC)};
+
+/* Appends the projected columns of one review as a row in fmt */
+static void export_row(struct out_buffer *ob, enum export_format fmt, const struct csv_record *rec,
+                       const int *cols, int ncols, char key[][32], const size_t *key_len)
+{
+    for (int i = 0; i < ncols; i++)
+    {
+        int c = cols[i];
+        const char *f = rec->field[c];
+        size_t len = rec->field_len[c];
+
+        if (fmt != EXPORT_NDJSON)
+        {
+            if (i > 0)
+                out_putc(ob, fmt == EXPORT_CSV ? ',' : '\t');
+            export_field(ob, fmt, f, len);
+            continue;
+        }
+        out_putc(ob, i > 0 ? ',' : '{');
+        out_put(ob, key[c], key_len[c]);
+        if (column_numeric[c] && json_number(f, len))
+            out_put(ob, f, len);
+        else
+            export_field(ob, fmt, f, len); // malformed numbers stay visible as strings
+    }
+    if (fmt == EXPORT_NDJSON)
+        out_putc(ob, '}');
+    if (fmt == EXPORT_CSV)
+        out_put(ob, "\r\n", 2);
+    else
+        out_putc(ob, '\n');
+}
+
+static int export_flush(int fd, struct out_buffer *ob)
+{
+    enum prof_phase prev = prof_enter(PHASE_WRITE);
+    int ok = !ob->failed && write_all(fd, ob->data, ob->len);
+    PROF_COUNT(bytes_written, ob->len);
+    prof_enter(prev);
+    ob->len = 0;
+    return ok;
+}
+
+/* Streams the reviews matching filter to fd as they are parsed; only one output buffer is
+ * held in memory. filter->columns picks the columns written. Returns the rows written or -1,
+ * and the bytes written in *bytes when it is not NULL */
+long long export_reviews(int fd, const char *filename, const struct review_filter *filter, enum export_format fmt,
+                         long long *bytes)
+{
+    struct review_scan sc;
+    struct out_buffer ob = {0};
+    const struct csv_record *rec;
+    char key[COLS][32];
+    size_t key_len[COLS];
+    int cols[COLS], ncols = 0;
+    long long rows = 0, written = 0;
+    int ok = 1;
+
+    for (int c = 0; c < COLS; c++)
+    {
+        if (!filter->columns || filter->columns & 1u << c)
+            cols[ncols++] = c;
+        key_len[c] = snprintf(key[c], sizeof(key[c]), "\"%s\":", column_names[c]);
+    }
+
+    if (!scan_open(&sc, filename, filter))
+        return -1;
+    sc.skip_text = filter->columns && !(filter->columns & 1u << COL_TEXT); // nothing to decompress
+
+    if (fmt != EXPORT_NDJSON)
+    {
+        for (int i = 0; i < ncols; i++)
+        {
+            if (i > 0)
+                out_putc(&ob, fmt == EXPORT_CSV ? ',' : '\t');
+            out_put(&ob, column_names[cols[i]], strlen(column_names[cols[i]]));
+        }
+        out_put(&ob, fmt == EXPORT_CSV ? "\r\n" : "\n", fmt == EXPORT_CSV ? 2 : 1);
+    }
+
+    while (ok && (rec = scan_next(&sc)) != NULL)
+    {
+        export_row(&ob, fmt, rec, cols, ncols, key, key_len);
+        rows++;
+        if (ob.len >= EXPORT_FLUSH)
+        {
+            written += ob.len;
+            ok = export_flush(fd, &ob);
+        }
+    }
+    scan_close(&sc);
+
+    written += ob.len;
+    ok = ok && export_flush(fd, &ob);
+    out_free(&ob);
+    if (bytes)
+        *bytes = written;
+    return ok ? rows : -1;
+}
+
+//***************************** Lint *****************************
+
+/* The rules the interactive prompts enforce, checked on every row of the data files */
+enum lint_rule
+{
+    LINT_FIELDS,    // six fields
+    LINT_ID,        // Review_ID is a positive integer
+    LINT_ORDER,     // Review_IDs rise through each file
+    LINT_DUPLICATE, // no Review_ID is used twice
+    LINT_RATING,    // 1 to 5
+    LINT_MONTH,     // one of the month names inputMonth() accepts
+    LINT_LOCATION,  // no digits
+    LINT_BRANCH,    // no digits
+    LINT_QUOTE,     // quoted fields are closed
+    LINT_RULES
+};
+
+static const char *lint_rule_names[LINT_RULES] = {"fields", "id",       "order",  "duplicate", "rating",
+                                                  "month",  "location", "branch", "quote"};
+
+struct lint_error
+{
+    int file;
+    long long offset; // Byte offset of the row
+    long long row;    // Data row of the file, from 1
+    char message[112];
+};
+
+/* Review_ID of one row, kept for the ordering and uniqueness checks; 0 when it is not valid */
+struct lint_id
+{
+    long long offset;
+    int id;
+};
+
+/* Rows starting inside bytes start..end-1 of one file, checked by a pool task */
+struct lint_task
+{
+    int fd;
+    int file;
+    long long start, end;
+    long long size;    // File size when lint began; later appends are not checked
+    int quotes_odd;    // The range holds an odd number of '"'
+    int in_quotes;     // start lies inside a quoted field
+    struct lint_id *ids;
+    size_t rows, ids_cap;
+    struct lint_error *errors; // The first max_errors found, in file order
+    int nerrors, max_errors;
+    long long counts[LINT_RULES];
+    int ok;
+};
+
+/* Counts an error and keeps it while fewer than max_errors are kept */
+static void lint_report(struct lint_task *t, enum lint_rule rule, long long offset, long long row, const char *fmt, ...)
+{
+    va_list ap;
+
+    t->counts[rule]++;
+    if (t->nerrors >= t->max_errors)
+        return;
+
+    struct lint_error *e = &t->errors[t->nerrors++];
+    e->file = t->file;
+    e->offset = offset;
+    e->row = row;
+    va_start(ap, fmt);
+    vsnprintf(e->message, sizeof(e->message), fmt, ap);
+    va_end(ap);
+}
+
+/* Number of '"' bytes in s; the record splitter only needs its parity */
+static size_t count_quotes(const char *s, size_t n)
+{
+    size_t i = 0, count = 0;
+
+#if defined(__SSE2__)
+    const __m128i q = _mm_set1_epi8('"');
+    for (; i + 16 <= n; i += 16)
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)), q)));
+#elif defined(__aarch64__)
+    const uint8x16_t q = vdupq_n_u8('"');
+    for (; i + 16 <= n; i += 16)
+        count += vaddvq_u8(vandq_u8(vceqq_u8(vld1q_u8((const uint8_t *)s + i), q), vdupq_n_u8(1)));
+#endif
+    for (; i < n; i++)
+        count += s[i] == '"';
+    return count;
+}
+
+static int has_digit(const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if ((unsigned char)(s[i] - '0') < 10)
+            return 1;
+    }
+    return 0;
+}
+
+/* First pass: the quote parity of the range, so every task can tell where records start */
+static void lint_count_run(void *arg)
+{
+    struct lint_task *t = arg;
+    char *buf = malloc(READ_CHUNK);
+    size_t quotes = 0;
+
+    for (long long at = t->start; buf && at < t->end;)
+    {
+        size_t want = t->end - at < READ_CHUNK ? (size_t)(t->end - at) : READ_CHUNK;
+        ssize_t n = pread(t->fd, buf, want, at);
+        if (n <= 0)
+            break;
+        quotes += count_quotes(buf, n);
+        at += n;
+        t->ok = at == t->end;
+    }
+    t->quotes_odd = quotes & 1;
+    free(buf);
+}
+
+/* Offset of the first record starting at or after at. Records begin after a newline that is
+ * outside quotes, the same rule find_record_end() splits by */
+static long long lint_record_start(int fd, long long at, long long size, int in_quotes)
+{
+    char buf[65536];
+    long long pos = at - 1; // the byte before at tells whether a record starts right at it
+
+    if (at == 0)
+        return 0;
+    while (pos < size)
+    {
+        size_t want = size - pos < (long long)sizeof(buf) ? (size_t)(size - pos) : sizeof(buf);
+        ssize_t n = pread(fd, buf, want, pos);
+        if (n <= 0)
+            break;
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (buf[i] == '"' && pos + i >= at)
+                in_quotes = !in_quotes;
+            else if (buf[i] == '\n' && !in_quotes)
+                return pos + i + 1;
+        }
+        pos += n;
+    }
+    return size;
+}
 
-    if (choice == 2)
+/* Checks one row against every rule that needs no other row */
+static void lint_row(struct lint_task *t, const struct csv_record *rec, long long row)
+{
+    const char *f;
+    size_t len;
+
+    if (rec->nfields != COLS)
+        lint_report(t, LINT_FIELDS, rec->offset, row, "has %d fields, expected %d", rec->nfields, COLS);
+
+    f = rec->field[COL_RATING];
+    len = rec->field_len[COL_RATING];
+    if (!int_valid(f, len) || parse_int(f, len) < 1 || parse_int(f, len) > 5)
+        lint_report(t, LINT_RATING, rec->offset, row, "Rating '%.32s' is not 1 to 5", f);
+
+    f = rec->field[COL_MONTH];
+    len = rec->field_len[COL_MONTH];
+    if (month_lookup(f, len) < 0)
+        lint_report(t, LINT_MONTH, rec->offset, row, "Review_Month '%.32s' is not a month name", f);
+
+    if (has_digit(rec->field[COL_LOCATION], rec->field_len[COL_LOCATION]))
+        lint_report(t, LINT_LOCATION, rec->offset, row, "Reviewer_Location '%.32s' contains digits",
+                    rec->field[COL_LOCATION]);
+    if (has_digit(rec->field[COL_BRANCH], rec->field_len[COL_BRANCH]))
+        lint_report(t, LINT_BRANCH, rec->offset, row, "Branch '%.32s' contains digits", rec->field[COL_BRANCH]);
+}
+
+/* Second pass: parses the records that start inside the range. Rows are numbered from 1
+ * within the task until lint_data() knows how many rows came before it */
+static void lint_check_run(void *arg)
+{
+    struct lint_task *t = arg;
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long from = lint_record_start(t->fd, t->start, t->size, t->in_quotes);
+
+    t->ok = 0;
+    if (from >= t->end || !reader_open(&rd, t->fd, from))
     {
-        sort_by_rating_desc();
+        t->ok = from >= t->end;
+        return;
     }
-    else if (choice == 3)
+    rd.limit = t->size;
+    rd.want = ALL_COLUMNS & ~(1u << COL_TEXT); // the text has no rules
+    if (from == 0)
+        reader_skip_header(&rd);
+
+    while (reader_next(&rd, &rec, 1) && rec.offset < t->end)
     {
-        sort_by_branch();
-    }
+        if (t->rows == t->ids_cap)
+        {
+            size_t cap = t->ids_cap ? t->ids_cap * 2 : 4096;
+            struct lint_id *tmp = realloc(t->ids, cap * sizeof(*tmp));
+            if (!tmp)
+            {
+                reader_close(&rd);
+                return;
+            }
+            t->ids = tmp;
+            t->ids_cap = cap;
+        }
 
-    return 1;
+        long long row = ++t->rows;
+        const char *id = rec.field[COL_ID];
+        size_t id_len = rec.field_len[COL_ID];
+        int valid = int_valid(id, id_len) && parse_int(id, id_len) > 0;
+
+        t->ids[row - 1].offset = rec.offset;
+        t->ids[row - 1].id = valid ? parse_int(id, id_len) : 0;
+        if (!valid)
+            lint_report(t, LINT_ID, rec.offset, row, "Review_ID '%.32s' is not a positive integer", id);
+        lint_row(t, &rec, row);
+    }
+    reader_close(&rd);
+    t->ok = 1;
 }
 
-// Function to check that only the names of the 12 months are entered by the user
-void inputMonth(char *result, int maxLen)
+static int lint_error_order(const void *a, const void *b)
 {
-    const char *months[] = {
-        "January", "February", "March", "April",
-        "May", "June", "July", "August",
-        "September", "October", "November", "December"};
+    const struct lint_error *x = a, *y = b;
 
-    char input[50];
-    int valid;
+    if (x->file != y->file)
+        return x->file - y->file;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
 
-    while (1)
+/* Checks every row of the data files in parallel: each file is cut into ranges, a first pass
+ * finds the quote parity of each so records can be split exactly, a second parses and checks
+ * them. Review_ID order and uniqueness are then checked in file order with a bitmap. Prints
+ * the first max_errors errors by row and byte offset and a summary. Returns the number of
+ * errors, or -1 when the data can't be read */
+long long lint_data(const char *filename, int max_errors)
+{
+    char paths[MAX_SHARDS][PATH_LEN];
+    int fd[MAX_SHARDS], split[MAX_SHARDS], open_quote[MAX_SHARDS];
+    long long size[MAX_SHARDS], bytes = 0;
+    int ntasks = 0, ok = 1;
+    double start = now_seconds();
+
+    // The shards stay put until every one of them is open
+    int hold = shards_hold(filename, 0);
+    int npaths = data_files(filename, paths);
+    if (npaths == 0)
+        errno = ENOENT;
+    for (int p = 0; p < npaths; p++)
     {
-        printf("Enter the month you have visited (e.g. April): ");
+        struct stat st;
+        fd[p] = open(paths[p], O_RDONLY);
+        size[p] = fd[p] >= 0 && fstat(fd[p], &st) == 0 ? (long long)st.st_size : -1;
+        ok = ok && size[p] >= 0;
+    }
+    shards_release(hold);
 
-        if (!fgets(input, sizeof(input), stdin))
-            continue;
+    // A few ranges per thread so a slow one can be balanced by stealing
+    int want = pool_size() * 4;
+    for (int p = 0; ok && p < npaths; p++)
+    {
+        long long n = size[p] / LINT_MIN_SPLIT + 1;
+        split[p] = n < want ? (int)n : want;
+        ntasks += split[p];
+        bytes += size[p];
+    }
 
-        // delete newline
-        input[strcspn(input, "\n")] = '\0';
+    // Every task keeps its first max_errors errors, and so does the order check after them:
+    // together they hold the first max_errors of the whole data
+    struct lint_task *tasks = ok && npaths > 0 ? calloc(ntasks, sizeof(*tasks)) : NULL;
+    struct lint_error *errors = tasks ? malloc(sizeof(*errors) * ((size_t)max_errors * (ntasks + 1) + 1)) : NULL;
+    struct task_group group = {0};
+    int n = 0;
+
+    ok = ok && errors;
+
+    for (int p = 0; errors && p < npaths; p++)
+    {
+        for (int i = 0; i < split[p]; i++)
+        {
+            struct lint_task *t = &tasks[n++];
+            t->fd = fd[p];
+            t->file = p;
+            t->size = size[p];
+            t->start = size[p] * i / split[p];
+            t->end = size[p] * (i + 1) / split[p];
+            t->max_errors = max_errors;
+            t->errors = errors + (size_t)max_errors * (n - 1);
+            t->ok = t->start == t->end;
+            pool_submit(&group, lint_count_run, t);
+        }
+    }
+    enum prof_phase prev = prof_enter(PHASE_READ);
+    pool_wait(&group);
+
+    // A range starts inside quotes when the ranges before it in its file hold an odd number
+    for (int i = 0; i < n; i++)
+    {
+        struct lint_task *t = &tasks[i];
+        if (i == 0 || t->file != tasks[i - 1].file)
+            open_quote[t->file] = 0;
+        t->in_quotes = open_quote[t->file];
+        open_quote[t->file] ^= t->quotes_odd;
+        ok = ok && t->ok;
+        pool_submit(&group, lint_check_run, t);
+    }
+    prof_enter(PHASE_PARSE);
+    pool_wait(&group);
+    prof_enter(prev);
+
+    // Order and uniqueness, walking the rows in file order. The bitmap grows to the largest
+    // Review_ID seen: 2^31 IDs fit in 256 MiB, a dataset of them in far less
+    struct lint_task order = {.errors = errors ? errors + (size_t)max_errors * ntasks : NULL, .max_errors = max_errors};
+    uint64_t *seen = NULL;
+    size_t seen_words = 0;
+    long long rows = 0, total = 0;
+    int prev_id = 0;
+
+    for (int i = 0; i < n && ok; i++)
+    {
+        struct lint_task *t = &tasks[i];
+        if (i == 0 || t->file != tasks[i - 1].file)
+        {
+            rows = 0;
+            prev_id = 0;
+        }
+        order.file = t->file;
+        ok = t->ok;
 
-        valid = 0;
-        for (int i = 0; i < 12; i++)
+        for (size_t r = 0; r < t->rows && ok; r++)
         {
-            if (strcmp(input, months[i]) == 0)
+            const struct lint_id *e = &t->ids[r];
+            long long row = rows + (long long)r + 1;
+            size_t word = (size_t)e->id >> 6;
+            uint64_t bit = 1ull << (e->id & 63);
+
+            if (e->id == 0)
+                continue;
+            if (word >= seen_words)
             {
-                valid = 1;
-                break;
+                size_t grow = word + 1 > seen_words * 2 ? word + 1 : seen_words * 2;
+                uint64_t *tmp = realloc(seen, grow * sizeof(*seen));
+                if (!tmp)
+                {
+                    ok = 0;
+                    break;
+                }
+                memset(tmp + seen_words, 0, (grow - seen_words) * sizeof(*seen));
+                seen = tmp;
+                seen_words = grow;
             }
+
+            if (seen[word] & bit)
+                lint_report(&order, LINT_DUPLICATE, e->offset, row, "Review_ID %d is used more than once", e->id);
+            else if (e->id <= prev_id)
+                lint_report(&order, LINT_ORDER, e->offset, row, "Review_ID %d does not follow %d", e->id, prev_id);
+            seen[word] |= bit;
+            prev_id = e->id;
         }
 
-        if (valid)
+        // Task errors were numbered within the task
+        for (int k = 0; k < t->nerrors; k++)
+            t->errors[k].row += rows;
+        rows += t->rows;
+        total += t->rows;
+
+        // An odd quote count leaves the last record of the file open until its end
+        int last = i + 1 == n || tasks[i + 1].file != t->file;
+        if (last && open_quote[t->file] && rows > 0)
         {
-            strncpy(result, input, maxLen - 1);
-            result[maxLen - 1] = '\0';
-            return;
+            const struct lint_task *with = t;
+            while (with->rows == 0 && with > tasks && with[-1].file == t->file)
+                with--;
+            if (with->rows > 0)
+                lint_report(&order, LINT_QUOTE, with->ids[with->rows - 1].offset, rows,
+                            "a quoted field is never closed");
         }
+    }
+    free(seen);
 
-        printf("Invalid month. Please enter a valid month name.\n");
+    long long found = 0;
+    int kept = 0;
+    for (int i = 0; ok && i <= n; i++)
+    {
+        struct lint_task *t = i < n ? &tasks[i] : &order;
+        for (int r = 0; r < LINT_RULES; r++)
+            order.counts[r] += i < n ? t->counts[r] : 0;
+        memmove(errors + kept, t->errors, sizeof(*errors) * t->nerrors);
+        kept += t->nerrors;
+    }
+    if (ok)
+    {
+        qsort(errors, kept, sizeof(*errors), lint_error_order);
+        for (int e = 0; e < kept && e < max_errors; e++)
+            printf("%s: row %lld (byte %lld): %s\n", paths[errors[e].file], errors[e].row, errors[e].offset,
+                   errors[e].message);
+        for (int r = 0; r < LINT_RULES; r++)
+            found += order.counts[r];
+        if (found > max_errors)
+            printf("... %lld more error(s) not shown\n", found - max_errors);
+
+        double seconds = now_seconds() - start;
+        printf("Checked %lld row(s) in %d file(s), %.1f MB in %.2f s (%.0f MB/s): %lld error(s)", total, npaths,
+               bytes / 1e6, seconds, seconds > 0 ? bytes / 1e6 / seconds : 0.0, found);
+        for (int r = 0, first = 1; r < LINT_RULES; r++)
+        {
+            if (order.counts[r])
+            {
+                printf("%s%lld %s", first ? " (" : ", ", order.counts[r], lint_rule_names[r]);
+                first = 0;
+            }
+        }
+        printf(found ? ").\n" : ".\n");
     }
+
+    for (int i = 0; i < n; i++)
+        free(tasks[i].ids);
+    free(tasks);
+    free(errors);
+    for (int p = 0; p < npaths; p++)
+    {
+        if (fd[p] >= 0)
+            close(fd[p]);
+    }
+    return ok ? found : -1;
 }
 
-//***************************** Add Data *****************************
+//***************************** Watch Mode *****************************
+
+/* Maps a Review_ID to the byte offset of its record */
+struct id_entry
+{
+    int id;
+    long long offset;
+};
+
+/* Everything watch mode remembers between file events */
+struct watch_state
+{
+    const char *filename;
+    int follow;                 // Print new rows like tail -f
+    long long offset;           // End of the last complete record parsed
+    struct file_mark mark;      // Identity and fingerprint of what was parsed
+
+    struct review_stats stats;  // Per-branch aggregates
+
+    struct id_entry *ids;       // Ordered by file position
+    long long nids;
+    long long id_cap;
+    int max_id;
+    int ids_sorted;             // IDs were appended in ascending order
+    int reloaded;               // Last update had to re-parse from the start
+};
+
+static void watch_reset(struct watch_state *ws)
+{
+    ws->offset = 0;
+    stats_reset(&ws->stats);
+    ws->nids = 0;
+    ws->max_id = 0;
+    ws->ids_sorted = 1;
+}
 
-/*Writes one text field into the CSV. It puts the text in quotes. It doubles any " inside the text. */
-void write_csv_field(FILE *dl, char text[])
+/* Adds one record to the aggregates and the ID index */
+static void watch_add(struct watch_state *ws, const struct csv_record *rec)
 {
-    int i = 0;
-    fprintf(dl, "\""); /* CSV escaping: always wrap fields in quotes */
+    int id = record_id(rec);
 
-    while (text[i] != '\0')
+    stats_add(&ws->stats, rec);
+
+    if (ws->nids == ws->id_cap)
     {
-        if (text[i] == '"')
-            fprintf(dl, "\""); /* escape quotes inside the field by doubling them */
+        long long cap = ws->id_cap ? ws->id_cap * 2 : 1024;
+        struct id_entry *tmp = realloc(ws->ids, sizeof(*tmp) * cap);
+        if (!tmp)
+            return;
+        ws->ids = tmp;
+        ws->id_cap = cap;
+    }
+    if (id <= ws->max_id)
+        ws->ids_sorted = 0;
+    else
+        ws->max_id = id;
+    ws->ids[ws->nids].id = id;
+    ws->ids[ws->nids].offset = rec->offset;
+    ws->nids++;
+}
 
-        fprintf(dl, "%c", text[i]); /* write the current character */
-        i++;
+/* Looks up the byte offset of a Review_ID (-1 when unknown) */
+long long watch_find_id(const struct watch_state *ws, int id)
+{
+    if (ws->ids_sorted)
+    {
+        long long lo = 0, hi = ws->nids - 1;
+        while (lo <= hi)
+        {
+            long long mid = lo + (hi - lo) / 2;
+            if (ws->ids[mid].id == id)
+                return ws->ids[mid].offset;
+            if (ws->ids[mid].id < id)
+                lo = mid + 1;
+            else
+                hi = mid - 1;
+        }
+        return -1;
     }
 
-    fprintf(dl, "\""); /* closing quote for the field */
+    for (long long i = 0; i < ws->nids; i++)
+    {
+        if (ws->ids[i].id == id)
+            return ws->ids[i].offset;
+    }
+    return -1;
 }
 
-/*Checks if the file exists. It tries to open the file in read mode. It returns 1 if it works, otherwise 0.*/
-int file_exists(const char *filename)
+/* Parses everything after the remembered offset. Returns the number of new records or -1 on error */
+long long watch_update(struct watch_state *ws)
 {
-    FILE *dl = fopen(filename, "r"); /* opening in read mode is a simple existence/access check */
-    if (dl == NULL)
+    struct stat st;
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long added = 0;
+    int fd = open(ws->filename, O_RDONLY);
+
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // Nothing new since the last pass
+    if (ws->offset > 0 && st.st_size == ws->offset && mark_is_prefix(&ws->mark, fd, &st))
+    {
+        close(fd);
         return 0;
+    }
 
-    fclose(dl);
-    return 1;
-}
+    int full = ws->offset == 0 || !mark_is_prefix(&ws->mark, fd, &st);
+    ws->reloaded = full && ws->offset > 0;
+    if (full)
+    {
+        if (ws->reloaded)
+            printf("\n[watch] %s was rewritten, reloading.\n", ws->filename);
+        watch_reset(ws);
+    }
 
-/*Finds the next Review_ID. It reads the CSV line by line. It returns the biggest ID + 1.*/
-int get_next_id(const char *filename)
-{
-    FILE *dl = fopen(filename, "r");
-    char line[2000];
-    int id;
-    int last_id = 0;
+    if (!reader_open(&rd, fd, ws->offset))
+    {
+        close(fd);
+        return -1;
+    }
+    if (full)
+        reader_skip_header(&rd);
 
-    if (dl == NULL)
-        return 1; /* file doesn't exist yet -> first ID should be 1 */
+    // A last row without a line break may still be half-written: it is left for a later pass,
+    // so the offset stays at the end of the last complete record
+    while (reader_next(&rd, &rec, 0))
+    {
+        watch_add(ws, &rec);
+        added++;
+
+        if (ws->follow && !full)
+        {
+            table_put(rows++, &rec);
+            if (rows == MAX_ROWS)
+                flush_table();
+        }
+    }
+    if (ws->follow)
+        flush_table();
+
+    ws->offset = reader_offset(&rd);
+    mark_file(&ws->mark, fd, &st, ws->offset);
+
+    reader_close(&rd);
+    close(fd);
+    return added;
+}
 
-    while (fgets(line, 2000, dl) != NULL)
+/* Blocks until the file may have changed or the poll interval passes */
+static void watch_wait(int notify_fd)
+{
+    if (notify_fd < 0)
     {
-        /* expect first column to be an integer ID followed by a comma */
-        if (sscanf(line, "%d,", &id) == 1)
-            last_id = id; /* keeps updating; assumes IDs are in ascending order */
+        usleep(WATCH_POLL_MS * 1000 / 4);
+        return;
     }
 
-    fclose(dl);
-    return last_id + 1;
+#ifdef __linux__
+    struct pollfd pfd = {notify_fd, POLLIN, 0};
+    if (poll(&pfd, 1, WATCH_POLL_MS) <= 0)
+        return;
+
+    // Drain the queue; the caller re-checks the file regardless of which entry it was
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (read(notify_fd, events, sizeof(events)) > 0)
+        ;
+#endif
 }
 
-/*Asks the user for all review data. It appends the new review at the bottom of the CSV.*/
-void add_review_append_only(const char *filename)
+/* Follows appends to the CSV, re-parsing only the new bytes */
+int watch_file(const char *filename, int follow)
 {
-    int existed = file_exists(filename);
-    int next_id = get_next_id(filename);
+    struct watch_state ws;
+    int notify_fd = -1;
 
-    int rating;
-    int i;
-    int ch;
-    char month[100];
-    char location[200];
-    char review_text[2000];
-    char branch[200];
+    memset(&ws, 0, sizeof(ws));
+    ws.filename = filename;
+    ws.follow = follow;
+    watch_reset(&ws);
+
+    if (watch_update(&ws) < 0)
+    {
+        perror("File could not be opened");
+        return 1;
+    }
+    stats_print(&ws.stats);
+
+#ifdef __linux__
+    // Watch the directory so both in-place writes and replaced files are seen
+    char dir[4096];
+    const char *slash = strrchr(filename, '/');
+    if (slash)
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - filename), filename);
+    else
+        strcpy(dir, ".");
+
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd >= 0 &&
+        inotify_add_watch(notify_fd, dir, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        close(notify_fd);
+        notify_fd = -1;
+    }
+#endif
+
+    printf("Watching %s for new reviews (Ctrl+C to stop)...\n", filename);
+    fflush(stdout);
 
     while (1)
     {
-        printf("Enter your rating (1-5): ");
+        watch_wait(notify_fd);
 
-        if (scanf("%d", &rating) != 1)
+        long long added = watch_update(&ws);
+        if (added < 0)
+            continue; // file briefly missing while being replaced
+        if (ws.reloaded)
         {
-            printf("Rating must be a number!\n");
-            /* clear invalid input from stdin so the loop can retry cleanly */
-            while ((ch = getchar()) != '\n' && ch != EOF) { }
-            continue;
+            stats_print(&ws.stats);
+            fflush(stdout);
         }
-
-        while ((ch = getchar()) != '\n' && ch != EOF) { } /* consume leftover newline */
-
-        if (rating < 1 || rating > 5)
+        else if (added > 0)
         {
-            printf("Rating must be between 1 and 5!\n");
-            continue;
+            printf("[watch] +%lld review(s), %lld total\n", added, ws.stats.total);
+            fflush(stdout);
         }
-
-        break;
     }
+    return 0;
+}
 
-    inputMonth(month, sizeof(month)); /* external helper: reads month text into buffer safely */
+//***************************** Benchmarks *****************************
 
-    for (i = 0; month[i] != '\0'; i++)
+/* xorshift64* generator so datasets are reproducible from a seed */
+static unsigned long long rng_state = 88172645463325252ULL;
+
+void rng_seed(unsigned long long seed)
+{
+    rng_state = seed ? seed : 88172645463325252ULL;
+}
+
+unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+/* Uniform value in [0, n) */
+static unsigned rng_below(unsigned n)
+{
+    return (unsigned)((rng_next() >> 32) % n);
+}
+
+/* Picks an index with the given relative weights */
+static int rng_weighted(const int *weights, int n)
+{
+    int total = 0;
+    for (int i = 0; i < n; i++)
+        total += weights[i];
+
+    int pick = rng_below(total);
+    for (int i = 0; i < n; i++)
     {
-        if (month[i] >= '0' && month[i] <= '9')
-        {
-            printf("Month must not contain numbers!\n");
-            return; /* early exit on invalid month */
-        }
+        if (pick < weights[i])
+            return i;
+        pick -= weights[i];
     }
+    return n - 1;
+}
 
-    while (1)
+/* Appends a field, quoting it only when it contains a comma, quote or line break */
+static void put_csv_text(struct out_buffer *ob, const char *text, size_t len)
+{
+    if (memchr(text, ',', len) || memchr(text, '"', len) || memchr(text, '\n', len))
     {
-        printf("Enter your location: ");
-        if (scanf(" %199[^\n]", location) != 1)
+        char tmp[8192];
+        size_t n = len < sizeof(tmp) - 1 ? len : sizeof(tmp) - 1;
+        memcpy(tmp, text, n);
+        tmp[n] = '\0';
+        write_csv_field(ob, tmp);
+    }
+    else
+    {
+        out_put(ob, text, len);
+    }
+}
+
+/* Writes rows synthetic reviews with skewed branches, locations and ratings */
+int generate_dataset(int fd, long long nrows, unsigned long long seed)
+{
+    static const char *branches[] = {"Disneyland_California", "Disneyland_Paris", "Disneyland_HongKong"};
+    static const int branch_weights[] = {50, 30, 20};
+    static const char *locations[] = {
+        "United States", "United Kingdom", "Australia", "Canada", "India", "Philippines",
+        "Singapore", "Malaysia", "Hong Kong", "New Zealand", "France", "Germany",
+        "China", "Indonesia", "Ireland", "Thailand", "Japan", "Netherlands",
+        "United Arab Emirates", "Myanmar (Burma)", "Korea, Republic of", "South Africa",
+        "Spain", "Italy", "Mexico", "Brazil", "Vietnam", "Sweden"};
+    static const char *words[] = {
+        "the", "park", "was", "and", "we", "a", "to", "rides", "it", "kids", "queue", "queues",
+        "fast", "pass", "hot", "day", "great", "long", "wait", "time", "food", "expensive",
+        "castle", "parade", "fireworks", "Mickey", "staff", "friendly", "clean", "crowded",
+        "hotel", "train", "worth", "visit", "again", "magic", "small", "world", "space",
+        "mountain", "tickets", "early", "opening", "lines", "families", "children", "fun",
+        "amazing", "disappointed", "closed", "weather", "summer", "holiday", "Disney"};
+    static const int rating_weights[] = {6, 7, 12, 25, 50};
+    int nloc = sizeof(locations) / sizeof(locations[0]);
+    int nwords = sizeof(words) / sizeof(words[0]);
+    int loc_weights[64];
+    struct out_buffer ob = {0};
+    char text[8192];
+    char num[32];
+
+    // Zipf-like location skew: the k-th country is about 1/k as common as the first
+    for (int i = 0; i < nloc; i++)
+        loc_weights[i] = 1000 / (i + 1);
+
+    rng_seed(seed);
+    out_put(&ob, CSV_HEADER, CSV_HEADER_LEN);
+
+    for (long long id = 1; id <= nrows; id++)
+    {
+        // Review length: mostly short, with a long tail
+        int nw = 10 + rng_below(40) + (rng_below(8) == 0 ? rng_below(400) : 0);
+        size_t len = 0;
+
+        for (int w = 0; w < nw && len < sizeof(text) - 64; w++)
         {
-            printf("Location input is invalid!\n");
-            while ((ch = getchar()) != '\n' && ch != EOF) { }
-            continue;
+            const char *word = words[rng_below(nwords)];
+            size_t wl = strlen(word);
+            unsigned extra = rng_below(100);
+
+            if (w > 0)
+                text[len++] = ' ';
+            if (extra == 0)
+                text[len++] = '"'; // a quoted phrase, doubled on output
+            memcpy(text + len, word, wl);
+            len += wl;
+            if (extra == 0)
+                text[len++] = '"';
+            else if (extra < 8)
+                text[len++] = ',';
+            else if (extra < 9 && w + 1 < nw)
+                text[len++] = '\n'; // paragraph break inside the review
+            else if (extra < 13)
+                text[len++] = '.';
         }
-        getchar(); /* consume newline after the scanset read */
 
-        for (i = 0; location[i] != '\0'; i++)
+        int n = snprintf(num, sizeof(num), "%lld,%d,", id, rng_weighted(rating_weights, 5) + 1);
+        out_put(&ob, num, n);
+        const char *month = month_names[rng_below(12)];
+        out_put(&ob, month, strlen(month));
+        out_putc(&ob, ',');
+        const char *loc = locations[rng_weighted(loc_weights, nloc)];
+        put_csv_text(&ob, loc, strlen(loc));
+        out_putc(&ob, ',');
+        put_csv_text(&ob, text, len);
+        out_putc(&ob, ',');
+        const char *branch = branches[rng_weighted(branch_weights, 3)];
+        out_put(&ob, branch, strlen(branch));
+        out_putc(&ob, '\n');
+
+        if (ob.len >= READ_CHUNK)
         {
-            if (location[i] >= '0' && location[i] <= '9')
+            if (ob.failed || !write_all(fd, ob.data, ob.len))
             {
-                printf("Location must not contain numbers!\n");
-                break;
+                out_free(&ob);
+                return 0;
             }
+            ob.len = 0;
         }
+    }
 
-        if (location[i] == '\0')
-            break; /* only accept location if no digits were found */
+    int ok = !ob.failed && write_all(fd, ob.data, ob.len);
+    out_free(&ob);
+    return ok;
+}
+
+/* Result of timing one operation */
+struct bench_result
+{
+    const char *op;
+    long long iterations;
+    double seconds;     // Wall time per iteration
+    long long rows;     // Rows handled per iteration
+    long long bytes;    // Bytes read or written per iteration
+};
+
+/* Prints one result as a JSON line */
+static void bench_report(const struct bench_result *r)
+{
+    double rows_s = r->seconds > 0 ? r->rows / r->seconds : 0;
+    double mb_s = r->seconds > 0 ? r->bytes / r->seconds / 1e6 : 0;
+
+    printf("{\"op\":\"%s\",\"iterations\":%lld,\"seconds\":%.9f,\"rows\":%lld,\"bytes\":%lld,"
+           "\"rows_per_s\":%.1f,\"mb_per_s\":%.3f}\n",
+           r->op, r->iterations, r->seconds, r->rows, r->bytes, rows_s, mb_s);
+    fflush(stdout);
+}
+
+/* Sends stdout to /dev/null (or back when saved >= 0). Returns the saved descriptor */
+static int bench_mute(int saved)
+{
+    fflush(stdout);
+    if (saved >= 0)
+    {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        return -1;
     }
 
-    printf("Enter your review: ");
-    scanf(" %1999[^\n]", review_text); /* read full line (up to buffer limit) */
-    getchar();
+    saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+    return saved;
+}
 
-    while (1)
+/* Copies a file, returning 1 on success */
+int copy_file(const char *from, const char *to)
+{
+    char *buf = malloc(READ_CHUNK);
+    int in = open(from, O_RDONLY);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok = buf && in >= 0 && out >= 0;
+    ssize_t n;
+
+    while (ok && (n = read(in, buf, READ_CHUNK)) > 0)
+        ok = write_all(out, buf, n);
+
+    if (in >= 0)
+        close(in);
+    if (out >= 0 && close(out) != 0)
+        ok = 0;
+    free(buf);
+    return ok;
+}
+
+static long long file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : 0;
+}
+
+/* Counts records and the bytes up to the end of the first limit records */
+static long long count_records(const char *path, long long limit, long long *prefix_bytes)
+{
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long n = 0;
+    int fd = open(path, O_RDONLY);
+
+    *prefix_bytes = 0;
+    if (fd < 0 || !reader_open(&rd, fd, 0))
     {
-        printf("Enter the branch you have visited (e.g. Disneyland_Paris): ");
-        if (scanf(" %199[^\n]", branch) != 1)
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+    reader_skip_header(&rd);
+    while (reader_next(&rd, &rec, 1))
+    {
+        n++;
+        if (n == limit)
+            *prefix_bytes = reader_offset(&rd);
+    }
+    if (n < limit)
+        *prefix_bytes = reader_offset(&rd);
+
+    reader_close(&rd);
+    close(fd);
+    return n;
+}
+
+/* Review_ID of the record after the first skip ones (0 when the file is shorter) */
+static int bench_middle_id(long long skip)
+{
+    struct review_scan sc;
+    const struct csv_record *rec;
+
+    if (!scan_open(&sc, DATA_FILE, NULL))
+        return 0;
+    while ((rec = scan_next(&sc)) && skip-- > 0)
+        ;
+    int id = rec ? record_id(rec) : 0;
+    scan_close(&sc);
+    return id;
+}
+
+/* Dataset being benchmarked, restored before every delete */
+static const char *bench_source;
+
+/* Which operation bench_once() runs */
+enum bench_op
+{
+    BENCH_VIEW,
+    BENCH_SORT_RATING,
+    BENCH_SORT_BRANCH,
+    BENCH_PRINT,
+    BENCH_NEXT_ID,
+    BENCH_SCAN,
+    BENCH_DELETE,
+    BENCH_STORE_UPDATE,
+    BENCH_STORE_DELETE
+};
+
+/* Review_ID the store benchmarks change, one in the middle of the dataset */
+static int bench_id;
+
+/* Runs one iteration of an operation on the working copy */
+static void bench_once(enum bench_op op, long long iteration)
+{
+    switch (op)
+    {
+    case BENCH_VIEW:
+        view_data(DATA_FILE, NULL);
+        break;
+    case BENCH_SORT_RATING:
+        sort_by_rating_desc();
+        break;
+    case BENCH_SORT_BRANCH:
+        sort_by_branch();
+        break;
+    case BENCH_PRINT:
+        print_table();
+        break;
+    case BENCH_NEXT_ID:
+        get_next_id(DATA_FILE);
+        break;
+    case BENCH_SCAN:
+    {
+        struct review_scan sc;
+        if (scan_open(&sc, DATA_FILE, NULL))
         {
-            printf("Branch input is invalid!\n");
-            while ((ch = getchar()) != '\n' && ch != EOF) { }
-            continue;
+            while (scan_next(&sc))
+                ;
+            scan_close(&sc);
         }
-        getchar();
+        break;
+    }
+    case BENCH_DELETE:
+    {
+        // delete_review() is interactive: feed it "<first id>, yes, yes" on stdin
+        struct review_scan sc;
+        const struct csv_record *rec;
+        FILE *in;
 
-        for (i = 0; branch[i] != '\0'; i++)
+        (void)iteration;
+        if (!scan_open(&sc, DATA_FILE, NULL))
+            break;
+        rec = scan_next(&sc);
+        in = rec ? fopen("bench-input.txt", "w") : NULL;
+        if (in)
         {
-            if (branch[i] >= '0' && branch[i] <= '9')
-            {
-                printf("Branch must not contain numbers!\n");
-                break;
-            }
+            fprintf(in, "%s\ny\ny\n", rec->field[COL_ID]);
+            fclose(in);
         }
+        scan_close(&sc);
 
-        if (branch[i] == '\0')
+        if (in && freopen("bench-input.txt", "r", stdin))
+            delete_review(DATA_FILE);
+        break;
+    }
+    case BENCH_STORE_UPDATE:
+    case BENCH_STORE_DELETE:
+    {
+        // one rewrite of the data file; updates cycle the rating so every pass changes the row
+        struct review_update u = {bench_id, {(int)(iteration % 5) + 1, NULL, NULL, NULL, NULL}};
+        struct review_store *store = review_store_open(DATA_FILE);
+        if (!store)
             break;
+        if (op == BENCH_STORE_UPDATE)
+            review_store_update(store, &u, 1);
+        else
+            review_store_delete(store, &bench_id, 1);
+        review_store_close(store);
+        break;
+    }
     }
+}
 
-    printf("\n");
+/* Repeats an operation until min_seconds have passed and returns the average */
+static struct bench_result bench_time(const char *name, enum bench_op op, double min_seconds,
+                                      long long rows, long long bytes)
+{
+    struct bench_result r = {name, 0, 0, rows, bytes};
+    double start = now_seconds();
+    double timed = 0;
 
-    FILE *dl = fopen(filename, "a"); /* append-only write: preserve existing records */
-    if (dl == NULL)
+    do
     {
-        printf("File not found.\n");
-        return;
-    }
+        // Sorts work in place, so the table is reloaded outside the timed part
+        if (op == BENCH_SORT_RATING || op == BENCH_SORT_BRANCH)
+            view_data(DATA_FILE, NULL);
+        // Every delete starts from the full dataset
+        if (op == BENCH_DELETE || op == BENCH_STORE_DELETE)
+            copy_file(bench_source, DATA_FILE);
+
+        double t = now_seconds();
+        bench_once(op, r.iterations);
+        timed += now_seconds() - t;
+        r.iterations++;
+    } while (now_seconds() - start < min_seconds);
+
+    r.seconds = timed / r.iterations;
+    return r;
+}
+
+/* Times the existing operations on a private copy of a dataset */
+int run_benchmarks(const char *source, double min_seconds)
+{
+    char dir[] = "/tmp/review-bench-XXXXXX";
+    char cwd[PATH_LEN];
+    long long view_bytes, size;
 
-    if (!existed)
+    if (!getcwd(cwd, sizeof(cwd)) || !mkdtemp(dir))
     {
-        fprintf(dl, "Review_ID,Rating,Review_Month,Reviewer_Location,Review_Text,Branch\n"); /* write header once */
+        perror("Benchmark directory could not be created");
+        return 1;
     }
 
-    /* make sure the file ends with newline before appending */
-    FILE *check = fopen(filename, "r+"); /* open for read/write so we can inspect/patch the last byte */
-    if (check != NULL)
+    // The menu functions use DATA_FILE relative to the working directory
+    char path[PATH_LEN + 64];
+    char source_path[PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", dir, DATA_FILE);
+    if (source[0] == '/')
+        snprintf(source_path, sizeof(source_path), "%s", source);
+    else
+        snprintf(source_path, sizeof(source_path), "%.*s/%.*s", PATH_LEN / 2 - 1, cwd, PATH_LEN / 2 - 2, source);
+    bench_source = source_path;
+    if (!copy_file(source, path) || chdir(dir) != 0)
     {
-        fseek(check, -1, SEEK_END);
-        int lastChar = fgetc(check);
-
-        if (lastChar != '\n')
-        {
-            fseek(check, 0, SEEK_END);
-            fputc('\n', check); /* ensures the next appended row starts on a new line */
-        }
-        fclose(check);
+        perror("Dataset could not be copied");
+        return 1;
     }
 
-    fprintf(dl, "%d,%d,", next_id, rating); /* write ID and rating as raw CSV numbers */
-
-    /* remaining fields are quoted/escaped to safely handle commas/newlines/quotes */
-    write_csv_field(dl, month);
-    fputc(',', dl);
-    write_csv_field(dl, location);
-    fputc(',', dl);
-    write_csv_field(dl, review_text);
-    fputc(',', dl);
-    write_csv_field(dl, branch);
-    fputc('\n', dl);
-
-    fclose(dl);
-
-    printf("\nThank you! We have successfully received your review.\n");
+    size = file_size(DATA_FILE);
+    long long total = count_records(DATA_FILE, MAX_ROWS, &view_bytes);
+    long long view_rows = total < MAX_ROWS ? total : MAX_ROWS;
+    int saved_in = dup(STDIN_FILENO);
+    int muted = bench_mute(-1);
+    struct bench_result results[10];
+    int n = 0;
+
+    results[n++] = bench_time("view_data", BENCH_VIEW, min_seconds, view_rows, view_bytes);
+    long long table_bytes = view_rows * (long long)sizeof(table[0]);
+    results[n++] = bench_time("sort_by_rating_desc", BENCH_SORT_RATING, min_seconds, view_rows, table_bytes);
+    results[n++] = bench_time("sort_by_branch", BENCH_SORT_BRANCH, min_seconds, view_rows, table_bytes);
+
+    // Output size of print_table(), measured once into a file
+    view_data(DATA_FILE, NULL);
+    column_width();
+    fflush(stdout);
+    int out = open("bench-table.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int keep = dup(STDOUT_FILENO);
+    dup2(out, STDOUT_FILENO);
+    print_table();
+    fflush(stdout);
+    dup2(keep, STDOUT_FILENO);
+    close(keep);
+    close(out);
+    results[n++] = bench_time("print_table", BENCH_PRINT, min_seconds, view_rows, file_size("bench-table.txt"));
+
+    results[n++] = bench_time("get_next_id", BENCH_NEXT_ID, min_seconds, total, size);
+    results[n++] = bench_time("scan", BENCH_SCAN, min_seconds, total, size);
+    results[n++] = bench_time("delete_review", BENCH_DELETE, min_seconds, total, size);
+
+    copy_file(bench_source, DATA_FILE);
+    bench_id = bench_middle_id(total / 2);
+    results[n++] = bench_time("review_store_update", BENCH_STORE_UPDATE, min_seconds, total, size);
+    results[n++] = bench_time("review_store_delete", BENCH_STORE_DELETE, min_seconds, total, size);
+
+    bench_mute(muted);
+    dup2(saved_in, STDIN_FILENO);
+    close(saved_in);
+
+    for (int i = 0; i < n; i++)
+        bench_report(&results[i]);
+
+    char side[PATH_LEN + 16];
+    sidecars_invalidate(DATA_FILE);
+    checksum_path(DATA_FILE, side, sizeof(side));
+    remove(side);
+    remove(DATA_FILE ".lock");
+    remove(DATA_FILE);
+    remove("bench-input.txt");
+    remove("bench-table.txt");
+    if (chdir(cwd) != 0 || rmdir(dir) != 0)
+        perror(dir);
+    return 0;
 }
 
-//***************************** Delete Data *****************************
+//***************************** Command Line *****************************
 
-/* Trim newline characters from the end of the input string */
-static void trim_newline(char *s)
+/* Returns the value following an option such as --file, or NULL */
+const char *option_value(int argc, char *argv[], const char *name)
 {
-    if (!s)
-        return;
-    size_t n = strlen(s);
-    while (n > 0 && (s[n - 1] == '\n' || s[n - 1] == '\r'))
+    for (int i = 0; i < argc - 1; i++)
     {
-        s[n - 1] = '\0';
-        n--;
+        if (strcmp(argv[i], name) == 0)
+            return argv[i + 1];
     }
+    return NULL;
 }
 
-/* Ask the user a yes/no question until valid input is given */
-static char ask_yes_no(const char *prompt)
+/* 1 when a flag such as --follow is present */
+int has_flag(int argc, char *argv[], const char *name)
 {
-    char ans[32];
-    while (1)
+    for (int i = 0; i < argc; i++)
     {
-        printf("%s", prompt);
-        if (!fgets(ans, sizeof(ans), stdin))
-            return 'n';
-        trim_newline(ans);
+        if (strcmp(argv[i], name) == 0)
+            return 1;
+    }
+    return 0;
+}
 
-        if (ans[0] == 'y' || ans[0] == 'Y')
-            return 'y';
-        if (ans[0] == 'n' || ans[0] == 'N')
-            return 'n';
+/* Reads "A" or "A..B" into an inclusive range */
+static int parse_range(const char *text, int *lo, int *hi)
+{
+    char extra;
 
-        printf("Please enter y or n.\n");
+    if (sscanf(text, "%d..%d %c", lo, hi, &extra) == 2)
+        return *lo <= *hi;
+    if (sscanf(text, "%d %c", lo, &extra) == 1)
+    {
+        *hi = *lo;
+        return 1;
     }
+    return 0;
 }
 
-/* NOTE:
- * We intentionally read the CSV file line-by-line (fgets) for deletion.
- * This keeps the delete part simple and avoids an extra "read_csv_record" helper.
- * Assumption: each review is stored in a single CSV line (no embedded newlines).
- */
-
-/* Parse CSV fields correctly */
-static int parse_csv_fields(const char *rec, char fields[][2000], int max_fields)
+/* Builds a row filter from --branch, --id A[..B], --rating A[..B], --month NAME[,NAME] and
+ * --columns NAME[,NAME]. Returns 0 on bad input */
+int parse_filter(int argc, char *argv[], struct review_filter *f)
 {
-    int f = 0, i = 0;
+    const char *id = option_value(argc, argv, "--id");
+    const char *rating = option_value(argc, argv, "--rating");
+    const char *month = option_value(argc, argv, "--month");
+    const char *columns = option_value(argc, argv, "--columns");
 
-    while (rec[i] != '\0' && f < max_fields)
-    {
-        int out = 0;
-        while (rec[i] == ' ')
-            i++;
+    filter_init(f);
+    f->branch = option_value(argc, argv, "--branch");
 
-        /* Field is enclosed in double quotes */
-        if (rec[i] == '"')
+    if (id && !parse_range(id, &f->min_id, &f->max_id))
+    {
+        printf("Invalid --id '%s' (use N or A..B).\n", id);
+        return 0;
+    }
+    if (rating && !parse_range(rating, &f->min_rating, &f->max_rating))
+    {
+        printf("Invalid --rating '%s' (use N or A..B).\n", rating);
+        return 0;
+    }
+    if (month)
+    {
+        char names[128];
+        snprintf(names, sizeof(names), "%s", month);
+        for (char *name = strtok(names, ","); name; name = strtok(NULL, ","))
         {
-            i++;
-            while (rec[i] != '\0')
+            int m = month_index(name);
+            if (m < 0)
             {
-                if (rec[i] == '"' && rec[i + 1] == '"')
-                {
-                    fields[f][out++] = '"';
-                    i += 2;
-                }
-                else if (rec[i] == '"')
-                {
-                    i++;
-                    break;
-                }
-                else
-                {
-                    fields[f][out++] = rec[i++];
-                }
+                printf("Invalid month '%s'.\n", name);
+                return 0;
             }
-            fields[f][out] = '\0';
-            while (rec[i] && rec[i] != ',')
-                i++;
-            if (rec[i] == ',')
-                i++;
+            f->months |= 1u << m;
         }
-        else
+    }
+    if (columns)
+    {
+        char names[256];
+        snprintf(names, sizeof(names), "%s", columns);
+        for (char *name = strtok(names, ","); name; name = strtok(NULL, ","))
         {
-            /* Normal field without quotes */
-            while (rec[i] && rec[i] != ',' && rec[i] != '\n')
-                fields[f][out++] = rec[i++];
-            fields[f][out] = '\0';
-            if (rec[i] == ',')
-                i++;
+            int c = column_index(name);
+            if (c < 0)
+            {
+                printf("Invalid column '%s'.\n", name);
+                return 0;
+            }
+            f->columns |= 1u << c;
         }
-        f++;
     }
-    return f;
+    return 1;
 }
 
-/* Delete a review by Review ID */
-void delete_review(const char *filename)
+/* watch [--follow] [--file PATH] */
+int cmd_watch(int argc, char *argv[])
 {
-    FILE *fp = fopen(filename, "r");
-    if (!fp)
-    {
-        printf("File not found %s\n", filename);
-        return;
-    }
+    const char *file = option_value(argc, argv, "--file");
+    int follow = has_flag(argc, argv, "--follow") || has_flag(argc, argv, "-f");
+
+    return watch_file(file ? file : DATA_FILE, follow);
+}
+
+/* append [--durability none|batch|record] [--file PATH] < rows.csv
+ * Reads rows in the data file's column order (Review_ID is ignored and reassigned) */
+int cmd_append(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    enum durability durability = parse_durability(option_value(argc, argv, "--durability"), DURABLE_BATCH);
+    struct review_writer w;
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long added = 0, rejected = 0;
+
+    if (!file)
+        file = DATA_FILE;
 
-    /*Read CSV header*/
-    char header[2048];
-    if (!fgets(header, sizeof(header), fp))
+    if (!writer_open(&w, file, durability))
     {
-        printf("Error: CSV header missing.\n");
-        fclose(fp);
-        return;
+        perror("File could not be opened");
+        return 1;
     }
-
-    /*Read all records into memory for easier deletion*/
-    int cap = 128;
-    int nrec = 0;
-    char **records = (char **)malloc(sizeof(char *) * cap);
-    if (!records)
+    if (!reader_open(&rd, STDIN_FILENO, 0))
     {
-        fclose(fp);
-        return;
+        writer_close(&w);
+        return 1;
     }
 
-    char rec[8000];
-    while (fgets(rec, sizeof(rec), fp))
+    while (reader_next(&rd, &rec, 1))
     {
-        /* remove trailing newline so later rewriting can control \n consistently */
-        trim_newline(rec);
+        int rating = record_rating(&rec);
 
-        /* skip empty lines */
-        if (rec[0] == '\0')
+        // Allow the input to carry its own header line
+        if (strcmp(rec.field[COL_ID], "Review_ID") == 0)
             continue;
-
-        if (nrec >= cap)
+        // The ID may be left empty since the writer assigns one; everything else must fit the schema
+        if ((rec.field_len[COL_ID] == 0 ? rec.nfields != COLS : !record_valid(&rec)) || rating < 1 || rating > 5)
         {
-            cap *= 2;
-            char **tmp = (char **)realloc(records, sizeof(char *) * cap);
-            if (!tmp)
-                break;
-            records = tmp;
+            fprintf(stderr, "Skipping malformed row at byte %lld\n", rec.offset);
+            rejected++;
+            continue;
         }
 
-        records[nrec] = (char *)malloc(strlen(rec) + 1);
-        if (!records[nrec])
+        struct review_values v = {.rating = rating, .month = rec.field[COL_MONTH], .location = rec.field[COL_LOCATION],
+                                  .text = rec.field[COL_TEXT], .branch = rec.field[COL_BRANCH]};
+        if (!writer_add(&w, &v))
             break;
-        strcpy(records[nrec], rec);
-        nrec++;
+        added++;
     }
-    fclose(fp);
+    reader_close(&rd);
 
-    /* Keep asking until user enters a valid and existing Review ID */
-    int delete_id = 0;
-    int target_index = -1;
-    char line[128];
+    if (!writer_close(&w))
+    {
+        perror("Append failed");
+        return 1;
+    }
+    printf("Appended %lld review(s), skipped %lld.\n", added, rejected);
+    return rejected > 0;
+}
 
-    while (1)
+/* Collects the IDs a delete applies to */
+struct id_list
+{
+    int *ids;
+    int n, cap;
+};
+
+static int collect_id(void *ctx, const struct review_view *review)
+{
+    struct id_list *l = ctx;
+
+    if (l->n == l->cap)
     {
-        printf("Enter the Review ID to delete: ");
-        if (!fgets(line, sizeof(line), stdin))
-            continue;
-        trim_newline(line);
+        int cap = l->cap ? l->cap * 2 : 256;
+        int *tmp = realloc(l->ids, sizeof(int) * cap);
+        if (!tmp)
+            return 1;
+        l->ids = tmp;
+        l->cap = cap;
+    }
+    l->ids[l->n++] = review->id;
+    return 0;
+}
 
-        /* Input must be a number only */
-        int value;
-        char extra;
-        if (sscanf(line, "%d %c", &value, &extra) != 1)
-        {
-            printf("\nInvalid Review ID. Please enter numbers only.\n\n");
-            continue;
-        }
+/* delete [filters] [--file PATH]: removes every matching review in one rewrite per file */
+int cmd_delete(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    struct review_filter filter;
+    struct review_query q;
+    struct review_store *store;
+    struct id_list l = {0};
+    int removed;
+
+    if (!parse_filter(argc, argv, &filter))
+        return 2;
+    if (!option_value(argc, argv, "--id") && !option_value(argc, argv, "--rating") &&
+        !option_value(argc, argv, "--month") && !filter.branch)
+    {
+        printf("Refusing to delete every review: give --id, --rating, --month or --branch.\n");
+        return 2;
+    }
 
-        delete_id = value;
-        target_index = -1;
+    store = review_store_open(file ? file : DATA_FILE);
+    if (!store)
+        return 1;
+    review_query_init(&q);
+    q.branch = filter.branch;
+    q.min_id = filter.min_id;
+    q.max_id = filter.max_id;
+    q.min_rating = filter.min_rating;
+    q.max_rating = filter.max_rating;
+    q.months = filter.months;
+    q.columns = 1u << REVIEW_ID;
+
+    if (review_store_scan(store, &q, collect_id, &l) < 0 || (removed = review_store_delete(store, l.ids, l.n)) < 0)
+    {
+        printf("Delete failed: %s\n", review_store_error(store));
+        free(l.ids);
+        review_store_close(store);
+        return 1;
+    }
+    printf("Deleted %d review(s).\n", removed);
+    free(l.ids);
+    review_store_close(store);
+    return 0;
+}
+
+/* update --id N [--rating R] [--month M] [--location L] [--text T] [--branch B] [--file PATH] */
+int cmd_update(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    const char *id = option_value(argc, argv, "--id");
+    const char *rating = option_value(argc, argv, "--rating");
+    struct review_update u;
+    struct review_store *store;
+    int changed;
+
+    memset(&u, 0, sizeof(u));
+    u.id = id ? atoi(id) : 0;
+    u.set.rating = rating ? atoi(rating) : 0;
+    u.set.month = option_value(argc, argv, "--month");
+    u.set.location = option_value(argc, argv, "--location");
+    u.set.text = option_value(argc, argv, "--text");
+    u.set.branch = option_value(argc, argv, "--branch");
+    if (u.id <= 0 || (rating && (u.set.rating < 1 || u.set.rating > 5)) || (u.set.month && month_index(u.set.month) < 0))
+    {
+        printf("Usage: update --id N [--rating 1-5] [--month NAME] [--location L] [--text T] [--branch B]\n");
+        return 2;
+    }
+
+    store = review_store_open(file ? file : DATA_FILE);
+    if (!store)
+        return 1;
+    changed = review_store_update(store, &u, 1);
+    if (changed < 0)
+        printf("Update failed: %s\n", review_store_error(store));
+    else if (changed == 0)
+        printf("Review ID %d not found.\n", u.id);
+    else
+        printf("Review %d updated.\n", u.id);
+    review_store_close(store);
+    return changed > 0 ? 0 : 1;
+}
+
+/* view [filters] [--sort rating|branch | --top K | --bottom K [--by COLUMN] | --sample N [--seed S]
+ *       | --rows A..B | --page P [--page-size S]] [--file PATH] */
+int cmd_view(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    const char *sort = option_value(argc, argv, "--sort");
+    const char *top = option_value(argc, argv, "--top");
+    const char *bottom = option_value(argc, argv, "--bottom");
+    const char *by = option_value(argc, argv, "--by");
+    const char *sample = option_value(argc, argv, "--sample");
+    const char *seed = option_value(argc, argv, "--seed");
+    const char *range = option_value(argc, argv, "--rows");
+    const char *page = option_value(argc, argv, "--page");
+    const char *page_size = option_value(argc, argv, "--page-size");
+    struct review_filter filter;
+
+    if (!parse_filter(argc, argv, &filter))
+        return 2;
+    show_columns(filter.columns);
+
+    // --rows A..B or --page P [--page-size S] show one stretch of the data
+    if (range || page)
+    {
+        int lo, hi;
+        long long first, last;
 
-        /* Search for the matching Review ID */
-        for (int i = 0; i < nrec; i++)
+        if (page)
         {
-            int id;
-            if (sscanf(records[i], "%d,", &id) == 1 && id == delete_id)
+            int size = page_size ? atoi(page_size) : MAX_ROWS;
+            int p = atoi(page);
+            if (p <= 0 || size <= 0)
             {
-                target_index = i;
-                break;
+                printf("--page and --page-size must be positive.\n");
+                return 2;
             }
+            first = (long long)(p - 1) * size + 1;
+            last = (long long)p * size;
         }
-
-        if (target_index == -1)
+        else if (parse_range(range, &lo, &hi) && lo > 0)
         {
-            printf("\nReview ID not found. Please try again.\n\n");
-            continue;
+            first = lo;
+            last = hi;
         }
-
-        break;
+        else
+        {
+            printf("--rows takes A..B with 1 <= A <= B.\n");
+            return 2;
+        }
+        if (!view_rows(file ? file : DATA_FILE, &filter, first, last))
+        {
+            perror("File could not be opened");
+            return 1;
+        }
+        return 0;
     }
 
-    /* Display the selected review */
+    // --sample N picks N random reviews; the seed is printed so a sample can be repeated
+    if (sample)
     {
-        char fields[6][2000];
-        parse_csv_fields(records[target_index], fields, 6);
+        unsigned long long s = seed ? strtoull(seed, NULL, 10) : (unsigned long long)time(NULL) ^ ((unsigned long long)getpid() << 32);
 
-        printf("\n--- Review Found ---\n");
-        printf("ID: %s\nRating: %s\nMonth: %s\nLocation: %s\nReview: %s\nBranch: %s\n",
-               fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+        if (atoi(sample) <= 0)
+        {
+            printf("--sample needs a positive count.\n");
+            return 2;
+        }
+        if (!view_sample(file ? file : DATA_FILE, &filter, atoi(sample), s))
+        {
+            perror("File could not be opened");
+            return 1;
+        }
+        return 0;
     }
 
-    /* Double confirmation to prevent accidental deletion */
-    if (ask_yes_no("\nDo you want to delete this review? (y/n): ") == 'n')
+    // --top/--bottom keep K reviews per group instead of the first MAX_ROWS
+    if (top || bottom)
     {
-        printf("\nThis review has NOT been deleted.\n");
-        for (int i = 0; i < nrec; i++)
-            free(records[i]);
-        free(records);
-        return;
+        int k = atoi(top ? top : bottom);
+        int column = -1;
+
+        if (by && strcmp(by, "branch") == 0)
+            column = COL_BRANCH;
+        else if (by && strcmp(by, "location") == 0)
+            column = COL_LOCATION;
+        else if (by && strcmp(by, "month") == 0)
+            column = COL_MONTH;
+        else if (by)
+        {
+            printf("--by takes branch, location or month.\n");
+            return 2;
+        }
+        if (k <= 0)
+        {
+            printf("--top/--bottom need a positive count.\n");
+            return 2;
+        }
+        if (!view_top(file ? file : DATA_FILE, &filter, k, bottom != NULL, column))
+        {
+            perror("File could not be opened");
+            return 1;
+        }
+        return 0;
     }
 
-    if (ask_yes_no("\nAre you sure you want to delete this review? (y/n): ") == 'n')
+    if (!view_data(file ? file : DATA_FILE, &filter))
     {
-        printf("\nThis review has NOT been deleted.\n");
-        for (int i = 0; i < nrec; i++)
-            free(records[i]);
-        free(records);
-        return;
+        perror("File could not be opened");
+        return 1;
     }
 
-    /* Rewrite the original CSV file */
-    fp = fopen(filename, "w");
-    if (!fp)
+    if (sort && strcmp(sort, "rating") == 0)
+        sort_by_rating_desc();
+    else if (sort && strcmp(sort, "branch") == 0)
+        sort_by_branch();
+
+    column_width();
+    print_table();
+    return 0;
+}
+
+/* report [filters] [--file PATH] */
+int cmd_report(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    struct review_filter filter;
+    struct review_scan sc;
+    struct review_stats st;
+    const struct csv_record *rec;
+
+    if (!parse_filter(argc, argv, &filter))
+        return 2;
+    filter.columns = 1u << COL_RATING | 1u << COL_BRANCH; // totals only need Rating and Branch
+
+    // Indexed data is split over the thread pool
+    memset(&st, 0, sizeof(st));
+    if (pool_size() > 1 && stats_parallel(file ? file : DATA_FILE, &filter, &st))
     {
-        printf("\nError: cannot write file.\n");
-        for (int i = 0; i < nrec; i++)
-            free(records[i]);
-        free(records);
-        return;
+        stats_print(&st);
+        stats_free(&st);
+        return 0;
     }
 
-    fputs(header, fp);
-    if (header[strlen(header) - 1] != '\n')
-        fputc('\n', fp);
-
-    for (int i = 0; i < nrec; i++)
+    if (!scan_open(&sc, file ? file : DATA_FILE, &filter))
     {
-        if (i == target_index)
-            continue;
-        fputs(records[i], fp);
-        if (records[i][strlen(records[i]) - 1] != '\n')
-            fputc('\n', fp);
+        perror("File could not be opened");
+        return 1;
     }
-    fclose(fp);
 
-    printf("\nReview deleted successfully.\n");
+    sc.skip_text = 1; // totals never look at the text
+    while ((rec = scan_next(&sc)) != NULL)
+        stats_add(&st, rec);
+    if (sc.blocks_total > 0)
+        fprintf(stderr, "Zone maps: read %lld of %lld blocks.\n", sc.blocks_read, sc.blocks_total);
+    scan_close(&sc);
 
-    for (int i = 0; i < nrec; i++)
-        free(records[i]);
-    free(records);
+    stats_print(&st);
+    stats_free(&st);
+    return 0;
 }
 
-//***************************** Edit Data *****************************
-
-/* =========================
-Struct for collecting review
-========================= */
-struct Review
+/* One file's zone map, built by a pool task */
+struct zonemap_task
 {
-    int id;                  // Review ID
-    int rating;              // Rating
-    char month[20];          // Review month
-    char location[50];       // Reviewer location
-    char review[REVIEW_LEN]; // Review text
-    char branch[50];         // Disneyland branch
+    const char *path;
+    int block_records;
+    struct zone_map zm;
+    int ok;
 };
 
-struct Review reviews[MAX]; // array collect all review
-int count = 0;              // collect the amount of review
-
-//comma in review
-void parseCSVLine(char *line, struct Review *r)
+static void zonemap_task_run(void *arg)
 {
-    char fields[6][REVIEW_LEN];
-    int field = 0, i = 0, j = 0;
-    int in_quotes = 0;
-
-    for (int k = 0; k < 6; k++)
-        fields[k][0] = '\0';
+    struct zonemap_task *t = arg;
+    t->ok = zonemap_sync(t->path, &t->zm, t->block_records);
+}
 
-    while (line[i] != '\0' && field < 6)
+/* trends [--branch NAME] [--months FROM[..TO]] [--chart] [--file PATH]: monthly averages per branch */
+int cmd_trends(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    const char *branch = option_value(argc, argv, "--branch");
+    const char *months = option_value(argc, argv, "--months");
+    int chart = has_flag(argc, argv, "--chart");
+    int first = 0, last = 11;
+    struct trend_prefix *tp;
+
+    if (months)
     {
-        if (line[i] == '"')
-        {
-            in_quotes = !in_quotes;
-        }
-        else if (line[i] == ',' && !in_quotes)
-        {
-            fields[field][j] = '\0';
-            field++;
-            j = 0;
-        }
-        else
+        char from[32];
+        const char *dots = strstr(months, "..");
+        snprintf(from, sizeof(from), "%.*s", dots ? (int)(dots - months) : (int)strlen(months), months);
+        first = month_index(from);
+        last = dots ? month_index(dots + 2) : first;
+        if (first < 0 || last < 0)
         {
-            fields[field][j++] = line[i];
+            printf("Invalid --months '%s' (use e.g. March..August).\n", months);
+            return 2;
         }
-        i++;
     }
-    fields[field][j] = '\0';
 
-    /* copy to struct */
-    r->id = atoi(fields[0]);
-    r->rating = atoi(fields[1]);
-    strcpy(r->month, fields[2]);
-    strcpy(r->location, fields[3]);
-    strcpy(r->review, fields[4]);
-    strcpy(r->branch, fields[5]);
+    tp = malloc(sizeof(*tp));
+    if (!tp || !trends_build(file ? file : DATA_FILE, tp))
+    {
+        perror("File could not be opened");
+        free(tp);
+        return 1;
+    }
+
+    // Monthly averages: one column (or one bar) per month
+    printf("%-24s", "Branch");
+    for (int m = 0; m < 12; m++)
+        printf(chart ? "%.1s" : " %5.3s", month_names[m]);
+    printf("\n");
+    for (int r = 0; r < tp->nbranch; r++)
+    {
+        if (!branch || strcmp(branch, tp->branch[r]) == 0)
+            trends_print_row(tp, r, tp->branch[r], chart);
+    }
+    if (!branch)
+        trends_print_row(tp, -1, "All branches", chart);
+
+    // The range totals come straight from the prefix sums
+    printf("\n%s..%s:\n", month_names[first], month_names[last]);
+    long long all_count = 0, all_sum = 0;
+    for (int r = 0; r < tp->nbranch; r++)
+    {
+        long long count, sum;
+        if (branch && strcmp(branch, tp->branch[r]) != 0)
+            continue;
+        trends_range(tp, r, first, last, &count, &sum);
+        printf("%-24s %10lld reviews, average %.2f\n", tp->branch[r], count, count ? (double)sum / count : 0.0);
+        all_count += count;
+        all_sum += sum;
+    }
+    if (!branch)
+        printf("%-24s %10lld reviews, average %.2f\n", "All branches", all_count,
+               all_count ? (double)all_sum / all_count : 0.0);
+
+    free(tp);
+    return 0;
+}
+
+/* dedupe [filters] [--threshold T] [--file PATH]: clusters of near-duplicate review texts */
+int cmd_dedupe(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    const char *threshold = option_value(argc, argv, "--threshold");
+    struct review_filter filter;
+    double t = threshold ? atof(threshold) : 0.8;
+
+    if (!parse_filter(argc, argv, &filter))
+        return 2;
+    if (t <= 0 || t > 1)
+    {
+        printf("Invalid --threshold '%s' (use a similarity between 0 and 1).\n", threshold);
+        return 2;
+    }
+    int done = find_duplicates(file ? file : DATA_FILE, &filter, t);
+    if (done == 0)
+        perror("File could not be opened");
+    return done > 0 ? 0 : 1;
+}
+
+/* terms [filters] [--top K] [--min-count N] [--by lift|count] [--file PATH]: words and phrases
+ * that stand out per branch and rating */
+int cmd_terms(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    const char *top = option_value(argc, argv, "--top");
+    const char *min = option_value(argc, argv, "--min-count");
+    const char *by = option_value(argc, argv, "--by");
+    struct review_filter filter;
+    int k = top ? atoi(top) : 10;
+    long long min_count = min ? atoll(min) : 10;
+
+    if (!parse_filter(argc, argv, &filter))
+        return 2;
+    if (k < 1 || min_count < 1)
+    {
+        printf("Invalid --top or --min-count (use 1 or more).\n");
+        return 2;
+    }
+    if (by && strcmp(by, "lift") != 0 && strcmp(by, "count") != 0)
+    {
+        printf("Unknown ranking '%s' (lift or count).\n", by);
+        return 2;
+    }
+    int done = term_report(file ? file : DATA_FILE, &filter, k, min_count, by && strcmp(by, "count") == 0);
+    if (done == 0)
+        perror("File could not be opened");
+    return done > 0 ? 0 : 1;
 }
 
-// function check int of id and rating
-int inputInt(const char *message)
+/* locations [--branch NAME] [--top K] [--file PATH]: distinct and most frequent reviewer locations */
+int cmd_locations(int argc, char *argv[])
 {
-    char line[100];
-    int value;
+    const char *file = option_value(argc, argv, "--file");
+    const char *branch = option_value(argc, argv, "--branch");
+    const char *top = option_value(argc, argv, "--top");
+    int k = top ? atoi(top) : 20;
+    struct sketch *sk;
 
-    while (1)
+    if (k < 1 || k > HEAVY_TRACKED)
     {
-        printf("%s", message);
-        // if it not int it will be continue in the while loop
-        if (!fgets(line, sizeof(line), stdin))
-            continue;
-        // condition if it "int" it will return the value
-        if (sscanf(line, "%d", &value) == 1)
-            return value;
+        printf("Invalid --top '%s' (use 1 to %d).\n", top, HEAVY_TRACKED);
+        return 2;
+    }
+    sk = sketch_build(file ? file : DATA_FILE);
+    if (!sk)
+    {
+        perror("File could not be opened");
+        return 1;
+    }
 
-        printf("\nPlease enter numbers only!\n");
+    printf("Distinct reviewer locations (estimated)\n%-24s", "Branch");
+    for (int m = 0; m < 12; m++)
+        printf(" %5.3s", month_names[m]);
+    printf(" %6s\n", "Year");
+    for (int r = 0; r < sk->nbranch; r++)
+    {
+        if (!branch || strcmp(branch, sk->branch[r]) == 0)
+            sketch_print_row(sk, r, sk->branch[r]);
     }
+    if (!branch)
+        sketch_print_row(sk, -1, "All branches");
+
+    // Candidates are ranked by their Count-Min estimate, which can only overcount
+    qsort(sk->heavy, sk->nheavy, sizeof(sk->heavy[0]), heavy_cmp);
+    printf("\nTop %d reviewer locations (estimated reviews, all branches)\n", k < sk->nheavy ? k : sk->nheavy);
+    for (int i = 0; i < k && i < sk->nheavy; i++)
+        printf("%4d  %-40s %10u\n", i + 1, sk->heavy[i].name, sk->heavy[i].count);
+
+    free(sk);
+    return 0;
 }
 
-// function loadcsv
-void loadCSV()
+/* verify [--update] [--file PATH]: checks every data file against its block checksums */
+int cmd_verify(int argc, char *argv[])
 {
-    FILE *fp = fopen("disneylandreview.csv", "r");
-    char line[REVIEW_LEN];
+    const char *file = option_value(argc, argv, "--file");
+    int update = has_flag(argc, argv, "--update");
+    char paths[MAX_SHARDS][PATH_LEN];
 
-    if (!fp)
-        return;
+    // Writers extend and replace the checksums, so they wait until these are checked
+    int lock = dataset_lock(file ? file : DATA_FILE);
+    int npaths = data_files(file ? file : DATA_FILE, paths);
+    int ok = 1;
 
-    count = 0;
+    for (int p = 0; p < npaths; p++)
+    {
+        if (!verify_file(paths[p], update))
+            ok = 0;
+    }
+    dataset_unlock(lock);
+    return ok ? 0 : 1;
+}
+
+/* lint [--max-errors N] [--file PATH]: checks every row against the rules of the prompts.
+ * Exits with 1 when any row breaks one, so it can gate an import */
+int cmd_lint(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    const char *max = option_value(argc, argv, "--max-errors");
+    int max_errors = max ? atoi(max) : 100;
+
+    if (max_errors < 0 || max_errors > 1000000)
+    {
+        printf("Invalid --max-errors '%s' (use 0 to 1000000).\n", max);
+        return 2;
+    }
 
-    /* skip header */
-    fgets(line, sizeof(line), fp);
+    long long found = lint_data(file ? file : DATA_FILE, max_errors);
+    if (found < 0)
+    {
+        perror("File could not be checked");
+        return 2;
+    }
+    return found > 0;
+}
 
-    while (fgets(line, sizeof(line), fp) && count < MAX)
+/* export [filters] [--format csv|tsv|ndjson] [--out PATH] [--file PATH]: streams the matching
+ * reviews, in the --columns given, to stdout or PATH */
+int cmd_export(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    const char *format = option_value(argc, argv, "--format");
+    const char *out = option_value(argc, argv, "--out");
+    struct review_filter filter;
+    enum export_format fmt;
+
+    if (!parse_filter(argc, argv, &filter))
+        return 2;
+    if (!format || strcmp(format, "csv") == 0)
+        fmt = EXPORT_CSV;
+    else if (strcmp(format, "tsv") == 0)
+        fmt = EXPORT_TSV;
+    else if (strcmp(format, "ndjson") == 0 || strcmp(format, "json") == 0)
+        fmt = EXPORT_NDJSON;
+    else
     {
-        line[strcspn(line, "\r\n")] = '\0'; 
+        printf("Unknown format '%s' (csv, tsv or ndjson).\n", format);
+        return 2;
+    }
 
+    int fd = out ? open(out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : STDOUT_FILENO;
+    if (fd < 0)
+    {
+        perror(out);
+        return 1;
+    }
 
-        parseCSVLine(line, &reviews[count]);
-        count++;
+    double start = now_seconds();
+    long long bytes = 0;
+    long long rows = export_reviews(fd, file ? file : DATA_FILE, &filter, fmt, &bytes);
+    if (out && close(fd) != 0)
+        rows = -1;
+    if (rows < 0)
+    {
+        perror("Export failed");
+        return 1;
     }
 
-    fclose(fp);
+    if (out)
+    {
+        double seconds = now_seconds() - start;
+        fprintf(stderr, "Exported %lld review(s), %.1f MB in %.2f s (%.0f MB/s).\n", rows, bytes / 1e6, seconds,
+                seconds > 0 ? bytes / 1e6 / seconds : 0.0);
+    }
+    return 0;
 }
 
-int inputRating(const char *message)
+/* zonemap [--block N] [--file PATH]: builds or refreshes the zone map sidecars, one shard per task */
+int cmd_zonemap(int argc, char *argv[])
 {
-    char line[100];
-    int value;
-
-    while (1)
+    const char *file = option_value(argc, argv, "--file");
+    const char *block = option_value(argc, argv, "--block");
+    char paths[MAX_SHARDS][PATH_LEN];
+    struct zonemap_task tasks[MAX_SHARDS];
+    struct task_group group = {0};
+    int block_records = block ? atoi(block) : 0;
+    int npaths = data_files(file ? file : DATA_FILE, paths);
+    int status = 0;
+
+    if (block && block_records <= 0)
     {
-        printf("%s", message);
+        printf("Invalid --block '%s'.\n", block);
+        return 2;
+    }
 
-        if (!fgets(line, sizeof(line), stdin))
-            continue;
+    for (int p = 0; p < npaths; p++)
+    {
+        tasks[p].path = paths[p];
+        tasks[p].block_records = block_records;
+        pool_submit(&group, zonemap_task_run, &tasks[p]);
+    }
+    pool_wait(&group);
 
-        if (sscanf(line, "%d", &value) != 1)
-        {
-            printf("\nPlease enter numbers only!\n");
-            continue;
-        }
+    for (int p = 0; p < npaths; p++)
+    {
+        struct zone_map *zm = &tasks[p].zm;
+        long long records = 0;
 
-        if (value < 1 || value > 5)
+        if (!tasks[p].ok)
         {
-            printf("\nRating must be between 1 and 5!\n");
+            perror(paths[p]);
+            status = 1;
             continue;
         }
-
-        return value;
+        for (int b = 0; b < zm->nblocks; b++)
+            records += zm->blocks[b].records;
+        printf("%s: %lld records in %d blocks of up to %d\n", paths[p], records, zm->nblocks, zm->block_records);
+        zonemap_free(zm);
     }
+    return status;
 }
 
-void inputBranch(char branch[], int size)
+/* Writes the new version of one data file to tmp, with its Review_Text moved into (compress)
+ * or back out of the text store. The caller swaps it in */
+static int recode_text(const char *path, const char *tmp, int compress)
 {
-    int i;
-    char ch;
+    struct csv_reader rd;
+    struct csv_record rec;
+    struct append_batch ab;
+    struct text_writer tw;
+    struct text_store ts;
+    char ref[64];
+    int ok = 1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
 
-    while (1)
+    remove(tmp);
+    text_store_open(&ts, path);
+    if (!reader_open(&rd, fd, 0))
     {
-        printf("Enter the branch you have visited (e.g. Disneyland_Paris): ");
+        close(fd);
+        return 0;
+    }
+    if (!append_open(&ab, tmp, DURABLE_BATCH) || (compress && !text_writer_open(&tw, path)))
+    {
+        reader_close(&rd);
+        close(fd);
+        return 0;
+    }
+    reader_skip_header(&rd);
+    reader_read_ahead(&rd);
 
-        if (scanf(" %49[^\n]", branch) != 1)
+    while (ok && reader_next(&rd, &rec, 1))
+    {
+        const char *text = rec.field[COL_TEXT];
+
+        if (compress && !is_text_ref(text))
         {
-            printf("Branch input is invalid!\n");
-            while ((ch = getchar()) != '\n' && ch != EOF) { }
-            continue;
+            // Stored texts keep their reference; only inline ones are added
+            ok = text_writer_add(&tw, text, ref, sizeof(ref));
+            text = ref;
         }
-        getchar(); // clear newline
-
-        for (i = 0; branch[i] != '\0'; i++)
+        else if (!compress && is_text_ref(text))
         {
-            if (branch[i] >= '0' && branch[i] <= '9')
-            {
-                printf("Branch must not contain numbers!\n");
-                break;
-            }
+            text = text_store_get(&ts, text, NULL);
+            ok = text != NULL;
         }
 
-        if (branch[i] == '\0')
-            break;   
+        if (ok)
+        {
+            rec.field[COL_TEXT] = (char *)text;
+            rec.field_len[COL_TEXT] = strlen(text);
+            ok = append_csv_record(&ab, &rec);
+        }
     }
+    reader_close(&rd);
+    close(fd);
+    text_store_close(&ts);
+
+    // The text store must be durable before the CSV starts pointing into it
+    if (compress && !text_writer_close(&tw))
+        ok = 0;
+    if (!append_close(&ab) || !ok)
+    {
+        remove(tmp);
+        return 0;
+    }
+    return 1;
 }
 
-void inputLocation(char location[], int size)
+/* compress|decompress [--file PATH] */
+static int run_recode(int argc, char *argv[], int compress)
 {
-    int i;
-    char ch;
-
-    while (1)
+    const char *file = option_value(argc, argv, "--file");
+    char paths[MAX_SHARDS][PATH_LEN];
+    int lock = dataset_lock(file ? file : DATA_FILE);
+    if (lock < 0)
     {
-        printf("Enter your location: ");
+        perror("Lock failed");
+        return 1;
+    }
+    int npaths = data_files(file ? file : DATA_FILE, paths);
+    char tmp[MAX_SHARDS][PATH_LEN + 8];
+    struct stat before[MAX_SHARDS];
+    int written = 0, ok = 1;
 
-        if (scanf(" %49[^\n]", location) != 1)
+    while (ok && written < npaths)
+    {
+        int p = written;
+        snprintf(tmp[p], sizeof(tmp[p]), "%.*s.tmp", PATH_LEN - 1, paths[p]);
+        if (stat(paths[p], &before[p]) != 0 || !recode_text(paths[p], tmp[p], compress))
         {
-            printf("Location input is invalid!\n");
-            while ((ch = getchar()) != '\n' && ch != EOF) { }
-            continue;
+            perror(paths[p]);
+            ok = 0;
         }
-        getchar(); // clear newline
+        written += ok;
+    }
 
-        for (i = 0; location[i] != '\0'; i++)
+    // Every new version is complete: readers see either none of them or all of them
+    int hold = ok ? shards_hold(file ? file : DATA_FILE, 1) : -1;
+    for (int p = 0; p < written; p++)
+    {
+        if (ok)
         {
-            if (location[i] >= '0' && location[i] <= '9')
+            sidecars_invalidate(paths[p]);
+            if (rename(tmp[p], paths[p]) != 0)
             {
-                printf("Location must not contain numbers!\n");
-                break;
+                perror(paths[p]);
+                ok = 0;
             }
         }
+        else
+            remove(tmp[p]);
+    }
+    if (ok && written > 0 && !dir_sync(paths[0])) // the data files share one directory
+    {
+        perror(paths[0]);
+        ok = 0;
+    }
+    shards_release(hold);
 
-        if (location[i] == '\0')
-            break;  
+    for (int p = 0; ok && p < written; p++)
+    {
+        struct stat after, text;
+        char name[PATH_LEN + 8];
+
+        checksums_record(paths[p]);
+        text_store_name(paths[p], name, sizeof(name));
+        if (!compress)
+            remove(name); // no data file points into it any more
+        stat(paths[p], &after);
+        if (stat(name, &text) != 0)
+            text.st_size = 0;
+
+        printf("%s: %lld bytes -> %lld bytes CSV + %lld bytes text store\n", paths[p],
+               (long long)before[p].st_size, (long long)after.st_size, (long long)text.st_size);
     }
+    dataset_unlock(lock);
+    return ok ? 0 : 1;
+}
+
+int cmd_compress(int argc, char *argv[])
+{
+    return run_recode(argc, argv, 1);
 }
 
+int cmd_decompress(int argc, char *argv[])
+{
+    return run_recode(argc, argv, 0);
+}
 
-// save function
-void saveCSV()
+/* generate --rows N [--seed S] [--out PATH]: writes a synthetic dataset */
+int cmd_generate(int argc, char *argv[])
 {
-    FILE *fp = fopen("disneylandreview.csv", "w");
+    const char *rows_opt = option_value(argc, argv, "--rows");
+    const char *seed = option_value(argc, argv, "--seed");
+    const char *out = option_value(argc, argv, "--out");
+    long long nrows = rows_opt ? atoll(rows_opt) : 10000;
 
-    /* write header */
-    fprintf(fp,
-            "Review_ID,Rating,Review_Month,Reviewer_Location,Review_Text,Branch\n");
+    if (nrows <= 0)
+    {
+        printf("Invalid --rows '%s'.\n", rows_opt);
+        return 2;
+    }
 
-    /* write review in file csv */
-    for (int i = 0; i < count; i++)
+    int fd = out ? open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+    if (fd < 0)
     {
-        fprintf(fp, "%d,%d,%s,%s,\"%s\",%s\n",
-                reviews[i].id,
-                reviews[i].rating,
-                reviews[i].month,
-                reviews[i].location,
-                reviews[i].review,
-                reviews[i].branch);
+        perror(out);
+        return 1;
     }
 
-    fclose(fp);
+    int ok = generate_dataset(fd, nrows, seed ? strtoull(seed, NULL, 10) : 1);
+    if (out && close(fd) != 0)
+        ok = 0;
+    if (!ok)
+    {
+        perror("Dataset could not be written");
+        return 1;
+    }
+    return 0;
 }
 
-// find data by ID
-int findByID(int id)
+/* bench [--file PATH] [--min-time SECONDS]: JSON lines with rows/s and MB/s per operation */
+int cmd_bench(int argc, char *argv[])
 {
-    for (int i = 0; i < count; i++)
+    const char *file = option_value(argc, argv, "--file");
+    const char *min_time = option_value(argc, argv, "--min-time");
+    struct shard_manifest m;
+
+    if (!file)
+        file = DATA_FILE;
+    if (manifest_load(file, &m))
     {
-        if (reviews[i].id == id)
-            return i; // find → send index back
+        printf("Benchmarks need a single-file dataset; run unshard first.\n");
+        return 2;
     }
-    return -1; // can't find
+    return run_benchmarks(file, min_time ? atof(min_time) : BENCH_MIN_SECONDS);
 }
 
-// function editReview
-void editReview(int index)
+/* Splits the CSV into one file per branch; the caller holds the dataset lock */
+static int shard_data(const char *file)
 {
-    printf("\n--- Edit Review ---\n");
+    struct shard_manifest m;
+    struct append_batch batch[MAX_SHARDS];
+    int open_batch[MAX_SHARDS] = {0};
+    struct review_scan sc;
+    const struct csv_record *rec;
+    char path[PATH_LEN];
+    int max_id = 0;
+    int ok = 1;
+
+    if (manifest_load(file, &m))
+    {
+        printf("%s is already sharded.\n", file);
+        return 0;
+    }
+    if (!scan_open(&sc, file, NULL))
+    {
+        perror("File could not be opened");
+        return 1;
+    }
 
-    // use function inputint
-    reviews[index].rating = inputRating("Enter the Rating (1-5): ");
+    snprintf(path, sizeof(path), "%s" SHARD_DIR_SUFFIX, file);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+    {
+        perror("Shard directory could not be created");
+        scan_close(&sc);
+        return 1;
+    }
 
-    // printf("Enter the month you have visited (e.g. April): ");
-    inputMonth(reviews[index].month, sizeof(reviews[index].month));
+    while (ok && (rec = scan_next(&sc)) != NULL)
+    {
+        int id = record_id(rec);
+        int s = shard_for_branch(&m, rec->field[COL_BRANCH], 1);
 
-    inputLocation(reviews[index].location, sizeof(reviews[index].location));
+        if (s < 0)
+        {
+            printf("Too many branches (limit %d).\n", MAX_SHARDS);
+            ok = 0;
+            break;
+        }
+        if (!open_batch[s])
+        {
+            shard_path(file, m.file[s], path, sizeof(path));
+            remove(path); // leftovers of an interrupted run
+            if (!(open_batch[s] = append_open(&batch[s], path, DURABLE_BATCH)))
+            {
+                ok = 0;
+                break;
+            }
+        }
 
-    printf("Enter your review: ");
-    scanf(" %3999[^\n]", reviews[index].review);
+        ok = append_csv_record(&batch[s], rec);
+        if (id > max_id)
+            max_id = id;
+    }
+    scan_close(&sc);
 
-    inputBranch(reviews[index].branch, sizeof(reviews[index].branch));
+    for (int s = 0; s < MAX_SHARDS; s++)
+    {
+        if (open_batch[s] && !append_close(&batch[s]))
+            ok = 0;
+    }
 
+    // The manifest is written last: until it exists the CSV stays the live copy. Readers finish
+    // opening the CSV first; after the swap they find the shards
+    m.next_id = max_id + 1;
+    shard_path(file, MANIFEST_NAME, path, sizeof(path));
+    int hold = ok ? shards_hold(file, 1) : -1;
+    ok = ok && manifest_save(file, &m) && dir_sync(path);
+    if (!ok)
+    {
+        shards_release(hold);
+        perror("Sharding failed");
+        return 1;
+    }
 
-    // save file
-    saveCSV();
+    snprintf(path, sizeof(path), "%s.unsharded", file);
+    if (rename(file, path) != 0 || !dir_sync(file))
+    {
+        shards_release(hold);
+        perror("The old file could not be moved aside");
+        return 1;
+    }
+    shards_release(hold);
 
-    printf("\nReview updated successfully!\n");
+    for (int s = 0; s < m.nshards; s++)
+    {
+        char shard[PATH_LEN];
+        shard_path(file, m.file[s], shard, sizeof(shard));
+        checksums_record(shard);
+    }
+    printf("Split %s into %d shard(s); the old file was kept as %s.\n", file, m.nshards, path);
+    return 0;
 }
 
-// Funtion to show the whole process
-void editMenu()
+/* shard [--file PATH]: splits the CSV into one file per branch */
+int cmd_shard(int argc, char *argv[])
 {
-    count = 0;
-    loadCSV(); // use function loadcsv
+    const char *file = option_value(argc, argv, "--file");
+    int lock = dataset_lock(file ? file : DATA_FILE);
 
-    // Giving user to Enter review id
-    //  use function inputint
-    int id; 
-    int index; 
+    if (lock < 0)
+    {
+        perror("Lock failed");
+        return 1;
+    }
+    int status = shard_data(file ? file : DATA_FILE);
+    dataset_unlock(lock);
+    return status;
+}
 
-    while (1)
+/* Merges the shards back into a single CSV; the caller holds the dataset lock */
+static int unshard_data(const char *file)
+{
+    struct shard_manifest m;
+    struct append_batch ab;
+    struct review_scan sc;
+    const struct csv_record *rec;
+    char tmp[PATH_LEN];
+    char path[PATH_LEN];
+    int ok;
+
+    if (!manifest_load(file, &m))
     {
-        id = inputInt("Enter the Review ID: ");
-        index = findByID(id);
+        printf("%s is not sharded.\n", file);
+        return 0;
+    }
 
-        if (index == -1)
-        {
-            printf("\nReview ID not found! Please try again.\n");
-            continue;  
-        }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    remove(tmp);
+    if (!scan_open(&sc, file, NULL))
+    {
+        perror("Shards could not be opened");
+        return 1;
+    }
+    if (!append_open(&ab, tmp, DURABLE_BATCH))
+    {
+        perror("File could not be created");
+        scan_close(&sc);
+        return 1;
+    }
 
-        break;
+    // The merged scan returns rows in ID order, as they were before sharding
+    ok = 1;
+    while (ok && (rec = scan_next(&sc)) != NULL)
+        ok = append_csv_record(&ab, rec);
+    scan_close(&sc);
+
+    // Readers opening the shards finish first; after the swap they find the merged file
+    ok = append_close(&ab) && ok;
+    int hold = shards_hold(file, 1);
+    if (!ok || rename(tmp, file) != 0 || !dir_sync(file))
+    {
+        shards_release(hold);
+        perror("Merging failed");
+        remove(tmp);
+        return 1;
     }
 
-    /* show data to make sure!! */
-    printf("\nID: %d\n", reviews[index].id);
-    printf("Rating: %d\n", reviews[index].rating);
-    printf("Month: %s\n", reviews[index].month);
-    printf("Location: %s\n", reviews[index].location);
-    printf("Review: %s\n", reviews[index].review);
-    printf("Branch: %s\n", reviews[index].branch);
+    for (int s = 0; s < m.nshards; s++)
+    {
+        char side[PATH_LEN + 16];
 
-    char confirm;
-    printf("\nDo you want to edit this review? (y/n): ");
-    scanf(" %c", &confirm);
+        shard_path(file, m.file[s], path, sizeof(path));
+        remove(path);
+        sidecars_invalidate(path);
+        checksum_path(path, side, sizeof(side));
+        remove(side);
+    }
+    shard_path(file, MANIFEST_NAME, path, sizeof(path));
+    remove(path);
+    snprintf(path, sizeof(path), "%s" SHARD_DIR_SUFFIX, file);
+    rmdir(path);
+    shards_release(hold);
+
+    checksums_record(file);
+    printf("Merged %d shard(s) into %s.\n", m.nshards, file);
+    return 0;
+}
 
-    // clear buffer
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF)
-        ;
+/* unshard [--file PATH]: merges the shards back into a single CSV */
+int cmd_unshard(int argc, char *argv[])
+{
+    const char *file = option_value(argc, argv, "--file");
+    int lock = dataset_lock(file ? file : DATA_FILE);
 
-    if (confirm == 'y' || confirm == 'Y')
+    if (lock < 0)
     {
-        editReview(index);
+        perror("Lock failed");
+        return 1;
     }
-    return;
+    int status = unshard_data(file ? file : DATA_FILE);
+    dataset_unlock(lock);
+    return status;
+}
+
+struct command
+{
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+    const char *usage;
+};
+
+const struct command commands[] = {
+    {"watch", cmd_watch, "watch [--follow] [--file PATH]   follow appended reviews"},
+    {"append", cmd_append, "append [--durability none|batch|record] [--file PATH] < rows.csv"},
+    {"view", cmd_view, "view [filters] [--sort rating|branch | --top K | --bottom K [--by branch|location|month]\n"
+                          "        | --sample N [--seed S] | --rows A..B | --page P [--page-size S]] [--file PATH]"},
+    {"delete", cmd_delete, "delete [filters] [--file PATH]   remove every matching review"},
+    {"update", cmd_update, "update --id N [--rating R] [--month M] [--location L] [--text T] [--branch B] [--file PATH]"},
+    {"report", cmd_report, "report [filters] [--file PATH]   reviews and ratings per branch"},
+    {"trends", cmd_trends, "trends [--branch NAME] [--months FROM..TO] [--chart] [--file PATH]   monthly averages"},
+    {"locations", cmd_locations, "locations [--branch NAME] [--top K] [--file PATH]   distinct and top reviewer locations"},
+    {"terms", cmd_terms, "terms [filters] [--top K] [--min-count N] [--by lift|count] [--file PATH]   standout words per branch and rating"},
+    {"dedupe", cmd_dedupe, "dedupe [filters] [--threshold T] [--file PATH]   near-duplicate review texts"},
+    {"verify", cmd_verify, "verify [--update] [--file PATH]   check data files against their block checksums"},
+    {"lint", cmd_lint, "lint [--max-errors N] [--file PATH]   check every row; exits 1 when any is invalid"},
+    {"export", cmd_export, "export [filters] [--format csv|tsv|ndjson] [--out PATH] [--file PATH]   stream reviews for other tools"},
+    {"zonemap", cmd_zonemap, "zonemap [--block N] [--file PATH]   build block summaries used to skip data"},
+    {"generate", cmd_generate, "generate --rows N [--seed S] [--out PATH]   synthetic dataset"},
+    {"bench", cmd_bench, "bench [--file PATH] [--min-time SECONDS]   time each operation"},
+    {"compress", cmd_compress, "compress [--file PATH]     move review text into a compressed store"},
+    {"decompress", cmd_decompress, "decompress [--file PATH]   put review text back into the CSV"},
+    {"shard", cmd_shard, "shard [--file PATH]     split the data into one file per branch"},
+    {"unshard", cmd_unshard, "unshard [--file PATH]   merge branch shards back into one file"},
+};
+
+/* Runs a non-interactive command given on the command line */
+int run_command(int argc, char *argv[])
+{
+    int ncommands = sizeof(commands) / sizeof(commands[0]);
+
+    for (int i = 0; i < ncommands; i++)
+    {
+        if (strcmp(argv[0], commands[i].name) == 0)
+        {
+            profile_begin(commands[i].name);
+            int status = commands[i].run(argc - 1, argv + 1);
+            profile_report();
+            return status;
+        }
+    }
+
+    printf("Unknown command '%s'. Available commands:\n", argv[0]);
+    for (int i = 0; i < ncommands; i++)
+        printf("  %s\n", commands[i].usage);
+    printf("Filters: --branch NAME --id A[..B] --rating A[..B] --month NAME[,NAME] --columns NAME[,NAME]\n");
+    printf("--stats (or REVIEW_STATS=1) prints per-phase timings of every operation\n");
+    printf("--threads N (or REVIEW_THREADS=N) sets the worker threads, --pin-threads pins them to CPUs\n");
+    return 2;
 }
 
 //***************************** MENU *****************************
 
-int main(void)
+int main(int argc, char *argv[])
 {
     int choice;
+    const char *env = getenv("REVIEW_STATS");
+    const char *threads = getenv("REVIEW_THREADS");
+    int pin = 0;
+
+    // Global options may appear anywhere and are removed before the command is looked up
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--stats") == 0)
+            env = "1";
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = argv[++i];
+        else if (strcmp(argv[i], "--pin-threads") == 0)
+            pin = 1;
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+    if (env && strcmp(env, "0") != 0)
+        profile_enable();
+    pool_configure(threads ? atoi(threads) : 0, pin);
+
+    // Any arguments select a command instead of the interactive menu
+    if (argc > 1)
+    {
+        return run_command(argc - 1, argv + 1);
+    }
+
     while (1)
     {
         printf("****** Welcome to our Disneyland Reviewing System! ******\n\n");
@@ -1214,16 +6540,13 @@ int main(void)
         {
         case 1:
         {
-            FILE *fp = fopen("disneylandreview.csv", "r");
-            if (!fp)
+            profile_begin("view");
+            if (!view_data(DATA_FILE, NULL)) // Call View function
             {
                 perror("File could not be opened");
                 return 1;
             }
 
-            view_data(fp); // Call View function
-            fclose(fp);
-
             while (!sort_menu())
             {
                 printf("Try again.\n");
@@ -1231,18 +6554,25 @@ int main(void)
 
             column_width();
             print_table();
+            profile_report();
             break;
         }
         case 2:
+            profile_begin("add");
             add_review_append_only("disneylandreview.csv"); // Call Add function
+            profile_report();
             break;
 
         case 3:
+            profile_begin("delete");
             delete_review("disneylandreview.csv"); // Call Delete function
+            profile_report();
             break;
 
         case 4:
+            profile_begin("edit");
             editMenu(); // Call Edit function
+            profile_report();
             break;
 
         case 5:
@@ -0,0 +1,2852 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <pthread.h>
+
+#include "review_store_internal.h"
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+//***************************** Instrumentation *****************************
+
+struct profile profile;
+__thread int prof_in_task; // running inside a pool task: its time is charged to the caller
+
+/* Charges the elapsed time to the running phase and starts another. Returns the previous phase.
+ * Pool tasks leave the clock alone: their time belongs to the phase that waits for them */
+enum prof_phase prof_enter(enum prof_phase phase)
+{
+    if (!profile.enabled || prof_in_task)
+        return PHASE_OTHER; // the caller's switch back is a no-op as well
+
+    enum prof_phase prev = profile.phase;
+    double now = now_seconds();
+    profile.seconds[prev] += now - profile.mark;
+    profile.mark = now;
+    profile.phase = phase;
+    return prev;
+}
+
+//***************************** Record Scanner *****************************
+
+/* Chunks of a file loaded by a helper thread ahead of the parser, so waiting for the disk
+ * overlaps with parsing. Chunks head..tail-1 are loaded; the thread fills slot tail % depth */
+struct read_ahead
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;   // a chunk was loaded
+    pthread_cond_t wanted;   // a slot was freed, the parser moved elsewhere, or stop was set
+    int fd;
+    long long limit;         // Bytes of the file that are read
+    char *slot[READ_AHEAD_DEPTH];
+    ssize_t got[READ_AHEAD_DEPTH]; // Bytes loaded in each slot; <= 0 ends the file early
+    long long head, tail;
+    size_t used;             // Bytes of chunk head already handed to the parser
+    long long at;            // File offset of the next byte the parser gets
+    long long load_at;       // File offset of chunk tail
+    unsigned seek;           // Bumped when the parser jumps, so loads in flight are dropped
+    int stop;
+};
+
+/* Finds the end of the record starting at buf[0]. Returns its raw length or 0 if no unquoted newline was found */
+size_t find_record_end(const char *buf, size_t len)
+{
+    size_t from = 0;
+    int quotes = 0;
+
+    while (from < len)
+    {
+        const char *nl = memchr(buf + from, '\n', len - from);
+        size_t stop = nl ? (size_t)(nl - buf) : len;
+
+        // Count quotes up to the newline; an odd total means it is inside a quoted field
+        const char *q = buf + from;
+        while ((q = memchr(q, '"', stop - (q - buf))) != NULL)
+        {
+            quotes++;
+            q++;
+        }
+
+        if (!nl)
+            return 0;
+        if (quotes % 2 == 0)
+            return stop + 1;
+        from = stop + 1;
+    }
+    return 0;
+}
+
+/* Splits raw record bytes into unescaped fields stored in scratch. Fields not in want
+ * are stepped over without being copied or unescaped and read as empty strings */
+static void split_record(const char *raw, size_t len, struct csv_record *rec, char *scratch, unsigned want)
+{
+    size_t i = 0;
+    char *out = scratch;
+
+    // Drop the line break (\n or \r\n) from the parsed content
+    while (len > 0 && (raw[len - 1] == '\n' || raw[len - 1] == '\r'))
+        len--;
+
+    rec->nfields = 0;
+    while (1)
+    {
+        char *start = out;
+
+        if (rec->nfields >= COLS || !(want & (1u << rec->nfields)))
+        {
+            // Skipped field: an escaped quote is just two quotes in a row, so quotes can be jumped between
+            if (i < len && raw[i] == '"')
+            {
+                i++;
+                while (i < len)
+                {
+                    const char *q = memchr(raw + i, '"', len - i);
+                    i = q ? (size_t)(q - raw) + 1 : len;
+                    if (i < len && raw[i] == '"')
+                        i++;
+                    else
+                        break;
+                }
+            }
+            const char *comma = memchr(raw + i, ',', len - i);
+            i = comma ? (size_t)(comma - raw) : len;
+        }
+        else if (i < len && raw[i] == '"')
+        {
+            // Quoted field: "" stands for one quote
+            i++;
+            while (i < len)
+            {
+                if (raw[i] == '"' && i + 1 < len && raw[i + 1] == '"')
+                {
+                    *out++ = '"';
+                    i += 2;
+                }
+                else if (raw[i] == '"')
+                {
+                    i++;
+                    break;
+                }
+                else
+                {
+                    *out++ = raw[i++];
+                }
+            }
+            // Anything between the closing quote and the comma is kept as-is
+            while (i < len && raw[i] != ',')
+                *out++ = raw[i++];
+        }
+        else
+        {
+            const char *comma = memchr(raw + i, ',', len - i);
+            size_t stop = comma ? (size_t)(comma - raw) : len;
+            memcpy(out, raw + i, stop - i);
+            out += stop - i;
+            i = stop;
+        }
+
+        if (rec->nfields < COLS)
+        {
+            rec->field[rec->nfields] = start;
+            rec->field_len[rec->nfields] = out - start;
+        }
+        *out++ = '\0';
+        rec->nfields++;
+
+        if (i >= len)
+            break;
+        i++; // skip the comma
+    }
+
+    // Missing trailing fields read as empty strings
+    for (int c = rec->nfields; c < COLS; c++)
+    {
+        rec->field[c] = out;
+        rec->field_len[c] = 0;
+    }
+    *out = '\0';
+}
+
+static void *read_ahead_worker(void *arg)
+{
+    struct read_ahead *ra = arg;
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->stop)
+    {
+        if (ra->tail - ra->head == READ_AHEAD_DEPTH || ra->load_at >= ra->limit)
+        {
+            pthread_cond_wait(&ra->wanted, &ra->lock);
+            continue;
+        }
+
+        int i = (int)(ra->tail % READ_AHEAD_DEPTH);
+        long long at = ra->load_at;
+        size_t want = ra->limit - at < READ_CHUNK ? (size_t)(ra->limit - at) : READ_CHUNK;
+        unsigned seek = ra->seek;
+
+        pthread_mutex_unlock(&ra->lock);
+        ssize_t n = pread(ra->fd, ra->slot[i], want, at);
+        pthread_mutex_lock(&ra->lock);
+
+        if (seek != ra->seek)
+            continue; // the parser went elsewhere while this was loading
+        ra->got[i] = n;
+        ra->load_at = n > 0 ? at + n : ra->limit;
+        ra->tail++;
+        pthread_cond_signal(&ra->loaded);
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+/* Copies up to size bytes at file offset at from the read-ahead chunks, redirecting the
+ * thread first when the parser jumped. Returns the bytes copied like pread() */
+static ssize_t read_ahead_take(struct read_ahead *ra, char *dst, size_t size, long long at)
+{
+    pthread_mutex_lock(&ra->lock);
+    if (at != ra->at)
+    {
+        ra->head = ra->tail = 0;
+        ra->used = 0;
+        ra->at = ra->load_at = at;
+        ra->seek++;
+        pthread_cond_signal(&ra->wanted);
+    }
+    while (ra->head == ra->tail)
+        pthread_cond_wait(&ra->loaded, &ra->lock);
+
+    // The thread never writes slot head while it holds unread bytes, so it is copied unlocked
+    int i = (int)(ra->head % READ_AHEAD_DEPTH);
+    ssize_t n = ra->got[i];
+    size_t used = ra->used;
+    pthread_mutex_unlock(&ra->lock);
+
+    if (n <= 0)
+        return n;
+    if ((size_t)n - used < size)
+        size = (size_t)n - used;
+    memcpy(dst, ra->slot[i] + used, size);
+
+    pthread_mutex_lock(&ra->lock);
+    ra->at += size;
+    ra->used += size;
+    if (ra->used == (size_t)n)
+    {
+        ra->head++;
+        ra->used = 0;
+        pthread_cond_signal(&ra->wanted);
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return size;
+}
+
+static void read_ahead_free(struct read_ahead *ra)
+{
+    pthread_mutex_destroy(&ra->lock);
+    pthread_cond_destroy(&ra->loaded);
+    pthread_cond_destroy(&ra->wanted);
+    for (int i = 0; i < READ_AHEAD_DEPTH; i++)
+        free(ra->slot[i]);
+    free(ra);
+}
+
+static void read_ahead_stop(struct read_ahead *ra)
+{
+    pthread_mutex_lock(&ra->lock);
+    ra->stop = 1;
+    pthread_cond_signal(&ra->wanted);
+    pthread_mutex_unlock(&ra->lock);
+    pthread_join(ra->thread, NULL);
+    read_ahead_free(ra);
+}
+
+/* Has a helper thread load the chunks after the reader's position while earlier ones are
+ * parsed. For sequential scans of files worth it; without memory or a thread the reader
+ * keeps reading on demand */
+void reader_read_ahead(struct csv_reader *rd)
+{
+    long long at = rd->pos + (long long)rd->len;
+    struct read_ahead *ra;
+
+    if (rd->stream || rd->ahead || rd->limit - at <= 2LL * READ_CHUNK)
+        return;
+    posix_fadvise(rd->fd, at, 0, POSIX_FADV_SEQUENTIAL); // larger kernel read-ahead as well
+
+    ra = calloc(1, sizeof(*ra));
+    if (!ra)
+        return;
+    ra->fd = rd->fd;
+    ra->limit = rd->limit;
+    ra->at = ra->load_at = at;
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->loaded, NULL);
+    pthread_cond_init(&ra->wanted, NULL);
+
+    int ok = 1;
+    for (int i = 0; i < READ_AHEAD_DEPTH; i++)
+        ok = ok && (ra->slot[i] = malloc(READ_CHUNK)) != NULL;
+    if (!ok || pthread_create(&ra->thread, NULL, read_ahead_worker, ra) != 0)
+    {
+        read_ahead_free(ra);
+        return;
+    }
+    rd->ahead = ra;
+}
+
+/* Prepares a reader positioned at byte offset start */
+int reader_open(struct csv_reader *rd, int fd, long long start)
+{
+    struct stat st;
+
+    memset(rd, 0, sizeof(*rd));
+    rd->fd = fd;
+    rd->pos = start;
+    rd->stream = lseek(fd, 0, SEEK_CUR) < 0;
+    rd->limit = rd->stream || fstat(fd, &st) != 0 ? -1 : (long long)st.st_size;
+    rd->cap = READ_CHUNK;
+    rd->buf = malloc(rd->cap);
+    rd->scratch_cap = SCRATCH_INIT;
+    rd->scratch = malloc(rd->scratch_cap);
+    rd->want = ALL_COLUMNS;
+    if (!rd->buf || !rd->scratch)
+    {
+        free(rd->buf);
+        free(rd->scratch);
+        return 0;
+    }
+    return 1;
+}
+
+void reader_close(struct csv_reader *rd)
+{
+    if (rd->ahead)
+        read_ahead_stop(rd->ahead);
+    rd->ahead = NULL;
+    free(rd->buf);
+    free(rd->scratch);
+    rd->buf = rd->scratch = NULL;
+}
+
+/* Offset just after the last record returned */
+long long reader_offset(const struct csv_reader *rd)
+{
+    return rd->pos + (long long)rd->next;
+}
+
+/* Reads more bytes, keeping the unparsed tail. Returns 0 when nothing more could be read */
+static int reader_fill(struct csv_reader *rd)
+{
+    if (rd->eof)
+        return 0;
+
+    // Slide the unparsed tail to the front of the buffer
+    if (rd->next > 0)
+    {
+        memmove(rd->buf, rd->buf + rd->next, rd->len - rd->next);
+        rd->pos += rd->next;
+        rd->len -= rd->next;
+        rd->next = 0;
+    }
+
+    // A record longer than the buffer: grow it
+    if (rd->len == rd->cap)
+    {
+        char *tmp = realloc(rd->buf, rd->cap * 2);
+        if (!tmp)
+            return 0;
+        rd->buf = tmp;
+        rd->cap *= 2;
+    }
+
+    ssize_t n;
+    size_t want = rd->cap - rd->len;
+    long long at = rd->pos + (long long)rd->len;
+    if (rd->limit >= 0 && (long long)want > rd->limit - at)
+        want = rd->limit > at ? (size_t)(rd->limit - at) : 0;
+    if (want == 0)
+    {
+        rd->eof = 1;
+        return 0;
+    }
+
+    enum prof_phase prev = prof_enter(PHASE_READ);
+    if (rd->stream)
+        n = read(rd->fd, rd->buf + rd->len, want);
+    else if (rd->ahead)
+        n = read_ahead_take(rd->ahead, rd->buf + rd->len, want, at);
+    else
+        n = pread(rd->fd, rd->buf + rd->len, want, at);
+    prof_enter(prev);
+    if (n <= 0)
+    {
+        rd->eof = 1;
+        return 0;
+    }
+    rd->len += n;
+    PROF_COUNT(bytes_read, n);
+    return 1;
+}
+
+/* 1 when the file grew past the snapshot the reader was opened on */
+static int reader_outgrown(const struct csv_reader *rd)
+{
+    struct stat st;
+
+    return rd->limit >= 0 && fstat(rd->fd, &st) == 0 && (long long)st.st_size > rd->limit;
+}
+
+/* Returns the next non-empty record. An unterminated last record is only returned when accept_partial is set,
+ * and not when the file has grown since: then it is the first part of an append still being written */
+int reader_next(struct csv_reader *rd, struct csv_record *rec, int accept_partial)
+{
+    while (1)
+    {
+        size_t avail = rd->len - rd->next;
+        size_t rlen = find_record_end(rd->buf + rd->next, avail);
+
+        if (rlen == 0)
+        {
+            if (reader_fill(rd))
+                continue;
+            if (!accept_partial || avail == 0 || reader_outgrown(rd))
+                return 0;
+            rlen = avail; // last record without a line break
+        }
+
+        const char *raw = rd->buf + rd->next;
+        rec->offset = reader_offset(rd);
+        rec->length = rlen;
+        rd->next += rlen;
+
+        // Skip blank lines
+        if (raw[0] == '\n' || (raw[0] == '\r' && rlen <= 2))
+            continue;
+
+        if (rlen + COLS + 1 > rd->scratch_cap)
+        {
+            char *tmp = realloc(rd->scratch, rlen + COLS + 1);
+            if (!tmp)
+                return 0;
+            rd->scratch = tmp;
+            rd->scratch_cap = rlen + COLS + 1;
+        }
+
+        split_record(raw, rlen, rec, rd->scratch, rd->want);
+        PROF_COUNT(rows_parsed, 1);
+        PROF_COUNT(bytes_parsed, rlen);
+        return 1;
+    }
+}
+
+/* Continues reading at another record boundary */
+void reader_seek(struct csv_reader *rd, long long offset)
+{
+    rd->pos = offset;
+    rd->len = 0;
+    rd->next = 0;
+    rd->eof = 0;
+}
+
+/* Skips the header line when the reader is at the start of the file */
+void reader_skip_header(struct csv_reader *rd)
+{
+    struct csv_record rec;
+
+    if (reader_offset(rd) == 0)
+        reader_next(rd, &rec, 1);
+}
+
+/* Remembers the file identity and the bytes before offset */
+void mark_file(struct file_mark *fm, int fd, const struct stat *st, long long offset)
+{
+    long long from = offset > FINGERPRINT_LEN ? offset - FINGERPRINT_LEN : 0;
+    ssize_t n = pread(fd, fm->tail, offset - from, from);
+
+    fm->offset = offset;
+    fm->dev = st->st_dev;
+    fm->ino = st->st_ino;
+    fm->tail_len = n > 0 ? (int)n : 0;
+}
+
+/* 1 when the file still starts with exactly what was processed (only appended to since) */
+int mark_is_prefix(const struct file_mark *fm, int fd, const struct stat *st)
+{
+    unsigned char now[FINGERPRINT_LEN];
+
+    if (st->st_dev != fm->dev || st->st_ino != fm->ino)
+        return 0; // file was replaced
+    if (st->st_size < fm->offset)
+        return 0; // file was truncated
+
+    long long from = fm->offset - fm->tail_len;
+    if (pread(fd, now, fm->tail_len, from) != fm->tail_len)
+        return 0;
+    return memcmp(now, fm->tail, fm->tail_len) == 0;
+}
+
+/* Names a temporary file next to path that no other process or thread uses: readers refresh
+ * sidecars without holding any lock, so two of them may be saving the same one */
+void temp_path(const char *path, char *out, size_t size)
+{
+    static unsigned seq;
+
+    snprintf(out, size, "%.*s.%ld-%u.tmp", PATH_LEN - 1, path, (long)getpid(),
+             __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED));
+}
+
+//***************************** Checksums *****************************
+
+static uint32_t crc32c_table[8][256];
+static uint32_t (*crc32c_update)(uint32_t crc, const unsigned char *p, size_t n);
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/* Portable version: eight table lookups per 8 bytes (slicing-by-8) */
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t n)
+{
+    while (n >= 8)
+    {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+              crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^ crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        n -= 8;
+    }
+    while (n--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/* SSE4.2 crc32 instruction, 8 bytes at a time; chosen at run time so the build needs no -msse4.2 */
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t n)
+{
+    uint64_t c = crc;
+
+    while (n >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __builtin_ia32_crc32di(c, v);
+        p += 8;
+        n -= 8;
+    }
+    while (n--)
+        c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+    return (uint32_t)c;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t n)
+{
+    while (n >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+        p += 8;
+        n -= 8;
+    }
+    while (n--)
+        crc = __crc32cb(crc, *p++);
+    return crc;
+}
+#endif
+
+static void crc32c_setup(void)
+{
+    for (unsigned i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+        crc32c_table[0][i] = c;
+    }
+    for (unsigned i = 0; i < 256; i++)
+    {
+        for (int t = 1; t < 8; t++)
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xff];
+    }
+
+    crc32c_update = crc32c_sw;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("sse4.2"))
+        crc32c_update = crc32c_hw;
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    crc32c_update = crc32c_hw;
+#endif
+}
+
+/* Continues a CRC32C over n more bytes: crc32c(crc32c(0, a), b) is the CRC of a followed by b */
+static uint32_t crc32c(uint32_t crc, const void *data, size_t n)
+{
+    pthread_once(&crc32c_once, crc32c_setup);
+    return ~crc32c_update(~crc, data, n);
+}
+
+void checksum_path(const char *path, char *out, size_t size)
+{
+    snprintf(out, size, "%.*s.crc", PATH_LEN - 1, path);
+}
+
+/* Reads the sidecar header and checksums of path; *crc is malloc'ed. Returns 0 if there is none */
+int checksums_load(const char *path, struct crc_header *h, uint32_t **crc)
+{
+    char side[PATH_LEN + 16];
+    int ok = 0;
+
+    checksum_path(path, side, sizeof(side));
+    FILE *fp = fopen(side, "rb");
+    *crc = NULL;
+    if (!fp)
+        return 0;
+    if (fread(h, sizeof(*h), 1, fp) == 1 && memcmp(h->magic, CRC_MAGIC, 8) == 0 && h->block_size > 0 &&
+        h->length >= 0 && (long long)h->nblocks == (h->length + h->block_size - 1) / h->block_size)
+    {
+        *crc = malloc(sizeof(uint32_t) * (h->nblocks ? h->nblocks : 1));
+        ok = *crc && fread(*crc, sizeof(uint32_t), h->nblocks, fp) == h->nblocks;
+    }
+    fclose(fp);
+    if (!ok)
+    {
+        free(*crc);
+        *crc = NULL;
+    }
+    return ok;
+}
+
+/* Checksums blocks first..last-1 of fd, stopping at byte length. Returns 0 on a read error */
+int crc_blocks(int fd, uint32_t block_size, long long length, long long first, long long last, uint32_t *crc)
+{
+    size_t cap = READ_CHUNK >= block_size ? READ_CHUNK - READ_CHUNK % block_size : block_size;
+    unsigned char *buf = malloc(cap);
+    int ok = buf != NULL;
+
+    for (long long b = first; ok && b < last;)
+    {
+        long long at = b * block_size;
+        size_t want = cap;
+        if ((long long)want > length - at)
+            want = (size_t)(length - at);
+
+        ssize_t got = pread(fd, buf, want, at);
+        if (got < 0)
+        {
+            ok = 0;
+            break;
+        }
+        PROF_COUNT(bytes_read, got);
+        // A short read (a truncated file) checksums what is there, which then fails to match
+        for (size_t off = 0; off < want && b < last; off += block_size, b++)
+        {
+            size_t n = want - off < block_size ? want - off : block_size;
+            size_t have = (ssize_t)off < got ? (size_t)got - off : 0;
+            crc[b - first] = crc32c(0, buf + off, have < n ? have : n);
+        }
+    }
+    free(buf);
+    return ok;
+}
+
+/* Records checksums for the current contents of path, replacing any old sidecar */
+int checksums_record(const char *path)
+{
+    struct crc_header h;
+    struct stat st;
+    char side[PATH_LEN + 16];
+    char tmp[PATH_LEN + 48];
+    uint32_t *crc;
+    int ok;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CRC_MAGIC, 8);
+    h.block_size = CRC_BLOCK_SIZE;
+    h.length = st.st_size;
+    h.nblocks = (uint32_t)((st.st_size + CRC_BLOCK_SIZE - 1) / CRC_BLOCK_SIZE);
+    crc = malloc(sizeof(uint32_t) * (h.nblocks ? h.nblocks : 1));
+    ok = crc && crc_blocks(fd, h.block_size, h.length, 0, h.nblocks, crc);
+    close(fd);
+
+    checksum_path(path, side, sizeof(side));
+    temp_path(side, tmp, sizeof(tmp));
+    FILE *fp = ok ? fopen(tmp, "wb") : NULL;
+    if (fp)
+    {
+        ok = fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(crc, sizeof(uint32_t), h.nblocks, fp) == h.nblocks;
+        if (fclose(fp) != 0 || !ok)
+            remove(tmp);
+        else
+            ok = rename(tmp, side) == 0;
+    }
+    free(crc);
+    return ok && fp;
+}
+
+/* Extends the checksums of path by n bytes just appended at offset start. The sidecar is only
+ * touched when it covers exactly the bytes before start; otherwise verify reports the gap */
+static void checksums_extend(const char *path, long long start, const char *data, size_t n)
+{
+    struct crc_header h;
+    char side[PATH_LEN + 16];
+
+    checksum_path(path, side, sizeof(side));
+    int fd = open(side, O_RDWR);
+    if (fd < 0)
+        return;
+    if (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || memcmp(h.magic, CRC_MAGIC, 8) != 0 ||
+        h.block_size == 0 || h.length != start)
+    {
+        close(fd);
+        return;
+    }
+
+    // The last block may be partial: its CRC continues over the new bytes
+    long long b = h.length / h.block_size;
+    size_t used = (size_t)(h.length % h.block_size);
+    uint32_t crc = 0;
+    int ok = 1;
+
+    if (used > 0)
+        ok = pread(fd, &crc, sizeof(crc), sizeof(h) + b * sizeof(uint32_t)) == (ssize_t)sizeof(crc);
+    while (ok && n > 0)
+    {
+        size_t take = h.block_size - used < n ? h.block_size - used : n;
+        crc = crc32c(crc, data, take);
+        ok = pwrite(fd, &crc, sizeof(crc), sizeof(h) + b * sizeof(uint32_t)) == (ssize_t)sizeof(crc);
+        data += take;
+        n -= take;
+        h.length += take;
+        used += take;
+        if (used == h.block_size)
+        {
+            b++;
+            used = 0;
+            crc = 0;
+        }
+    }
+    // The header is written last, so until then the sidecar still describes the old length
+    h.nblocks = (uint32_t)((h.length + h.block_size - 1) / h.block_size);
+    if (ok)
+        ok = pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+    close(fd);
+}
+
+//***************************** Storage *****************************
+
+/* Makes room for at least n more bytes; marks the buffer failed when there is none */
+static int out_reserve(struct out_buffer *ob, size_t n)
+{
+    if (ob->len + n <= ob->cap)
+        return 1;
+
+    size_t cap = ob->cap ? ob->cap : 4096;
+    while (cap < ob->len + n)
+        cap *= 2;
+
+    char *tmp = realloc(ob->data, cap);
+    if (!tmp)
+    {
+        ob->failed = 1;
+        return 0;
+    }
+    ob->data = tmp;
+    ob->cap = cap;
+    return 1;
+}
+
+void out_put(struct out_buffer *ob, const char *bytes, size_t n)
+{
+    if (!out_reserve(ob, n))
+        return;
+    memcpy(ob->data + ob->len, bytes, n);
+    ob->len += n;
+}
+
+void out_putc(struct out_buffer *ob, char ch)
+{
+    if (!out_reserve(ob, 1))
+        return;
+    ob->data[ob->len++] = ch;
+}
+
+void out_free(struct out_buffer *ob)
+{
+    free(ob->data);
+    ob->data = NULL;
+    ob->len = ob->cap = 0;
+    ob->failed = 0;
+}
+
+/* Writes the whole buffer, retrying short writes. Returns 1 on success */
+int write_all(int fd, const char *bytes, size_t n)
+{
+    while (n > 0)
+    {
+        ssize_t w = write(fd, bytes, n);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        bytes += w;
+        n -= w;
+    }
+    return 1;
+}
+
+/* Copies len bytes of in, from offset from on, to the current position of out. The kernel moves
+ * them itself (or shares the blocks, where the file system can) with copy_file_range; when the
+ * files don't allow that they go through a buffer in large blocks. Returns 1 on success */
+static int copy_span(int in, long long from, long long len, int out)
+{
+    enum prof_phase prev = prof_enter(PHASE_WRITE);
+    off_t at = from;
+
+#ifdef __linux__
+    while (len > 0)
+    {
+        ssize_t n = copy_file_range(in, &at, out, NULL, len, 0);
+        if (n > 0)
+        {
+            len -= n;
+            PROF_COUNT(bytes_written, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0 || (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP))
+        {
+            prof_enter(prev);
+            return 0; // in ended early, or out can't be written
+        }
+        break; // not between these files: copy the rest by hand
+    }
+#endif
+
+    char *buf = len > 0 ? malloc(READ_CHUNK) : NULL;
+    int ok = len == 0 || buf != NULL;
+    while (ok && len > 0)
+    {
+        ssize_t n = pread(in, buf, len < READ_CHUNK ? (size_t)len : READ_CHUNK, at);
+        if (n < 0 && errno == EINTR)
+            continue;
+        ok = n > 0 && write_all(out, buf, n);
+        PROF_COUNT(bytes_read, n > 0 ? n : 0);
+        PROF_COUNT(bytes_written, n > 0 ? n : 0);
+        at += n;
+        len -= n;
+    }
+    free(buf);
+    prof_enter(prev);
+    return ok;
+}
+
+/* Flushes the data of a finished replacement to disk, so a rename never swaps in a file whose
+ * bytes a crash could still lose. Returns 1 on success */
+int file_sync(int fd)
+{
+    enum prof_phase prev = prof_enter(PHASE_SYNC);
+    int ok = fdatasync(fd) == 0;
+    PROF_COUNT(syncs, 1);
+    prof_enter(prev);
+    return ok;
+}
+
+/* Makes the renames done in the directory holding path survive a crash. Returns 1 on success */
+int dir_sync(const char *path)
+{
+    char dir[PATH_LEN];
+    const char *slash = strrchr(path, '/');
+
+    if (!slash)
+        snprintf(dir, sizeof(dir), ".");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    int ok = file_sync(fd) || errno == EINVAL; // some file systems can't sync a directory
+    close(fd);
+    return ok;
+}
+
+/*Writes one text field into the CSV. It puts the text in quotes. It doubles any " inside the text. */
+void write_csv_field(struct out_buffer *ob, const char *text)
+{
+    size_t len = strlen(text);
+    const char *quote;
+
+    out_putc(ob, '"'); /* CSV escaping: always wrap fields in quotes */
+
+    /* copy whole runs between quotes instead of single characters */
+    while ((quote = memchr(text, '"', len)) != NULL)
+    {
+        size_t run = quote - text + 1;
+        out_put(ob, text, run);
+        out_putc(ob, '"'); /* escape quotes inside the field by doubling them */
+        text += run;
+        len -= run;
+    }
+    out_put(ob, text, len);
+
+    out_putc(ob, '"'); /* closing quote for the field */
+}
+
+/* Serializes a parsed record as one CSV row following each column's encoding */
+#define SCHEMA_PUT_RAW(col) out_put(ob, rec->field[col], rec->field_len[col]);
+#define SCHEMA_PUT_QUOTED(col) write_csv_field(ob, rec->field[col]);
+#define SCHEMA_PUT(col, name, key, type, encoding, wrap, width) \
+    if (col > 0)                                                 \
+        out_putc(ob, ',');                                       \
+    SCHEMA_PUT_##encoding(col)
+static void put_record(struct out_buffer *ob, const struct csv_record *rec)
+{
+    REVIEW_SCHEMA(SCHEMA_PUT)
+    out_putc(ob, '\n');
+}
+
+/* Writers of a dataset take turns through an flock on <csv>.lock, held from the moment they
+ * read the state they build on (the next Review_ID, the rows to rewrite) until their changes
+ * are in place. Readers never take it: appends only add whole records behind the snapshot a
+ * reader opened, and rewrites swap in a new file by rename, so an open file never changes
+ * under a reader. Returns the descriptor holding the lock, or -1 */
+int dataset_lock(const char *filename)
+{
+    char path[PATH_LEN + 8];
+
+    snprintf(path, sizeof(path), "%.*s.lock", PATH_LEN - 1, filename);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    enum prof_phase prev = prof_enter(PHASE_LOCK);
+    int locked;
+    while ((locked = flock(fd, LOCK_EX)) != 0 && errno == EINTR)
+        ;
+    prof_enter(prev);
+    if (locked != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void dataset_unlock(int fd)
+{
+    if (fd >= 0)
+        close(fd); // the lock file stays: removing it would let two writers lock different files
+}
+
+/* Reads the durability policy from a name such as "batch" (falls back to def) */
+enum durability parse_durability(const char *name, enum durability def)
+{
+    if (!name)
+        return def;
+    if (strcmp(name, "none") == 0)
+        return DURABLE_NONE;
+    if (strcmp(name, "batch") == 0)
+        return DURABLE_BATCH;
+    if (strcmp(name, "record") == 0)
+        return DURABLE_RECORD;
+    printf("Unknown durability '%s', using default.\n", name);
+    return def;
+}
+
+/* Opens the CSV for appending and queues the header or a missing final newline */
+int append_open(struct append_batch *ab, const char *filename, enum durability durability)
+{
+    struct stat st;
+    char last = '\n';
+
+    memset(ab, 0, sizeof(*ab));
+    ab->durability = durability;
+    snprintf(ab->path, sizeof(ab->path), "%s", filename);
+    ab->fd = open(filename, O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (ab->fd < 0)
+        return 0;
+
+    if (fstat(ab->fd, &st) == 0 && st.st_size == 0)
+    {
+        out_put(&ab->out, CSV_HEADER, CSV_HEADER_LEN); /* write header once */
+    }
+    else if (pread(ab->fd, &last, 1, st.st_size - 1) == 1 && last != '\n')
+    {
+        out_putc(&ab->out, '\n'); /* ensures the next appended row starts on a new line */
+    }
+    return 1;
+}
+
+/* Writes everything buffered so far in one system call */
+static int append_commit(struct append_batch *ab)
+{
+    int ok = 1;
+
+    enum prof_phase prev = prof_enter(PHASE_WRITE);
+
+    if (ab->out.failed)
+        ok = 0; // a row is incomplete: commit none of the batch
+    else if (ab->out.len > 0)
+    {
+        ok = write_all(ab->fd, ab->out.data, ab->out.len);
+        PROF_COUNT(bytes_written, ab->out.len);
+        off_t end = ok ? lseek(ab->fd, 0, SEEK_END) : -1;
+        if (end >= 0)
+            checksums_extend(ab->path, end - (long long)ab->out.len, ab->out.data, ab->out.len);
+        ab->out.len = 0;
+    }
+    if (ok && ab->pending > 0 && ab->durability != DURABLE_NONE)
+    {
+        prof_enter(PHASE_SYNC);
+        ok = fdatasync(ab->fd) == 0;
+        PROF_COUNT(syncs, 1);
+    }
+    prof_enter(prev);
+    ab->pending = 0;
+    return ok;
+}
+
+static void put_int(struct out_buffer *ob, int value)
+{
+    char num[16];
+
+    out_put(ob, num, snprintf(num, sizeof(num), "%d", value));
+}
+
+/* Serializes one review as a CSV row: INT columns as raw digits, QUOTED ones quoted/escaped
+ * to safely handle commas/newlines/quotes */
+#define SCHEMA_WRITE_INT_RAW(value) put_int(ob, value);
+#define SCHEMA_WRITE_TEXT_RAW(value) out_put(ob, value, strlen(value));
+#define SCHEMA_WRITE_TEXT_QUOTED(value) write_csv_field(ob, value);
+#define SCHEMA_WRITE(col, name, key, type, encoding, wrap, width) \
+    if (col > 0)                                                   \
+        out_putc(ob, ',');                                         \
+    SCHEMA_WRITE_##type##_##encoding(v->key)
+void put_review(struct out_buffer *ob, const struct review_values *v)
+{
+    REVIEW_SCHEMA(SCHEMA_WRITE)
+    out_putc(ob, '\n');
+}
+
+/* Counts a serialized record and commits when the durability policy asks for it */
+static int append_done(struct append_batch *ab)
+{
+    ab->pending++;
+    if (ab->durability == DURABLE_RECORD || ab->out.len >= APPEND_FLUSH)
+        return append_commit(ab);
+    return 1;
+}
+
+/* Serializes one review into the batch */
+static int append_record(struct append_batch *ab, const struct review_values *v)
+{
+    put_review(&ab->out, v);
+    return append_done(ab);
+}
+
+/* Serializes a parsed record into the batch */
+int append_csv_record(struct append_batch *ab, const struct csv_record *rec)
+{
+    put_record(&ab->out, rec);
+    return append_done(ab);
+}
+
+/* Commits what is left and closes the file */
+int append_close(struct append_batch *ab)
+{
+    int ok = append_commit(ab);
+
+    if (close(ab->fd) != 0)
+        ok = 0;
+    out_free(&ab->out);
+    return ok;
+}
+
+//***************************** Text Store *****************************
+
+/* Review_Text can live in a compressed <file>.text store. The CSV then holds a
+ * reference "\x1A<block offset>:<index>" in place of the text, so every other
+ * column stays plain and filters never decompress anything. */
+
+static uint32_t lz_read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Writes an LZ length continuation: 255s followed by the remainder */
+static unsigned char *lz_put_length(unsigned char *op, size_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+/* Worst-case compressed size of n bytes */
+static size_t lz_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+/* LZ77 compression with 4-byte hashed matches and 64K window (LZ4-style sequences).
+ * dst must hold lz_bound(n) bytes. Returns the compressed size */
+static size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst)
+{
+    static int32_t table[1 << LZ_HASH_BITS];
+    unsigned char *op = dst;
+    size_t ip = 0, anchor = 0;
+
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+        table[i] = -1;
+
+    // The last bytes are always literals so matches never run to the very end
+    while (n >= LZ_MIN_MATCH + 8 && ip < n - LZ_MIN_MATCH - 8)
+    {
+        uint32_t v = lz_read32(src + ip);
+        uint32_t h = (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int32_t ref = table[h];
+        table[h] = (int32_t)ip;
+
+        if (ref < 0 || ip - ref > 65535 || lz_read32(src + ref) != v)
+        {
+            ip++;
+            continue;
+        }
+
+        size_t len = LZ_MIN_MATCH;
+        while (ip + len < n - 8 && src[ref + len] == src[ip + len])
+            len++;
+
+        size_t lit = ip - anchor;
+        size_t mlen = len - LZ_MIN_MATCH;
+        unsigned char *token = op++;
+        *token = (unsigned char)(((lit < 15 ? lit : 15) << 4) | (mlen < 15 ? mlen : 15));
+        if (lit >= 15)
+            op = lz_put_length(op, lit - 15);
+        memcpy(op, src + anchor, lit);
+        op += lit;
+        *op++ = (unsigned char)((ip - ref) & 0xff);
+        *op++ = (unsigned char)((ip - ref) >> 8);
+        if (mlen >= 15)
+            op = lz_put_length(op, mlen - 15);
+
+        ip += len;
+        anchor = ip;
+    }
+
+    // Final run of literals without a match
+    size_t lit = n - anchor;
+    *op++ = (unsigned char)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15)
+        op = lz_put_length(op, lit - 15);
+    memcpy(op, src + anchor, lit);
+    op += lit;
+
+    return op - dst;
+}
+
+/* Reverses lz_compress(). Returns 1 when exactly n bytes were produced */
+static int lz_decompress(const unsigned char *src, size_t len, unsigned char *dst, size_t n)
+{
+    const unsigned char *ip = src, *end = src + len;
+    unsigned char *op = dst, *oend = dst + n;
+
+    while (ip < end)
+    {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+
+        if (lit == 15)
+        {
+            unsigned char b;
+            do
+            {
+                if (ip >= end)
+                    return 0;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > (size_t)(end - ip) || lit > (size_t)(oend - op))
+            return 0;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        if (ip >= end)
+            break; // last sequence has no match
+
+        if (end - ip < 2)
+            return 0;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t mlen = (token & 15);
+        if (mlen == 15)
+        {
+            unsigned char b;
+            do
+            {
+                if (ip >= end)
+                    return 0;
+                b = *ip++;
+                mlen += b;
+            } while (b == 255);
+        }
+        mlen += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - dst) || mlen > (size_t)(oend - op))
+            return 0;
+
+        // Byte by byte: the match may overlap the bytes it produces
+        const unsigned char *from = op - offset;
+        while (mlen--)
+            *op++ = *from++;
+    }
+    return op == oend;
+}
+
+/* On-disk header in front of each compressed block */
+struct text_block_header
+{
+    uint32_t count;    // Texts in the block, each followed by '\0'
+    uint32_t raw_len;
+    uint32_t comp_len;
+};
+
+/* 1 when a Review_Text field is a reference into the text store */
+int is_text_ref(const char *field)
+{
+    return field[0] == TEXT_REF_MARK;
+}
+
+void text_store_name(const char *path, char *out, size_t size)
+{
+    snprintf(out, size, "%.*s.text", PATH_LEN - 1, path);
+}
+
+/* Opens the text store belonging to a data file. Returns 0 if it has none */
+int text_store_open(struct text_store *ts, const char *path)
+{
+    char name[PATH_LEN + 8];
+
+    memset(ts, 0, sizeof(*ts));
+    ts->cached = -1;
+    text_store_name(path, name, sizeof(name));
+    ts->fd = open(name, O_RDONLY);
+    return ts->fd >= 0;
+}
+
+void text_store_close(struct text_store *ts)
+{
+    if (ts->fd >= 0)
+        close(ts->fd);
+    free(ts->raw);
+    free(ts->starts);
+    free(ts->comp);
+    memset(ts, 0, sizeof(*ts));
+    ts->fd = -1;
+}
+
+/* Makes sure a buffer holds at least n bytes */
+int grow_buffer(void **buf, size_t *cap, size_t n)
+{
+    if (n <= *cap)
+        return 1;
+
+    void *tmp = realloc(*buf, n);
+    if (!tmp)
+        return 0;
+    *buf = tmp;
+    *cap = n;
+    return 1;
+}
+
+/* Decompresses the block at offset into the cache */
+static int text_store_load(struct text_store *ts, long long offset)
+{
+    struct text_block_header h;
+
+    if (ts->cached == offset)
+        return 1;
+    ts->cached = -1;
+
+    if (pread(ts->fd, &h, sizeof(h), offset) != (ssize_t)sizeof(h) || h.count == 0)
+        return 0;
+    if (!grow_buffer((void **)&ts->raw, &ts->raw_cap, h.raw_len) ||
+        !grow_buffer((void **)&ts->comp, &ts->comp_cap, h.comp_len) ||
+        !grow_buffer((void **)&ts->starts, &ts->starts_cap, h.count * sizeof(uint32_t)))
+        return 0;
+    if (pread(ts->fd, ts->comp, h.comp_len, offset + sizeof(h)) != (ssize_t)h.comp_len)
+        return 0;
+
+    // A block that didn't shrink is stored as-is
+    if (h.comp_len == h.raw_len)
+        memcpy(ts->raw, ts->comp, h.raw_len);
+    else if (!lz_decompress(ts->comp, h.comp_len, (unsigned char *)ts->raw, h.raw_len))
+        return 0;
+
+    // Texts are '\0'-separated; index their starts
+    uint32_t pos = 0;
+    ts->count = 0;
+    while (pos < h.raw_len && ts->count < h.count)
+    {
+        const char *nul = memchr(ts->raw + pos, '\0', h.raw_len - pos);
+        if (!nul)
+            break;
+        ts->starts[ts->count++] = pos;
+        pos = nul - ts->raw + 1;
+    }
+
+    ts->cached = offset;
+    return 1;
+}
+
+/* Resolves a text reference. Returns NULL if the store can't provide it */
+const char *text_store_get(struct text_store *ts, const char *ref, size_t *len)
+{
+    long long offset;
+    unsigned index;
+
+    if (ts->fd < 0 || sscanf(ref + 1, "%lld:%u", &offset, &index) != 2)
+        return NULL;
+    if (!text_store_load(ts, offset) || index >= ts->count)
+        return NULL;
+
+    const char *text = ts->raw + ts->starts[index];
+    if (len)
+        *len = strlen(text);
+    return text;
+}
+
+/* Replaces a text reference in buf with the text it stands for (plain text is left alone) */
+void resolve_review_text(const char *path, char *buf, size_t size)
+{
+    struct text_store ts;
+    char ref[64];
+
+    if (!is_text_ref(buf) || !text_store_open(&ts, path))
+        return;
+
+    snprintf(ref, sizeof(ref), "%.63s", buf);
+    const char *text = text_store_get(&ts, ref, NULL);
+    if (text)
+        snprintf(buf, size, "%s", text);
+    text_store_close(&ts);
+}
+
+int text_writer_open(struct text_writer *tw, const char *path)
+{
+    char name[PATH_LEN + 8];
+    struct stat st;
+
+    memset(tw, 0, sizeof(*tw));
+    text_store_name(path, name, sizeof(name));
+    tw->fd = open(name, O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (tw->fd < 0 || fstat(tw->fd, &st) != 0)
+        return 0;
+
+    tw->end = st.st_size;
+    if (tw->end == 0)
+    {
+        // Offset 0 is never a block so a zeroed reference is always invalid
+        if (!write_all(tw->fd, TEXT_MAGIC, 8))
+            return 0;
+        tw->end = 8;
+    }
+    return 1;
+}
+
+/* Compresses and appends the open block */
+static int text_writer_flush(struct text_writer *tw)
+{
+    struct text_block_header h;
+
+    if (tw->count == 0)
+        return 1;
+    if (tw->raw.failed || !grow_buffer((void **)&tw->comp, &tw->comp_cap, lz_bound(tw->raw.len)))
+        return 0;
+
+    h.count = tw->count;
+    h.raw_len = tw->raw.len;
+    h.comp_len = lz_compress((unsigned char *)tw->raw.data, tw->raw.len, tw->comp);
+
+    const void *body = tw->comp;
+    if (h.comp_len >= h.raw_len)
+    {
+        h.comp_len = h.raw_len; // incompressible: keep raw
+        body = tw->raw.data;
+    }
+
+    if (!write_all(tw->fd, (const char *)&h, sizeof(h)) || !write_all(tw->fd, body, h.comp_len))
+        return 0;
+
+    tw->end += sizeof(h) + h.comp_len;
+    tw->raw.len = 0;
+    tw->count = 0;
+    return 1;
+}
+
+/* Adds a text and writes the reference to it into ref */
+int text_writer_add(struct text_writer *tw, const char *text, char *ref, size_t size)
+{
+    if (tw->raw.len >= TEXT_BLOCK_SIZE && !text_writer_flush(tw))
+        return 0;
+
+    snprintf(ref, size, "%c%lld:%u", TEXT_REF_MARK, tw->end, tw->count);
+    out_put(&tw->raw, text, strlen(text) + 1);
+    tw->count++;
+    return 1;
+}
+
+int text_writer_close(struct text_writer *tw)
+{
+    int ok = tw->fd >= 0 && text_writer_flush(tw) && fdatasync(tw->fd) == 0;
+
+    if (tw->fd >= 0)
+        close(tw->fd);
+    out_free(&tw->raw);
+    free(tw->comp);
+    return ok;
+}
+
+//***************************** Sharded Storage *****************************
+
+/* Builds the path of a file inside the shard directory of filename */
+void shard_path(const char *filename, const char *name, char *out, size_t size)
+{
+    snprintf(out, size, "%s" SHARD_DIR_SUFFIX "/%s", filename, name);
+}
+
+/* Loads the manifest. Returns 0 when the data file is not sharded */
+int manifest_load(const char *filename, struct shard_manifest *m)
+{
+    char path[PATH_LEN];
+    char line[256];
+
+    memset(m, 0, sizeof(*m));
+    m->next_id = 1;
+
+    shard_path(filename, MANIFEST_NAME, path, sizeof(path));
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+
+    // Lines are "next_id\t<n>" and "shard\t<branch>\t<file>"
+    while (fgets(line, sizeof(line), fp))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *key = strtok(line, "\t");
+        char *a = strtok(NULL, "\t");
+        char *b = strtok(NULL, "\t");
+
+        if (!key || !a)
+            continue;
+        if (strcmp(key, "next_id") == 0)
+        {
+            m->next_id = atoi(a);
+        }
+        else if (strcmp(key, "shard") == 0 && b && m->nshards < MAX_SHARDS)
+        {
+            snprintf(m->branch[m->nshards], sizeof(m->branch[0]), "%s", a);
+            snprintf(m->file[m->nshards], sizeof(m->file[0]), "%s", b);
+            m->nshards++;
+        }
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+/* Writes the manifest through a temporary file so readers never see half of it */
+int manifest_save(const char *filename, const struct shard_manifest *m)
+{
+    char path[PATH_LEN];
+    char tmp[PATH_LEN + 4];
+
+    shard_path(filename, MANIFEST_NAME, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return 0;
+
+    fprintf(fp, "next_id\t%d\n", m->next_id);
+    for (int i = 0; i < m->nshards; i++)
+        fprintf(fp, "shard\t%s\t%s\n", m->branch[i], m->file[i]);
+
+    enum prof_phase prev = prof_enter(PHASE_SYNC);
+    int synced = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    PROF_COUNT(syncs, 1);
+    prof_enter(prev);
+    if (!synced)
+    {
+        fclose(fp);
+        remove(tmp);
+        return 0;
+    }
+    fclose(fp);
+    return rename(tmp, path) == 0;
+}
+
+/* Finds the shard of a branch, adding a new one when create is set. Returns -1 if there is none */
+int shard_for_branch(struct shard_manifest *m, const char *branch, int create)
+{
+    for (int i = 0; i < m->nshards; i++)
+    {
+        if (strcmp(m->branch[i], branch) == 0)
+            return i;
+    }
+
+    if (!create || m->nshards == MAX_SHARDS)
+        return -1;
+
+    // File names only keep characters that are safe on every file system
+    int i = m->nshards;
+    char name[80];
+    int n = 0;
+    for (int k = 0; branch[k] && n < (int)sizeof(name) - 1; k++)
+    {
+        char ch = branch[k];
+        int safe = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '-';
+        name[n++] = safe ? ch : '_';
+    }
+    name[n] = '\0';
+
+    snprintf(m->branch[i], sizeof(m->branch[0]), "%s", branch);
+    snprintf(m->file[i], sizeof(m->file[0]), "%02d-%s.csv", i, name);
+    m->nshards++;
+    return i;
+}
+
+/* Lists the files holding the dataset: the CSV itself or every shard */
+int data_files(const char *filename, char paths[][PATH_LEN])
+{
+    struct shard_manifest m;
+
+    if (!manifest_load(filename, &m))
+    {
+        snprintf(paths[0], PATH_LEN, "%s", filename);
+        return 1;
+    }
+
+    for (int i = 0; i < m.nshards; i++)
+        shard_path(filename, m.file[i], paths[i], PATH_LEN);
+    return m.nshards;
+}
+
+/* Readers hold the shard directory shared while they load the manifest and open the shards;
+ * writers hold it exclusively only while they swap shard files in or out. A scan so never mixes
+ * shards from before and after a rewrite, and never waits longer than the renames take.
+ * Returns the descriptor holding the lock, or -1 when filename is not sharded */
+int shards_hold(const char *filename, int exclusive)
+{
+    char path[PATH_LEN];
+
+    snprintf(path, sizeof(path), "%s" SHARD_DIR_SUFFIX, filename);
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    enum prof_phase prev = prof_enter(PHASE_LOCK);
+    while (flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0 && errno == EINTR)
+        ;
+    prof_enter(prev);
+    return fd;
+}
+
+void shards_release(int fd)
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+const char *month_names[12] = {
+    "January", "February", "March", "April",
+    "May", "June", "July", "August",
+    "September", "October", "November", "December"};
+
+/* Perfect hash of the month names: (second + third letter) & 31 differs for all twelve.
+ * Slots hold the month number, 0 when no month hashes there */
+static const unsigned char month_slot[32] = {[15] = 1, [7] = 2,  [19] = 3, [2] = 4,  [26] = 5,  [3] = 6,
+                                             [1] = 7,  [28] = 8, [21] = 9, [23] = 10, [5] = 11, [8] = 12};
+
+/* Returns 0..11 when the len bytes at s are a month name, -1 when they are not */
+int month_lookup(const char *s, size_t len)
+{
+    if (len < 3)
+        return -1;
+    int m = month_slot[((unsigned char)s[1] + (unsigned char)s[2]) & 31] - 1;
+    return m >= 0 && strlen(month_names[m]) == len && memcmp(s, month_names[m], len) == 0 ? m : -1;
+}
+
+/* Returns 0..11 for a month name, -1 when it is not one */
+int month_index(const char *name)
+{
+    return month_lookup(name, strlen(name));
+}
+
+#define SCHEMA_NAME(col, name, key, type, encoding, wrap, width) name,
+#define SCHEMA_KEY(col, name, key, type, encoding, wrap, width) #key,
+const char *column_names[COLS] = {REVIEW_SCHEMA(SCHEMA_NAME)};
+
+/* Returns the column of a header name or its short form (id, rating, month, location, text, branch), -1 if none */
+int column_index(const char *name)
+{
+    static const char *short_names[COLS] = {REVIEW_SCHEMA(SCHEMA_KEY)};
+
+    for (int c = 0; c < COLS; c++)
+    {
+        if (strcasecmp(name, column_names[c]) == 0 || strcasecmp(name, short_names[c]) == 0)
+            return c;
+    }
+    return -1;
+}
+
+/* A filter that lets every row through */
+void filter_init(struct review_filter *f)
+{
+    f->branch = NULL;
+    f->min_id = 0;
+    f->max_id = 0x7fffffff;
+    f->min_rating = 0;
+    f->max_rating = 0x7fffffff;
+    f->months = 0;
+    f->columns = 0;
+}
+
+/* Fields a scan must parse: the projected ones plus the ones the filter and the ID merge look at */
+unsigned filter_columns(const struct review_filter *f)
+{
+    if (!f->columns)
+        return ALL_COLUMNS;
+    return f->columns | 1u << COL_ID | 1u << COL_RATING | (f->months ? 1u << COL_MONTH : 0) | (f->branch ? 1u << COL_BRANCH : 0);
+}
+
+/* 1 when the filter restricts anything besides the branch */
+int filter_restricts_rows(const struct review_filter *f)
+{
+    return f->min_id > 0 || f->max_id < 0x7fffffff || f->min_rating > 0 ||
+           f->max_rating < 0x7fffffff || f->months != 0;
+}
+
+int filter_match(const struct review_filter *f, const struct csv_record *rec)
+{
+    int id = record_id(rec);
+    int rating = record_rating(rec);
+
+    if (id < f->min_id || id > f->max_id || rating < f->min_rating || rating > f->max_rating)
+        return 0;
+    if (f->months)
+    {
+        int m = month_lookup(rec->field[COL_MONTH], rec->field_len[COL_MONTH]);
+        if (m < 0 || !(f->months & (1u << m)))
+            return 0;
+    }
+    return !f->branch || strcmp(rec->field[COL_BRANCH], f->branch) == 0;
+}
+
+/* Fixed part of the sidecar, followed by the branch names and the blocks */
+struct zone_header
+{
+    char magic[8];
+    int block_records;
+    int nbranch;
+    int nblocks;
+    struct file_mark mark;
+};
+
+void zonemap_free(struct zone_map *zm)
+{
+    free(zm->blocks);
+    zm->blocks = NULL;
+    zm->nblocks = zm->cap = 0;
+}
+
+/* Bit for a branch; names past the list limit share the last bit */
+static unsigned zone_branch_bit(struct zone_map *zm, const char *name, int add)
+{
+    for (int b = 0; b < zm->nbranch; b++)
+    {
+        if (strcmp(zm->branch[b], name) == 0)
+            return 1u << b;
+    }
+    if (!add)
+        return 0;
+    if (zm->nbranch == ZONE_MAX_BRANCHES)
+        return 1u << ZONE_MAX_BRANCHES;
+
+    snprintf(zm->branch[zm->nbranch], sizeof(zm->branch[0]), "%s", name);
+    return 1u << zm->nbranch++;
+}
+
+static void zone_add(struct zone_map *zm, const struct csv_record *rec)
+{
+    struct zone_block *b = zm->nblocks ? &zm->blocks[zm->nblocks - 1] : NULL;
+    int id = record_id(rec);
+    int rating = record_rating(rec);
+    int month = month_lookup(rec->field[COL_MONTH], rec->field_len[COL_MONTH]);
+
+    // Start a new block when the last one is full
+    if (!b || b->records == zm->block_records)
+    {
+        if (zm->nblocks == zm->cap)
+        {
+            int cap = zm->cap ? zm->cap * 2 : 64;
+            struct zone_block *tmp = realloc(zm->blocks, sizeof(*tmp) * cap);
+            if (!tmp)
+                return;
+            zm->blocks = tmp;
+            zm->cap = cap;
+        }
+        b = &zm->blocks[zm->nblocks++];
+        memset(b, 0, sizeof(*b));
+        b->start = rec->offset;
+        b->min_id = b->max_id = id;
+        b->min_rating = b->max_rating = rating;
+    }
+
+    b->records++;
+    b->end = rec->offset + rec->length;
+    if (id < b->min_id)
+        b->min_id = id;
+    if (id > b->max_id)
+        b->max_id = id;
+    if (rating < b->min_rating)
+        b->min_rating = rating;
+    if (rating > b->max_rating)
+        b->max_rating = rating;
+    b->months |= month >= 0 ? 1u << month : 1u << 12; // bit 12: not a valid month
+    b->branches |= zone_branch_bit(zm, rec->field[COL_BRANCH], 1);
+}
+
+/* 0 when no record of block b can satisfy the filter */
+int zone_block_may_match(struct zone_map *zm, int b, const struct review_filter *f)
+{
+    const struct zone_block *blk = &zm->blocks[b];
+
+    if (blk->max_id < f->min_id || blk->min_id > f->max_id)
+        return 0;
+    if (blk->max_rating < f->min_rating || blk->min_rating > f->max_rating)
+        return 0;
+    if (f->months && !(blk->months & f->months))
+        return 0;
+    if (f->branch)
+    {
+        unsigned bit = zone_branch_bit(zm, f->branch, 0);
+        if (!(blk->branches & (bit | 1u << ZONE_MAX_BRANCHES)))
+            return 0;
+    }
+    return 1;
+}
+
+void zonemap_path(const char *path, char *out, size_t size)
+{
+    snprintf(out, size, "%.*s.zonemap", PATH_LEN - 1, path);
+}
+
+/* Reads the sidecar of path. Returns 0 if there is none or it is unreadable */
+static int zonemap_load(const char *path, struct zone_map *zm)
+{
+    struct zone_header h;
+    char side[PATH_LEN + 16];
+    int ok = 0;
+
+    zonemap_path(path, side, sizeof(side));
+    FILE *fp = fopen(side, "rb");
+    if (!fp)
+        return 0;
+
+    if (fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.magic, ZONE_MAGIC, 8) == 0 &&
+        h.nbranch <= ZONE_MAX_BRANCHES && h.nblocks >= 0)
+    {
+        zm->blocks = malloc(sizeof(struct zone_block) * (h.nblocks + 1));
+        zm->cap = h.nblocks + 1;
+        if (zm->blocks &&
+            fread(zm->branch, sizeof(zm->branch[0]), h.nbranch, fp) == (size_t)h.nbranch &&
+            fread(zm->blocks, sizeof(struct zone_block), h.nblocks, fp) == (size_t)h.nblocks)
+        {
+            zm->mark = h.mark;
+            zm->block_records = h.block_records;
+            zm->nbranch = h.nbranch;
+            zm->nblocks = h.nblocks;
+            ok = 1;
+        }
+    }
+
+    fclose(fp);
+    if (!ok)
+        zonemap_free(zm);
+    return ok;
+}
+
+/* Writes the sidecar through a temporary file */
+static int zonemap_save(const char *path, const struct zone_map *zm)
+{
+    struct zone_header h;
+    char side[PATH_LEN + 16];
+    char tmp[PATH_LEN + 48];
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, ZONE_MAGIC, 8);
+    h.block_records = zm->block_records;
+    h.nbranch = zm->nbranch;
+    h.nblocks = zm->nblocks;
+    h.mark = zm->mark;
+
+    zonemap_path(path, side, sizeof(side));
+    temp_path(side, tmp, sizeof(tmp));
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+        return 0;
+
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+             fwrite(zm->branch, sizeof(zm->branch[0]), zm->nbranch, fp) == (size_t)zm->nbranch &&
+             fwrite(zm->blocks, sizeof(struct zone_block), zm->nblocks, fp) == (size_t)zm->nblocks;
+    if (fclose(fp) != 0 || !ok)
+    {
+        remove(tmp);
+        return 0;
+    }
+    return rename(tmp, side) == 0;
+}
+
+/* 1 when zm describes the file open as fd, not a version swapped in after fd was opened */
+int zonemap_covers(const struct zone_map *zm, int fd)
+{
+    struct stat st;
+
+    return fstat(fd, &st) == 0 && st.st_dev == zm->mark.dev && st.st_ino == zm->mark.ino;
+}
+
+/* Drops the sidecars (zone map, trend grid and sketch) after a rewrite; the next use rebuilds them */
+void sidecars_invalidate(const char *path)
+{
+    char side[PATH_LEN + 16];
+
+    zonemap_path(path, side, sizeof(side));
+    remove(side);
+    snprintf(side, sizeof(side), "%.*s.trends", PATH_LEN - 1, path);
+    remove(side);
+    snprintf(side, sizeof(side), "%.*s.sketch", PATH_LEN - 1, path);
+    remove(side);
+}
+
+/* Brings the zone map of path up to date: appended records extend it, anything else rebuilds it.
+ * block_records of 0 keeps the stored block size. Returns 0 if the data file can't be read */
+int zonemap_sync(const char *path, struct zone_map *zm, int block_records)
+{
+    struct stat st;
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long from = 0;
+
+    memset(zm, 0, sizeof(*zm));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if (zonemap_load(path, zm) && mark_is_prefix(&zm->mark, fd, &st) &&
+        (block_records == 0 || block_records == zm->block_records))
+    {
+        if (st.st_size == zm->mark.offset)
+        {
+            close(fd);
+            return 1; // already current
+        }
+        from = zm->mark.offset;
+    }
+    else
+    {
+        zonemap_free(zm);
+        memset(zm, 0, sizeof(*zm));
+        zm->block_records = block_records > 0 ? block_records : ZONE_BLOCK_RECORDS;
+    }
+
+    if (!reader_open(&rd, fd, from))
+    {
+        close(fd);
+        return 0;
+    }
+    if (from == 0)
+        reader_skip_header(&rd);
+    reader_read_ahead(&rd);
+
+    while (reader_next(&rd, &rec, 1))
+        zone_add(zm, &rec);
+
+    mark_file(&zm->mark, fd, &st, reader_offset(&rd));
+    reader_close(&rd);
+    close(fd);
+
+    zonemap_save(path, zm); // a read-only directory just means no sidecar
+    return 1;
+}
+
+/* Moves a source to the next zone block that may match. Returns 0 when there is none */
+static int scan_next_block(struct review_scan *sc, int src)
+{
+    struct zone_map *zm = &sc->zm[src];
+    int b = sc->block[src] + 1;
+
+    while (b < zm->nblocks && !zone_block_may_match(zm, b, &sc->filter))
+        b++;
+
+    sc->block[src] = b;
+    if (b >= zm->nblocks)
+        return 0;
+
+    sc->blocks_read++;
+    if (reader_offset(&sc->rd[src]) != zm->blocks[b].start)
+        reader_seek(&sc->rd[src], zm->blocks[b].start);
+    return 1;
+}
+
+/* Loads the next record of one source into cur[] */
+static void scan_advance(struct review_scan *sc, int src)
+{
+    if (sc->zoned[src])
+    {
+        // Leaving the current block: jump to the next one that can match
+        int b = sc->block[src];
+        if ((b < 0 || reader_offset(&sc->rd[src]) >= sc->zm[src].blocks[b].end) && !scan_next_block(sc, src))
+        {
+            sc->ready[src] = 0;
+            return;
+        }
+    }
+    sc->ready[src] = reader_next(&sc->rd[src], &sc->cur[src], 1);
+}
+
+static int scan_add_source(struct review_scan *sc, const char *path)
+{
+    int src = sc->nsrc;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT && sc->sharded; // a shard whose first reviews are still being written
+
+    if (!reader_open(&sc->rd[src], fd, 0))
+    {
+        close(fd);
+        return 0;
+    }
+    sc->fd[src] = fd;
+    sc->rd[src].want = filter_columns(&sc->filter);
+    sc->block[src] = -1;
+    text_store_open(&sc->ts[src], path);
+    sc->nsrc++;
+
+    sc->zoned[src] = sc->use_zones && zonemap_sync(path, &sc->zm[src], 0) && zonemap_covers(&sc->zm[src], fd);
+    if (sc->zoned[src])
+        sc->blocks_total += sc->zm[src].nblocks;
+    else
+        reader_skip_header(&sc->rd[src]);
+
+    scan_advance(sc, src);
+
+    // Chunks are loaded ahead only when the source is read front to back: jumps between zone blocks would waste them
+    int sequential = 1;
+    for (int b = 0; sc->zoned[src] && sequential && b < sc->zm[src].nblocks; b++)
+        sequential = zone_block_may_match(&sc->zm[src], b, &sc->filter);
+    if (sequential)
+        reader_read_ahead(&sc->rd[src]);
+    return 1;
+}
+
+void scan_close(struct review_scan *sc)
+{
+    for (int s = 0; s < sc->nsrc; s++)
+    {
+        reader_close(&sc->rd[s]);
+        close(sc->fd[s]);
+        zonemap_free(&sc->zm[s]);
+        text_store_close(&sc->ts[s]);
+    }
+    sc->nsrc = 0;
+}
+
+/* Opens a scan returning the records that match filter (NULL for all). Only the
+ * shard of the filtered branch is touched, and zone maps skip blocks that can't
+ * match. Returns 0 if the data can't be opened */
+int scan_open(struct review_scan *sc, const char *filename, const struct review_filter *filter)
+{
+    struct shard_manifest m;
+    char path[PATH_LEN];
+
+    memset(sc, 0, sizeof(*sc));
+    if (filter)
+        sc->filter = *filter;
+    else
+        filter_init(&sc->filter);
+    sc->last = -1;
+    int hold = shards_hold(filename, 0);
+    sc->sharded = manifest_load(filename, &m);
+
+    // A branch alone is fully handled by shard pruning
+    sc->use_zones = filter_restricts_rows(&sc->filter) || (sc->filter.branch && !sc->sharded);
+
+    if (!sc->sharded)
+    {
+        shards_release(hold);
+        if (!scan_add_source(sc, filename))
+        {
+            scan_close(sc);
+            return 0;
+        }
+        return 1;
+    }
+
+    for (int i = 0; i < m.nshards; i++)
+    {
+        if (sc->filter.branch && strcmp(sc->filter.branch, m.branch[i]) != 0)
+            continue; // pruned: this shard can't hold matching rows
+
+        shard_path(filename, m.file[i], path, sizeof(path));
+        if (!scan_add_source(sc, path))
+        {
+            shards_release(hold);
+            scan_close(sc);
+            return 0;
+        }
+    }
+    shards_release(hold);
+    return 1;
+}
+
+/* Returns the next matching record or NULL at the end. It stays valid until the next call */
+const struct csv_record *scan_next(struct review_scan *sc)
+{
+    enum prof_phase prev = prof_enter(PHASE_PARSE);
+
+    while (1)
+    {
+        if (sc->last >= 0)
+            scan_advance(sc, sc->last);
+
+        // Take the source whose pending record has the lowest ID
+        int best = -1;
+        int best_id = 0;
+        for (int s = 0; s < sc->nsrc; s++)
+        {
+            if (!sc->ready[s])
+                continue;
+            int id = record_id(&sc->cur[s]);
+            if (best < 0 || id < best_id)
+            {
+                best = s;
+                best_id = id;
+            }
+        }
+
+        sc->last = best;
+        if (best < 0)
+        {
+            prof_enter(prev);
+            return NULL;
+        }
+
+        struct csv_record *rec = &sc->cur[best];
+        if (!filter_match(&sc->filter, rec))
+            continue;
+
+        // Only rows that are handed out get their text decompressed
+        if (!sc->skip_text && is_text_ref(rec->field[COL_TEXT]))
+        {
+            const char *text = text_store_get(&sc->ts[best], rec->field[COL_TEXT], &rec->field_len[COL_TEXT]);
+            if (text)
+                rec->field[COL_TEXT] = (char *)text;
+        }
+        prof_enter(prev);
+        return rec;
+    }
+}
+
+/*Finds the next Review_ID. It reads the CSV record by record. It returns the biggest ID + 1.*/
+int get_next_id(const char *filename)
+{
+    struct shard_manifest m;
+    if (manifest_load(filename, &m))
+        return m.next_id; /* sharded data: the manifest hands out IDs */
+
+    struct csv_reader rd;
+    struct csv_record rec;
+    int last_id = 0;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+        return 1; /* file doesn't exist yet -> first ID should be 1 */
+    if (!reader_open(&rd, fd, 0))
+    {
+        close(fd);
+        return 1;
+    }
+
+    /* only the first column is split out; the rest of the file loads while IDs are read */
+    rd.want = 1u << COL_ID;
+    reader_skip_header(&rd);
+    reader_read_ahead(&rd);
+    while (reader_next(&rd, &rec, 1))
+    {
+        if (int_valid(rec.field[COL_ID], rec.field_len[COL_ID]))
+            last_id = parse_int(rec.field[COL_ID], rec.field_len[COL_ID]); /* keeps updating; assumes IDs are in ascending order */
+    }
+
+    reader_close(&rd);
+    close(fd);
+    return last_id + 1;
+}
+
+/* Takes the dataset lock first, so no other writer hands out the same Review_IDs */
+int writer_open(struct review_writer *w, const char *filename, enum durability durability)
+{
+    memset(w, 0, sizeof(*w));
+    w->filename = filename;
+    w->durability = durability;
+    w->lock = dataset_lock(filename);
+    if (w->lock < 0)
+        return 0;
+    w->sharded = manifest_load(filename, &w->manifest);
+    w->next_id = w->sharded ? w->manifest.next_id : get_next_id(filename);
+
+    if (w->sharded)
+        return 1; // shards are opened on first use
+
+    w->open[0] = append_open(&w->batch[0], filename, durability);
+    if (!w->open[0])
+    {
+        dataset_unlock(w->lock);
+        w->lock = -1;
+    }
+    return w->open[0];
+}
+
+/* Buffers one review and returns the Review_ID it was given (0 on failure); v->id is ignored */
+int writer_add(struct review_writer *w, const struct review_values *v)
+{
+    struct review_values row = *v;
+    int s = 0;
+
+    if (w->sharded)
+    {
+        char path[PATH_LEN];
+
+        s = shard_for_branch(&w->manifest, v->branch, 1);
+        if (s < 0)
+            return 0;
+        shard_path(w->filename, w->manifest.file[s], path, sizeof(path));
+        if (!w->open[s] && !(w->open[s] = append_open(&w->batch[s], path, w->durability)))
+            return 0;
+    }
+
+    row.id = w->next_id;
+    if (!append_record(&w->batch[s], &row))
+        return 0;
+    w->next_id++;
+    return row.id;
+}
+
+/* Commits every batch. The manifest is saved first so a crash can only skip IDs, never reuse them */
+int writer_close(struct review_writer *w)
+{
+    int ok = 1;
+
+    if (w->sharded)
+    {
+        w->manifest.next_id = w->next_id;
+        ok = manifest_save(w->filename, &w->manifest);
+    }
+
+    for (int s = 0; s < MAX_SHARDS; s++)
+    {
+        if (w->open[s] && !append_close(&w->batch[s]))
+            ok = 0;
+    }
+    dataset_unlock(w->lock);
+    w->lock = -1;
+    return ok;
+}
+
+//***************************** Review Store *****************************
+
+/* The library interface declared in review_store.h. Everything a call needs lives in the handle
+ * or on the stack; none of the menu's tables are touched */
+struct review_store
+{
+    char path[PATH_LEN];
+    char error[PATH_LEN + 96];
+};
+
+static long long store_fail(struct review_store *store, const char *what)
+{
+    snprintf(store->error, sizeof(store->error), "%s: %s", what, errno ? strerror(errno) : "failed");
+    return -1;
+}
+
+void review_query_init(struct review_query *q)
+{
+    memset(q, 0, sizeof(*q));
+    q->max_id = 0x7fffffff;
+    q->max_rating = 0x7fffffff;
+    q->order = REVIEW_ORDER_FILE;
+}
+
+struct review_store *review_store_open(const char *path)
+{
+    struct review_store *store;
+
+    if (strlen(path) >= PATH_LEN - 32) // room for shard, sidecar and temporary suffixes
+        return NULL;
+    store = calloc(1, sizeof(*store));
+    if (store)
+        snprintf(store->path, sizeof(store->path), "%s", path);
+    return store;
+}
+
+void review_store_close(struct review_store *store)
+{
+    free(store);
+}
+
+const char *review_store_error(const struct review_store *store)
+{
+    return store->error;
+}
+
+static void store_filter(const struct review_query *q, struct review_filter *f)
+{
+    filter_init(f);
+    if (!q)
+        return;
+    f->branch = q->branch;
+    f->min_id = q->min_id;
+    f->max_id = q->max_id;
+    f->min_rating = q->min_rating;
+    f->max_rating = q->max_rating;
+    f->months = q->months;
+    f->columns = q->columns;
+}
+
+static int store_deliver(const struct csv_record *rec, review_callback cb, void *ctx)
+{
+    struct review_view v;
+
+    v.id = record_id(rec);
+    v.rating = record_rating(rec);
+    for (int c = 0; c < REVIEW_FIELDS; c++)
+    {
+        v.field[c].data = rec->field[c];
+        v.field[c].len = rec->field_len[c];
+    }
+    return cb(ctx, &v);
+}
+
+long long review_store_scan(struct review_store *store, const struct review_query *q, review_callback cb, void *ctx)
+{
+    struct review_filter f;
+    struct review_scan sc;
+    const struct csv_record *rec;
+    long long n = 0;
+
+    store_filter(q, &f);
+    errno = 0;
+    if (!scan_open(&sc, store->path, &f))
+        return errno == ENOENT ? 0 : store_fail(store, store->path); // nothing appended yet
+    while ((!q || !q->limit || n < q->limit) && (rec = scan_next(&sc)) != NULL)
+    {
+        n++;
+        if (store_deliver(rec, cb, ctx))
+            break;
+    }
+    scan_close(&sc);
+    return n;
+}
+
+/* Copies a record's fields into an entry, reusing its buffer */
+int top_store(struct top_entry *e, const struct csv_record *rec, int rating, int id)
+{
+    size_t need = COLS;
+
+    for (int c = 0; c < COLS; c++)
+        need += rec->field_len[c];
+    if (!grow_buffer((void **)&e->buf, &e->cap, need))
+        return 0;
+
+    char *p = e->buf;
+    for (int c = 0; c < COLS; c++)
+    {
+        memcpy(p, rec->field[c], rec->field_len[c]);
+        p[rec->field_len[c]] = '\0';
+        e->rec.field[c] = p;
+        e->rec.field_len[c] = rec->field_len[c];
+        p += rec->field_len[c] + 1;
+    }
+    e->rec.nfields = COLS;
+    e->rating = rating;
+    e->id = id;
+    return 1;
+}
+
+/* A buffered review of a sorted query; seq keeps file order among equal keys */
+struct store_row
+{
+    struct top_entry e;
+    long long seq;
+};
+
+static int store_rating_cmp(const void *a, const void *b)
+{
+    const struct store_row *x = a, *y = b;
+    if (x->e.rating != y->e.rating)
+        return x->e.rating < y->e.rating ? 1 : -1;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static int store_branch_cmp(const void *a, const void *b)
+{
+    const struct store_row *x = a, *y = b;
+    int c = strcmp(x->e.rec.field[COL_BRANCH], y->e.rec.field[COL_BRANCH]);
+    if (c != 0)
+        return c;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+long long review_store_query(struct review_store *store, const struct review_query *q, review_callback cb, void *ctx)
+{
+    struct review_filter f;
+    struct review_scan sc;
+    const struct csv_record *rec;
+    struct store_row *rows = NULL;
+    long long n = 0, cap = 0, delivered = 0;
+
+    if (!q || q->order == REVIEW_ORDER_FILE)
+        return review_store_scan(store, q, cb, ctx);
+
+    store_filter(q, &f);
+    if (q->order == REVIEW_ORDER_BRANCH && f.columns)
+        f.columns |= 1u << COL_BRANCH;
+    errno = 0;
+    if (!scan_open(&sc, store->path, &f))
+        return errno == ENOENT ? 0 : store_fail(store, store->path); // nothing appended yet
+
+    while ((rec = scan_next(&sc)) != NULL)
+    {
+        if (n == cap)
+        {
+            long long grow = cap ? cap * 2 : 1024;
+            struct store_row *tmp = realloc(rows, sizeof(*rows) * grow);
+            if (!tmp)
+                break;
+            memset(tmp + cap, 0, sizeof(*rows) * (grow - cap));
+            rows = tmp;
+            cap = grow;
+        }
+        if (!top_store(&rows[n].e, rec, record_rating(rec), record_id(rec)))
+            break;
+        rows[n].seq = n;
+        n++;
+    }
+    int complete = rec == NULL;
+    scan_close(&sc);
+
+    if (complete)
+    {
+        enum prof_phase prev = prof_enter(PHASE_SORT);
+        qsort(rows, n, sizeof(*rows), q->order == REVIEW_ORDER_RATING ? store_rating_cmp : store_branch_cmp);
+        prof_enter(prev);
+        while (delivered < n && (!q->limit || delivered < q->limit))
+        {
+            if (store_deliver(&rows[delivered++].e.rec, cb, ctx))
+                break;
+        }
+    }
+    else
+    {
+        errno = ENOMEM;
+        store_fail(store, "query");
+    }
+
+    for (long long i = 0; i < cap; i++)
+        free(rows[i].e.buf);
+    free(rows);
+    return complete ? delivered : -1;
+}
+
+int review_store_append(struct review_store *store, const struct review_input *reviews, int n, int *ids)
+{
+    struct review_writer w;
+    int added = 0;
+
+    errno = 0;
+    if (!writer_open(&w, store->path, DURABLE_BATCH))
+        return (int)store_fail(store, store->path);
+
+    for (; added < n; added++)
+    {
+        const struct review_input *r = &reviews[added];
+        struct review_values v = {.rating = r->rating, .month = r->month ? r->month : "", .location = r->location ? r->location : "",
+                                  .text = r->text ? r->text : "", .branch = r->branch ? r->branch : ""};
+        int id = writer_add(&w, &v);
+        if (!id)
+            break;
+        if (ids)
+            ids[added] = id;
+    }
+
+    if (!writer_close(&w) || added < n)
+        return (int)store_fail(store, "append");
+    return added;
+}
+
+static int id_cmp(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int update_cmp(const void *a, const void *b)
+{
+    return id_cmp(&(*(const struct review_update *const *)a)->id, &(*(const struct review_update *const *)b)->id);
+}
+
+static int update_key_cmp(const void *key, const void *elem)
+{
+    return id_cmp(key, &(*(const struct review_update *const *)elem)->id);
+}
+
+/* One pending rewrite: the data file, its replacement being written and what the rewrite did */
+struct store_rewrite
+{
+    char path[PATH_LEN];
+    char tmp[PATH_LEN + 8];
+    int fd;
+    struct out_buffer out;
+    int changed;
+};
+
+static int rewrite_flush(struct store_rewrite *rw)
+{
+    int ok = !rw->out.failed && write_all(rw->fd, rw->out.data, rw->out.len);
+    PROF_COUNT(bytes_written, rw->out.len);
+    rw->out.len = 0;
+    return ok;
+}
+
+/* 1 when a zone block may hold one of the reviews being deleted or updated (both sorted by ID) */
+static int rewrite_block_hit(const struct zone_block *blk, const int *del, int ndel,
+                             const struct review_update **upd, int nupd)
+{
+    int lo = 0, hi = ndel;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (del[mid] < blk->min_id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < ndel && del[lo] <= blk->max_id)
+        return 1;
+
+    lo = 0, hi = nupd;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (upd[mid]->id < blk->min_id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < nupd && upd[lo]->id <= blk->max_id;
+}
+
+/* Writes the replacement of path: the bytes between changed reviews are carried over by
+ * copy_span as they are, deleted reviews are left out and updated ones written anew. Updated
+ * reviews whose branch now lives in another shard go to moved[shard] instead. Only Review_IDs
+ * are parsed, and with a zone map only in blocks that may hold a changed one. The replacement
+ * is created at the first change: a file without any is left alone */
+static int rewrite_file(struct store_rewrite *rw, const int *del, int ndel, const struct review_update **upd, int nupd,
+                        struct shard_manifest *m, int self, struct out_buffer *moved)
+{
+    struct csv_reader rd;
+    struct csv_record rec;
+    struct text_store ts;
+    struct zone_map zm;
+    char side[PATH_LEN + 16];
+    int ts_open = 0, ok = 1;
+    long long copied = 0; // bytes of path already carried into the replacement
+
+    int in = open(rw->path, O_RDONLY);
+    if (in < 0)
+        return errno == ENOENT; // a shard without reviews yet
+    if (!reader_open(&rd, in, 0))
+    {
+        close(in);
+        return 0;
+    }
+    rd.want = 1u << COL_ID;
+
+    // A zone map is only used when one is there already: the rewrite drops it anyway
+    zonemap_path(rw->path, side, sizeof(side));
+    memset(&zm, 0, sizeof(zm));
+    int zoned = access(side, F_OK) == 0 && zonemap_sync(rw->path, &zm, 0) && zonemap_covers(&zm, in);
+    int b = -1;
+
+    reader_skip_header(&rd);
+    if (!zoned)
+        reader_read_ahead(&rd);
+
+    enum prof_phase prev = prof_enter(PHASE_PARSE);
+    while (ok)
+    {
+        // Leaving a block: jump to the next one that may hold a changed review
+        if (zoned && (b < 0 || reader_offset(&rd) >= zm.blocks[b].end))
+        {
+            while (++b < zm.nblocks && !rewrite_block_hit(&zm.blocks[b], del, ndel, upd, nupd))
+                ;
+            if (b >= zm.nblocks)
+                break;
+            if (reader_offset(&rd) != zm.blocks[b].start)
+                reader_seek(&rd, zm.blocks[b].start);
+        }
+        if (!reader_next(&rd, &rec, 1))
+            break;
+
+        int id = record_id(&rec);
+        const char *raw = rd.buf + (rec.offset - rd.pos);
+        const struct review_update **u = NULL;
+        int deleted = ndel && bsearch(&id, del, ndel, sizeof(int), id_cmp);
+
+        if (!deleted && (!nupd || !(u = bsearch(&id, upd, nupd, sizeof(*upd), update_key_cmp))))
+            continue;
+
+        // Carry over the unchanged bytes before this review
+        if (rw->fd < 0 && (rw->fd = open(rw->tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        {
+            ok = 0;
+            break;
+        }
+        if (rec.offset > copied)
+            ok = rewrite_flush(rw) && copy_span(in, copied, rec.offset - copied, rw->fd);
+        copied = rec.offset + (long long)rec.length;
+        rw->changed++;
+        if (deleted)
+            continue;
+
+        split_record(raw, rec.length, &rec, rd.scratch, ALL_COLUMNS); // so far only the ID was split
+        const struct review_input *s = &(*u)->set;
+        const char *branch = s->branch ? s->branch : rec.field[COL_BRANCH];
+        const char *text = s->text ? s->text : rec.field[COL_TEXT];
+        int target = self;
+
+        if (m && s->branch && (target = shard_for_branch(m, branch, 1)) < 0)
+        {
+            ok = 0;
+            break;
+        }
+        // A text reference only resolves next to the text store of its own file
+        if (target != self && !s->text && is_text_ref(text))
+        {
+            if (!ts_open)
+                ts_open = text_store_open(&ts, rw->path) ? 1 : -1;
+            if (ts_open < 0 || !(text = text_store_get(&ts, text, NULL)))
+            {
+                ok = 0;
+                break;
+            }
+        }
+        struct review_values v = {.id = id, .rating = s->rating ? s->rating : record_rating(&rec),
+                                  .month = s->month ? s->month : rec.field[COL_MONTH],
+                                  .location = s->location ? s->location : rec.field[COL_LOCATION],
+                                  .text = text, .branch = branch};
+        put_review(target == self ? &rw->out : &moved[target], &v);
+        if (rw->out.len >= APPEND_FLUSH)
+            ok = rewrite_flush(rw);
+    }
+    prof_enter(prev);
+
+    // The rest of the file, ended by a line break so rows appended later start a line of their own
+    char last = '\n';
+    if (ok && rw->fd >= 0)
+        ok = rewrite_flush(rw) && copy_span(in, copied, rd.limit - copied, rw->fd);
+    if (ok && rw->fd >= 0 && rd.limit > copied && pread(in, &last, 1, rd.limit - 1) == 1 && last != '\n')
+        ok = write_all(rw->fd, "\n", 1);
+
+    if (ts_open > 0)
+        text_store_close(&ts);
+    zonemap_free(&zm);
+    reader_close(&rd);
+    close(in);
+    if (ok && rw->fd >= 0)
+        ok = file_sync(rw->fd);
+    if (rw->fd >= 0 && close(rw->fd) != 0)
+        ok = 0;
+    rw->fd = -1;
+    return ok;
+}
+
+/* A review moved into another shard: its row in the moved buffer and its Review_ID */
+struct moved_row
+{
+    int id;
+    size_t start, len;
+};
+
+static int moved_row_cmp(const void *a, const void *b)
+{
+    return id_cmp(&((const struct moved_row *)a)->id, &((const struct moved_row *)b)->id);
+}
+
+/* Writes the replacement of a shard with the rows in moved (whole records in any order) put
+ * in at their Review_ID's place, so the shard stays sorted for the merged scan. Builds on the
+ * replacement already written when the shard changed itself, else on the shard, if any */
+static int rewrite_insert(struct store_rewrite *rw, const struct out_buffer *moved)
+{
+    struct moved_row *rows = NULL;
+    size_t nrows = 0, cap = 0;
+    int ok = 1;
+
+    for (size_t at = 0; ok && at < moved->len;)
+    {
+        size_t len = find_record_end(moved->data + at, moved->len - at);
+        const char *comma = memchr(moved->data + at, ',', len);
+        if (!(ok = len > 0 && comma && grow_buffer((void **)&rows, &cap, (nrows + 1) * sizeof(*rows))))
+            break;
+        rows[nrows++] = (struct moved_row){parse_int(moved->data + at, comma - (moved->data + at)), at, len};
+        at += len;
+    }
+    if (!ok)
+    {
+        free(rows);
+        return 0;
+    }
+    qsort(rows, nrows, sizeof(*rows), moved_row_cmp);
+
+    // The replacement written so far is read through a descriptor while its name is reused
+    int in = open(rw->changed ? rw->tmp : rw->path, O_RDONLY);
+    if (in < 0 && (rw->changed || errno != ENOENT))
+    {
+        free(rows);
+        return 0;
+    }
+    if (rw->changed)
+        unlink(rw->tmp);
+    rw->fd = open(rw->tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    struct csv_reader rd;
+    struct csv_record rec;
+    long long copied = 0, end = 0;
+    size_t r = 0;
+
+    ok = rw->fd >= 0 && (in < 0 || reader_open(&rd, in, 0));
+    if (ok && in >= 0)
+    {
+        rd.want = 1u << COL_ID;
+        end = rd.limit;
+        reader_skip_header(&rd);
+        reader_read_ahead(&rd);
+
+        enum prof_phase prev = prof_enter(PHASE_PARSE);
+        while (ok && r < nrows && reader_next(&rd, &rec, 1))
+        {
+            int id = record_id(&rec);
+            if (rows[r].id > id)
+                continue;
+
+            // Carry over the rows before this one, then the moved rows that go ahead of it
+            ok = rewrite_flush(rw) && copy_span(in, copied, rec.offset - copied, rw->fd);
+            copied = rec.offset;
+            for (; r < nrows && rows[r].id <= id; r++)
+                out_put(&rw->out, moved->data + rows[r].start, rows[r].len);
+        }
+        prof_enter(prev);
+        reader_close(&rd);
+    }
+
+    // The rest of the shard, ended by a line break, then the rows past its last ID
+    char last = '\n';
+    if (end == 0)
+        out_put(&rw->out, CSV_HEADER, CSV_HEADER_LEN);
+    ok = ok && rewrite_flush(rw) && copy_span(in, copied, end - copied, rw->fd);
+    if (ok && end > copied && pread(in, &last, 1, end - 1) == 1 && last != '\n')
+        out_putc(&rw->out, '\n');
+    for (; r < nrows; r++)
+        out_put(&rw->out, moved->data + rows[r].start, rows[r].len);
+    ok = ok && rewrite_flush(rw);
+
+    if (in >= 0)
+        close(in);
+    if (ok && rw->fd >= 0)
+        ok = file_sync(rw->fd);
+    if (rw->fd >= 0 && close(rw->fd) != 0)
+        ok = 0;
+    rw->fd = -1;
+    free(rows);
+    rw->changed++;
+    return ok;
+}
+
+/* Rewrites every data file in one pass each, then swaps in the files that changed. Readers
+ * keep the files they opened before the swap and open the new ones after it */
+static int store_rewrite_all(struct review_store *store, const int *del, int ndel,
+                             const struct review_update **upd, int nupd)
+{
+    char paths[MAX_SHARDS][PATH_LEN];
+    struct shard_manifest m;
+    int lock = dataset_lock(store->path);
+    if (lock < 0)
+        return (int)store_fail(store, "lock");
+
+    struct store_rewrite *rw = calloc(MAX_SHARDS, sizeof(*rw));
+    struct out_buffer moved[MAX_SHARDS];
+    int sharded = manifest_load(store->path, &m);
+    int npaths = data_files(store->path, paths);
+    int ok = rw != NULL, changed = 0;
+
+    memset(moved, 0, sizeof(moved));
+    for (int p = 0; ok && p < npaths; p++)
+    {
+        snprintf(rw[p].path, sizeof(rw[p].path), "%s", paths[p]);
+        snprintf(rw[p].tmp, sizeof(rw[p].tmp), "%s.tmp", paths[p]);
+        rw[p].fd = -1;
+        ok = rewrite_file(&rw[p], del, ndel, upd, nupd, sharded ? &m : NULL, p, moved);
+        if (!ok && rw[p].fd >= 0)
+            close(rw[p].fd);
+    }
+
+    for (int p = 0; ok && p < npaths; p++)
+        changed += rw[p].changed;
+
+    // Reviews that changed branch join their new shard at their ID's place, in its replacement
+    int nfiles = sharded && m.nshards > npaths ? m.nshards : npaths;
+    for (int s = npaths; ok && s < nfiles; s++)
+    {
+        char path[PATH_LEN + 64];
+
+        shard_path(store->path, m.file[s], path, sizeof(path));
+        snprintf(rw[s].path, sizeof(rw[s].path), "%.*s", PATH_LEN - 1, path);
+        snprintf(rw[s].tmp, sizeof(rw[s].tmp), "%s.tmp", rw[s].path);
+        rw[s].fd = -1;
+    }
+    for (int s = 0; ok && sharded && s < m.nshards; s++)
+    {
+        if (moved[s].len > 0)
+            ok = !moved[s].failed && rewrite_insert(&rw[s], &moved[s]);
+    }
+
+    // From here on readers must see either none of the changes or all of them
+    int hold = ok && changed > 0 ? shards_hold(store->path, 1) : -1;
+    if (ok && sharded)
+        ok = manifest_save(store->path, &m);
+
+    const char *renamed = NULL;
+    for (int p = 0; rw && p < nfiles; p++)
+    {
+        if (ok && rw[p].changed > 0)
+        {
+            sidecars_invalidate(rw[p].path);
+            if (rename(rw[p].tmp, rw[p].path) != 0)
+                ok = 0;
+            renamed = rw[p].path;
+        }
+        else
+        {
+            rw[p].changed = 0;
+            remove(rw[p].tmp);
+        }
+        out_free(&rw[p].out);
+    }
+    if (ok && renamed)
+        ok = dir_sync(renamed); // the data files (and the manifest) share one directory
+    shards_release(hold);
+
+    for (int p = 0; rw && p < nfiles; p++)
+    {
+        if (rw[p].changed > 0)
+            checksums_record(rw[p].path);
+    }
+    for (int s = 0; s < MAX_SHARDS; s++)
+        out_free(&moved[s]);
+    free(rw);
+    dataset_unlock(lock);
+
+    if (!ok)
+        return (int)store_fail(store, "rewrite");
+    return changed;
+}
+
+int review_store_update(struct review_store *store, const struct review_update *updates, int n)
+{
+    const struct review_update **upd;
+    int changed;
+
+    if (n <= 0)
+        return 0;
+    upd = malloc(sizeof(*upd) * n);
+    if (!upd)
+    {
+        errno = ENOMEM;
+        return (int)store_fail(store, "update");
+    }
+    for (int i = 0; i < n; i++)
+        upd[i] = &updates[i];
+    qsort(upd, n, sizeof(*upd), update_cmp);
+
+    errno = 0;
+    changed = store_rewrite_all(store, NULL, 0, upd, n);
+    free(upd);
+    return changed;
+}
+
+int review_store_delete(struct review_store *store, const int *ids, int n)
+{
+    int *del;
+    int removed;
+
+    if (n <= 0)
+        return 0;
+    del = malloc(sizeof(int) * n);
+    if (!del)
+    {
+        errno = ENOMEM;
+        return (int)store_fail(store, "delete");
+    }
+    memcpy(del, ids, sizeof(int) * n);
+    qsort(del, n, sizeof(int), id_cmp);
+
+    errno = 0;
+    removed = store_rewrite_all(store, del, n, NULL, 0);
+    free(del);
+    return removed;
+}
@@ -0,0 +1,119 @@
+#ifndef REVIEW_STORE_H
+#define REVIEW_STORE_H
+
+#include <stddef.h>
+
+/* Review store: the review dataset (one CSV file, or one file per branch once sharded)
+ * behind an opaque handle. Calls work on batches and report through callbacks, never
+ * through stdin/stdout. Handles share no state, so separate stores can be used from
+ * separate threads; a single handle must be used by one thread at a time.
+ *
+ * The store is built from review_store.c alone (cc -c review_store.c) and exports nothing
+ * but the functions below. The interactive program in disneyland-group10.c links the same
+ * file (cc disneyland-group10.c review_store.c -lpthread -lm). It deletes and edits reviews
+ * through these functions. Its views, reports and imports use the scanner and writer from
+ * review_store_internal.h, which are not part of this interface. */
+
+#pragma GCC visibility push(default)
+
+#define REVIEW_FIELDS 6
+
+/* Field positions, in CSV order */
+enum review_column
+{
+    REVIEW_ID,
+    REVIEW_RATING,
+    REVIEW_MONTH,
+    REVIEW_LOCATION,
+    REVIEW_TEXT,
+    REVIEW_BRANCH
+};
+
+struct review_store;
+
+/* Bytes of one field, NUL-terminated; len excludes the NUL */
+struct review_field
+{
+    const char *data;
+    size_t len;
+};
+
+/* One review handed to a callback. The views are only valid until the callback returns */
+struct review_view
+{
+    int id;
+    int rating;
+    struct review_field field[REVIEW_FIELDS];
+};
+
+enum review_order
+{
+    REVIEW_ORDER_FILE,   // order of the data files, streamed without buffering
+    REVIEW_ORDER_RATING, // highest rating first, then file order
+    REVIEW_ORDER_BRANCH  // branch name A to Z, then file order
+};
+
+struct review_query
+{
+    const char *branch;         // NULL matches every branch
+    int min_id, max_id;         // Inclusive Review_ID range
+    int min_rating, max_rating; // Inclusive rating range
+    unsigned months;            // Bit m set for month m (0 = January); 0 matches all
+    unsigned columns;           // Fields the callback reads (1u << enum review_column); 0 for all
+    enum review_order order;
+    long long limit;            // Most reviews delivered; 0 for no limit
+};
+
+/* A new review; the store gives it the next Review_ID */
+struct review_input
+{
+    int rating;
+    const char *month;
+    const char *location;
+    const char *text;
+    const char *branch;
+};
+
+/* Changes to one review: a rating of 0 or a NULL field keeps the current value */
+struct review_update
+{
+    int id;
+    struct review_input set;
+};
+
+/* Called once per review; a nonzero return stops the scan */
+typedef int (*review_callback)(void *ctx, const struct review_view *review);
+
+/* A query matching every review, in file order */
+void review_query_init(struct review_query *q);
+
+/* Opens the store at path. The files need not exist yet: the first append creates them.
+ * Returns NULL when out of memory or the path is too long */
+struct review_store *review_store_open(const char *path);
+void review_store_close(struct review_store *store);
+
+/* Describes why the last failing call on store failed */
+const char *review_store_error(const struct review_store *store);
+
+/* Streams the reviews matching q (NULL for all) to cb in file order, ignoring q->order.
+ * Returns the number delivered, or -1 on error */
+long long review_store_scan(struct review_store *store, const struct review_query *q, review_callback cb, void *ctx);
+
+/* Like review_store_scan but honours q->order; sorted results are buffered in memory */
+long long review_store_query(struct review_store *store, const struct review_query *q, review_callback cb, void *ctx);
+
+/* Appends n reviews in one batch, storing the Review_IDs they got in ids (may be NULL).
+ * Returns the number appended, or -1 on error */
+int review_store_append(struct review_store *store, const struct review_input *reviews, int n, int *ids);
+
+/* Applies n updates in one rewrite of each affected file. Returns the number of reviews
+ * changed, or -1 on error */
+int review_store_update(struct review_store *store, const struct review_update *updates, int n);
+
+/* Removes the reviews with the n given IDs in one rewrite of each affected file. Returns
+ * the number removed, or -1 on error */
+int review_store_delete(struct review_store *store, const int *ids, int n);
+
+#pragma GCC visibility pop
+
+#endif
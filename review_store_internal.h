@@ -0,0 +1,462 @@
+/* Internals of the review store shared by review_store.c and the interactive program:
+ * the schema, the on-disk formats and the building blocks behind the review_store_* API.
+ * None of it is exported from the library; programs linking it see only review_store.h. */
+
+#ifndef REVIEW_STORE_INTERNAL_H
+#define REVIEW_STORE_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "review_store.h"
+
+#pragma GCC visibility push(hidden)
+
+/* Configuration */
+#define MAX_REVIEW_WIDTH 70 // Maximum width of review text column
+#define READ_CHUNK (1 << 20)   // Bytes read per refill by the record scanner
+#define READ_AHEAD_DEPTH 4     // Chunks a read-ahead thread may load before the parser takes them
+#define FINGERPRINT_LEN 64     // Bytes before a processed offset used to detect rewrites
+#define APPEND_FLUSH (1 << 20) // Buffered append bytes that force a commit
+#define SCRATCH_INIT 65536     // Initial size of a reader's unescaped field storage
+#define MAX_SHARDS 32          // Maximum number of branch shards
+#define PATH_LEN 512
+#define SHARD_DIR_SUFFIX ".shards"
+#define MANIFEST_NAME "manifest"
+#define ZONE_BLOCK_RECORDS 1024 // Records summarised by one zone map block
+#define ZONE_MAX_BRANCHES 31    // Branches with their own bit in a zone block
+#define ZONE_MAGIC "ZMAP0001"
+#define TEXT_MAGIC "ZTXT0001"
+#define TEXT_BLOCK_SIZE 65536   // Raw review text bytes compressed together
+#define TEXT_REF_MARK '\x1A'    // First byte of a Review_Text stored in the text store
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define CRC_MAGIC "CRC32C01"
+#define CRC_BLOCK_SIZE 65536    // Bytes covered by one checksum
+
+/* The review schema, one line per CSV column in file order:
+ * X(constant, header name, short name, type, encoding, wrap policy, display width limit or 0).
+ * INT columns get dedicated integer parsing and validation and are written as raw digits;
+ * QUOTED columns are always written in quotes. Parse, validate, serialize and render code
+ * and the CSV header are expanded from this list at compile time, so the hot paths have no
+ * per-field type checks. A new column is a line here plus its position in review_store.h */
+#define REVIEW_SCHEMA(X)                                                            \
+    X(COL_ID, "Review_ID", id, INT, RAW, NOWRAP, 0)                                 \
+    X(COL_RATING, "Rating", rating, INT, RAW, NOWRAP, 0)                            \
+    X(COL_MONTH, "Review_Month", month, TEXT, QUOTED, WRAP, 0)                      \
+    X(COL_LOCATION, "Reviewer_Location", location, TEXT, QUOTED, WRAP, 0)           \
+    X(COL_TEXT, "Review_Text", text, TEXT, QUOTED, WRAP, MAX_REVIEW_WIDTH)          \
+    X(COL_BRANCH, "Branch", branch, TEXT, QUOTED, WRAP, 0)
+
+#define SCHEMA_ENUM(col, name, key, type, encoding, wrap, width) col,
+enum review_col
+{
+    REVIEW_SCHEMA(SCHEMA_ENUM)
+    COLS // Number of columns
+};
+#define ALL_COLUMNS ((1u << COLS) - 1)
+
+_Static_assert(COLS == REVIEW_FIELDS, "review_store.h must list every schema column");
+
+/* The header line: every name behind a comma, the first comma skipped */
+#define SCHEMA_HEADER(col, name, key, type, encoding, wrap, width) "," name
+static const char schema_header[] = REVIEW_SCHEMA(SCHEMA_HEADER) "\n";
+#define CSV_HEADER (schema_header + 1)
+#define CSV_HEADER_LEN (sizeof(schema_header) - 2)
+
+/* The values of one review to be written, one member per column named by its short name */
+#define SCHEMA_VALUE_INT int
+#define SCHEMA_VALUE_TEXT const char *
+#define SCHEMA_VALUE(col, name, key, type, encoding, wrap, width) SCHEMA_VALUE_##type key;
+struct review_values
+{
+    REVIEW_SCHEMA(SCHEMA_VALUE)
+};
+
+//***************************** Instrumentation *****************************
+
+/* Phases an operation's time is split into; time outside every phase counts as PHASE_OTHER */
+enum prof_phase
+{
+    PHASE_OTHER,
+    PHASE_READ,   // open and read system calls
+    PHASE_PARSE,  // splitting records into fields
+    PHASE_SORT,
+    PHASE_RENDER, // wrapping and printing the table
+    PHASE_WRITE,
+    PHASE_SYNC,   // fsync / fdatasync
+    PHASE_LOCK,   // waiting for another writer
+    PHASE_COUNT
+};
+
+/* Counters of the running operation, printed by --stats or REVIEW_STATS=1 */
+struct profile
+{
+    int enabled;
+    const char *op;
+    enum prof_phase phase;
+    double start;
+    double mark; // when the current phase was entered
+    double seconds[PHASE_COUNT];
+    long long bytes_read;
+    long long rows_parsed;
+    long long bytes_parsed;
+    long long comparisons;
+    long long output_bytes;
+    long long bytes_written;
+    long long syncs;
+    long long heap_bytes; // heap in use when the operation started, -1 if unknown
+};
+
+/* Adds n to a profile counter; only a branch when profiling is off */
+#define PROF_COUNT(field, n)                                                 \
+    do                                                                       \
+    {                                                                        \
+        if (profile.enabled)                                                 \
+            __atomic_fetch_add(&profile.field, (n), __ATOMIC_RELAXED);       \
+    } while (0)
+
+static inline double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+extern struct profile profile;
+extern __thread int prof_in_task;
+
+enum prof_phase prof_enter(enum prof_phase phase);
+
+//***************************** Record Scanner *****************************
+
+/* One CSV record; fields point into the reader's scratch buffer */
+struct csv_record
+{
+    long long offset;       // Byte offset of the record in the file
+    size_t length;          // Raw length in bytes including the line break
+    int nfields;            // Number of fields found (may exceed COLS)
+    char *field[COLS];      // Unescaped, NUL-terminated field text
+    size_t field_len[COLS]; // Length of each field
+};
+
+/* Integer parser for INT columns: optional sign and digits, nothing locale dependent */
+static inline int parse_int(const char *s, size_t len)
+{
+    size_t i = 0;
+    unsigned v = 0;
+    int neg = 0;
+
+    while (i < len && s[i] == ' ')
+        i++;
+    if (i < len && (s[i] == '-' || s[i] == '+'))
+        neg = s[i++] == '-';
+    while (i < len && (unsigned char)(s[i] - '0') < 10)
+        v = v * 10 + (unsigned)(s[i++] - '0');
+    return neg ? -(int)v : (int)v;
+}
+
+/* 1 when a field holds an integer and nothing else */
+static inline int int_valid(const char *s, size_t len)
+{
+    size_t i = (len > 0 && (s[0] == '-' || s[0] == '+')) ? 1 : 0;
+
+    if (i == len || len > 10)
+        return 0;
+    for (; i < len; i++)
+    {
+        if ((unsigned char)(s[i] - '0') >= 10)
+            return 0;
+    }
+    return 1;
+}
+
+/* record_id(rec), record_rating(rec), ...: one typed getter per INT column */
+#define SCHEMA_GETTER_INT(col, key) \
+    static inline int record_##key(const struct csv_record *rec) { return parse_int(rec->field[col], rec->field_len[col]); }
+#define SCHEMA_GETTER_TEXT(col, key)
+#define SCHEMA_GETTER(col, name, key, type, encoding, wrap, width) SCHEMA_GETTER_##type(col, key)
+REVIEW_SCHEMA(SCHEMA_GETTER)
+
+/* Checks a record against the schema: the column count and every INT column */
+#define SCHEMA_VALID_INT(col) &&int_valid(rec->field[col], rec->field_len[col])
+#define SCHEMA_VALID_TEXT(col)
+#define SCHEMA_VALID(col, name, key, type, encoding, wrap, width) SCHEMA_VALID_##type(col)
+static inline int record_valid(const struct csv_record *rec)
+{
+    return rec->nfields == COLS REVIEW_SCHEMA(SCHEMA_VALID);
+}
+
+/* Streams records out of a file descriptor in large chunks */
+struct csv_reader
+{
+    int fd;
+    long long pos;      // File offset of buf[0]
+    char *buf;
+    size_t len;         // Bytes currently held in buf
+    size_t cap;
+    size_t next;        // Parse position inside buf
+    int eof;
+    int stream;         // fd is a pipe or terminal: read() instead of pread()
+    long long limit;    // File size when opened: bytes appended later belong to a newer snapshot
+    char *scratch;      // Storage for unescaped fields
+    size_t scratch_cap;
+    unsigned want;      // Fields split out of each record (bit per column); the rest read as ""
+    struct read_ahead *ahead; // Loads the next chunks while these are parsed; NULL reads on demand
+};
+
+/* What a file looked like up to some offset; tells appends apart from rewrites */
+struct file_mark
+{
+    long long offset;                     // Bytes already processed
+    dev_t dev;                            // Identity of the processed file
+    ino_t ino;
+    unsigned char tail[FINGERPRINT_LEN];  // Bytes just before offset
+    int tail_len;
+};
+
+size_t find_record_end(const char *buf, size_t len);
+void reader_read_ahead(struct csv_reader *rd);
+int reader_open(struct csv_reader *rd, int fd, long long start);
+void reader_close(struct csv_reader *rd);
+long long reader_offset(const struct csv_reader *rd);
+int reader_next(struct csv_reader *rd, struct csv_record *rec, int accept_partial);
+void reader_seek(struct csv_reader *rd, long long offset);
+void reader_skip_header(struct csv_reader *rd);
+void mark_file(struct file_mark *fm, int fd, const struct stat *st, long long offset);
+int mark_is_prefix(const struct file_mark *fm, int fd, const struct stat *st);
+void temp_path(const char *path, char *out, size_t size);
+
+//***************************** Checksums *****************************
+
+/* CRC32C (Castagnoli) of fixed-size blocks of each data file, kept in a <csv>.crc sidecar.
+ * Rewrites record fresh checksums once the new file is complete and appends extend them, so
+ * a torn or truncated write shows up as blocks that no longer match */
+struct crc_header
+{
+    char magic[8];
+    uint32_t block_size;
+    uint32_t nblocks;
+    long long length; // Bytes covered; the last block may be partial
+};
+
+void checksum_path(const char *path, char *out, size_t size);
+int checksums_load(const char *path, struct crc_header *h, uint32_t **crc);
+int crc_blocks(int fd, uint32_t block_size, long long length, long long first, long long last, uint32_t *crc);
+int checksums_record(const char *path);
+
+//***************************** Storage *****************************
+
+/* Growable byte buffer used to build output before one write() */
+struct out_buffer
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed; // bytes were dropped for lack of memory: the contents must not be written
+};
+
+/* When appended records are forced to disk */
+enum durability
+{
+    DURABLE_NONE,   // leave it to the OS page cache
+    DURABLE_BATCH,  // one fdatasync per committed batch
+    DURABLE_RECORD  // fdatasync after every record
+};
+
+/* Appends buffered in memory and written with a single write() per commit */
+struct append_batch
+{
+    int fd;
+    char path[PATH_LEN];       // for extending the checksums of what gets written
+    struct out_buffer out;
+    int pending;               // records buffered since the last commit
+    enum durability durability;
+};
+
+void out_put(struct out_buffer *ob, const char *bytes, size_t n);
+void out_putc(struct out_buffer *ob, char ch);
+void out_free(struct out_buffer *ob);
+int write_all(int fd, const char *bytes, size_t n);
+int file_sync(int fd);
+int dir_sync(const char *path);
+void write_csv_field(struct out_buffer *ob, const char *text);
+int dataset_lock(const char *filename);
+void dataset_unlock(int fd);
+enum durability parse_durability(const char *name, enum durability def);
+int append_open(struct append_batch *ab, const char *filename, enum durability durability);
+void put_review(struct out_buffer *ob, const struct review_values *v);
+int append_csv_record(struct append_batch *ab, const struct csv_record *rec);
+int append_close(struct append_batch *ab);
+
+//***************************** Text Store *****************************
+
+/* Open text store with the most recently decompressed block cached */
+struct text_store
+{
+    int fd;
+    long long cached;      // Offset of the cached block, -1 if none
+    char *raw;
+    size_t raw_cap;
+    uint32_t *starts;      // Start of each text inside raw
+    size_t starts_cap;
+    uint32_t count;
+    unsigned char *comp;
+    size_t comp_cap;
+};
+
+/* Collects texts into a block and appends it to the store when full */
+struct text_writer
+{
+    int fd;
+    long long end;          // Offset where the next block goes
+    struct out_buffer raw;  // Texts of the open block, '\0'-separated
+    uint32_t count;
+    unsigned char *comp;
+    size_t comp_cap;
+};
+
+int is_text_ref(const char *field);
+void text_store_name(const char *path, char *out, size_t size);
+int text_store_open(struct text_store *ts, const char *path);
+void text_store_close(struct text_store *ts);
+int grow_buffer(void **buf, size_t *cap, size_t n);
+const char *text_store_get(struct text_store *ts, const char *ref, size_t *len);
+void resolve_review_text(const char *path, char *buf, size_t size);
+int text_writer_open(struct text_writer *tw, const char *path);
+int text_writer_add(struct text_writer *tw, const char *text, char *ref, size_t size);
+int text_writer_close(struct text_writer *tw);
+
+//***************************** Sharded Storage *****************************
+
+/* Sharded layout: one CSV per branch in <data file>.shards/ plus a manifest.
+ * The manifest owns Review_ID allocation so IDs stay unique across shards. */
+struct shard_manifest
+{
+    int next_id;                // Next Review_ID to hand out
+    int nshards;
+    char branch[MAX_SHARDS][50];
+    char file[MAX_SHARDS][100]; // File name inside the shard directory
+};
+
+/* Row predicates; blocks and shards that can't match are skipped */
+struct review_filter
+{
+    const char *branch;     // NULL matches every branch
+    int min_id, max_id;     // Inclusive Review_ID range
+    int min_rating, max_rating;
+    unsigned months;        // Bit m set for month m (0 = January); 0 matches all
+    unsigned columns;       // Fields the caller reads (bit per column); 0 for all
+};
+
+/* Summary of ZONE_BLOCK_RECORDS consecutive records */
+struct zone_block
+{
+    long long start;        // Offset of the first record
+    long long end;          // Offset just after the last record
+    int records;
+    int min_id, max_id;
+    int min_rating, max_rating;
+    unsigned months;        // Months present (bit 0 = January)
+    unsigned branches;      // Branches present, as bits into the zone map's branch list
+};
+
+/* Zone map of one data file, kept in a <file>.zonemap sidecar */
+struct zone_map
+{
+    struct file_mark mark;  // Extent and fingerprint of the file that was summarised
+    int block_records;
+    int nbranch;
+    char branch[ZONE_MAX_BRANCHES][50];
+    int nblocks;
+    int cap;
+    struct zone_block *blocks;
+};
+
+/* Streams records from the CSV or from its shards. A merged scan over all
+ * shards returns records in Review_ID order, like the single file. */
+struct review_scan
+{
+    struct review_filter filter;       // Only records matching this are returned
+    int use_zones;                     // Skip blocks through the zone maps
+    int zoned[MAX_SHARDS];             // Source has a usable zone map
+    int sharded;
+    int nsrc;
+    int fd[MAX_SHARDS];
+    struct csv_reader rd[MAX_SHARDS];
+    struct csv_record cur[MAX_SHARDS];
+    int ready[MAX_SHARDS];             // cur[] holds a record not yet returned
+    struct zone_map zm[MAX_SHARDS];
+    int block[MAX_SHARDS];             // Zone block being read
+    struct text_store ts[MAX_SHARDS];  // Compressed Review_Text of each source
+    int skip_text;                     // Leave text references unresolved
+    int last;                          // Source of the record returned last
+    long long blocks_total;            // Zone blocks in the sources opened
+    long long blocks_read;             // Zone blocks that could not be skipped
+};
+
+/* Appends new reviews to the CSV, or to the shard of their branch */
+struct review_writer
+{
+    const char *filename;
+    enum durability durability;
+    int sharded;
+    struct shard_manifest manifest;
+    struct append_batch batch[MAX_SHARDS]; // batch[0] is the CSV when not sharded
+    int open[MAX_SHARDS];
+    int next_id;
+    int lock;                              // dataset lock, held until writer_close
+};
+
+extern const char *month_names[12];
+extern const char *column_names[COLS];
+
+void shard_path(const char *filename, const char *name, char *out, size_t size);
+int manifest_load(const char *filename, struct shard_manifest *m);
+int manifest_save(const char *filename, const struct shard_manifest *m);
+int shard_for_branch(struct shard_manifest *m, const char *branch, int create);
+int data_files(const char *filename, char paths[][PATH_LEN]);
+int shards_hold(const char *filename, int exclusive);
+void shards_release(int fd);
+int month_lookup(const char *s, size_t len);
+int month_index(const char *name);
+int column_index(const char *name);
+void filter_init(struct review_filter *f);
+unsigned filter_columns(const struct review_filter *f);
+int filter_restricts_rows(const struct review_filter *f);
+int filter_match(const struct review_filter *f, const struct csv_record *rec);
+void zonemap_free(struct zone_map *zm);
+int zone_block_may_match(struct zone_map *zm, int b, const struct review_filter *f);
+void zonemap_path(const char *path, char *out, size_t size);
+int zonemap_covers(const struct zone_map *zm, int fd);
+void sidecars_invalidate(const char *path);
+int zonemap_sync(const char *path, struct zone_map *zm, int block_records);
+void scan_close(struct review_scan *sc);
+int scan_open(struct review_scan *sc, const char *filename, const struct review_filter *filter);
+const struct csv_record *scan_next(struct review_scan *sc);
+int get_next_id(const char *filename);
+int writer_open(struct review_writer *w, const char *filename, enum durability durability);
+int writer_add(struct review_writer *w, const struct review_values *v);
+int writer_close(struct review_writer *w);
+
+//***************************** Review Store *****************************
+
+/* One kept review; its fields point into buf */
+struct top_entry
+{
+    int rating;
+    int id;
+    char *buf;
+    size_t cap;
+    struct csv_record rec;
+};
+
+int top_store(struct top_entry *e, const struct csv_record *rec, int rating, int id);
+
+#pragma GCC visibility pop
+
+#endif